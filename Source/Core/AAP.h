@@ -18,7 +18,10 @@
 
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <span>
+#include <algorithm>
 #include <vector>
 #include <optional>
 #include <functional>
@@ -139,134 +142,177 @@ enum class BatteryStatus : uint8_t {
     Disconnected = 0x04
 };
 
+//////////////////////////////////////////////////
+// Packet Layout
+//
+// Every packet starts with the same header: 04 00 04 00 [opcode] 00
+// Settings packets (opcode 0x09) carry the setting id at byte 6 and its value at byte 7.
+//
+
+enum class Opcode : uint8_t {
+    Battery = 0x04,
+    EarDetection = 0x06,
+    Settings = 0x09,
+    HeadTracking = 0x17,
+    SpeakingLevel = 0x4B,
+};
+
+enum class SettingId : uint8_t {
+    NoiseControl = 0x0D,
+    AutomaticEarDetection = 0x1B,
+    LoudSoundReduction = 0x25,
+    PersonalizedVolume = 0x26,
+    ConversationalAwareness = 0x28,
+    AdaptiveNoise = 0x2E,
+    AdaptiveTransparencyLevel = 0x38,
+};
+
+constexpr size_t kHeaderSize = 6;
+constexpr size_t kOpcodeOffset = 4;
+constexpr size_t kSettingIdOffset = 6;
+constexpr size_t kSettingValueOffset = 7;
+constexpr size_t kHeadTrackingPacketSize = 56;
+
+inline bool HasHeader(std::span<const uint8_t> data)
+{
+    return data.size() >= kHeaderSize && data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 &&
+           data[3] == 0x00 && data[5] == 0x00;
+}
+
+inline bool IsPacketOf(std::span<const uint8_t> data, Opcode opcode)
+{
+    return HasHeader(data) && data[kOpcodeOffset] == Helper::ToUnderlying(opcode);
+}
+
+inline bool IsSettingOf(std::span<const uint8_t> data, SettingId id)
+{
+    return data.size() > kSettingIdOffset && IsPacketOf(data, Opcode::Settings) &&
+           data[kSettingIdOffset] == Helper::ToUnderlying(id);
+}
+
 //////////////////////////////////////////////////
 // AAP Packets
 //
+// Everything here is built at compile time, sending a packet doesn't allocate.
+//
 
 namespace Packets {
 
 // Handshake packet - Required to establish connection
 // Without this, AirPods will not respond to any packets
-inline const std::vector<uint8_t> Handshake = {
+inline constexpr auto Handshake = std::to_array<uint8_t>({
     0x00, 0x00, 0x04, 0x00, 0x01, 0x00, 0x02, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+});
 
 // Enable features packet - Enables Conversational Awareness and Adaptive Transparency
 // This is needed for CA to work when audio is playing
-inline const std::vector<uint8_t> EnableFeatures = {
+inline constexpr auto EnableFeatures = std::to_array<uint8_t>({
     0x04, 0x00, 0x04, 0x00, 0x4D, 0x00, 0xFF, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+});
 
 // Request notifications packet - Required to receive battery, ear detection, noise control updates
-inline const std::vector<uint8_t> RequestNotifications = {
+inline constexpr auto RequestNotifications = std::to_array<uint8_t>({
     0x04, 0x00, 0x04, 0x00, 0x0F, 0x00, 0xFF, 0xFF, 0xFF, 0xFF
-};
-
-// Noise Control Mode packet builder
-inline std::vector<uint8_t> BuildNoiseControlPacket(NoiseControlMode mode) {
-    return {
-        0x04, 0x00, 0x04, 0x00, 0x09, 0x00, 0x0D,
-        static_cast<uint8_t>(mode), 0x00, 0x00, 0x00
-    };
-}
+});
 
-// Conversational Awareness toggle packet builder
-inline std::vector<uint8_t> BuildConversationalAwarenessPacket(bool enable) {
-    return {
-        0x04, 0x00, 0x04, 0x00, 0x09, 0x00, 0x28,
-        enable ? static_cast<uint8_t>(0x01) : static_cast<uint8_t>(0x02),
-        0x00, 0x00, 0x00
-    };
-}
-
-// Adaptive Audio Noise level packet builder (0-100)
-inline std::vector<uint8_t> BuildAdaptiveNoisePacket(uint8_t level) {
-    return {
-        0x04, 0x00, 0x04, 0x00, 0x09, 0x00, 0x2E,
-        level, 0x00, 0x00, 0x00
-    };
-}
+// Request current settings packet
+inline constexpr auto RequestSettings = std::to_array<uint8_t>({
+    0x04, 0x00, 0x04, 0x00, 0x0D, 0x00, 0xFF, 0xFF, 0xFF, 0xFF
+});
 
 // Head tracking start packet
-inline const std::vector<uint8_t> StartHeadTracking = {
+inline constexpr auto StartHeadTracking = std::to_array<uint8_t>({
     0x04, 0x00, 0x04, 0x00, 0x17, 0x00, 0x00, 0x00,
     0x10, 0x00, 0x10, 0x00, 0x08, 0xA1, 0x02, 0x42,
     0x0B, 0x08, 0x0E, 0x10, 0x02, 0x1A, 0x05, 0x01,
     0x40, 0x9C, 0x00, 0x00
-};
+});
 
 // Head tracking stop packet
-inline const std::vector<uint8_t> StopHeadTracking = {
+inline constexpr auto StopHeadTracking = std::to_array<uint8_t>({
     0x04, 0x00, 0x04, 0x00, 0x17, 0x00, 0x00, 0x00,
     0x10, 0x00, 0x11, 0x00, 0x08, 0x7E, 0x10, 0x02,
     0x42, 0x0B, 0x08, 0x4E, 0x10, 0x02, 0x1A, 0x05,
     0x01, 0x00, 0x00, 0x00, 0x00
-};
+});
 
-// Personalized Volume toggle packet builder
-inline std::vector<uint8_t> BuildPersonalizedVolumePacket(bool enable) {
+// Settings commands share one layout: header, setting id, value and 3 bytes of padding
+constexpr size_t kSettingPacketSize = 11;
+using SettingPacket = std::array<uint8_t, kSettingPacketSize>;
+
+constexpr SettingPacket BuildSettingPacket(SettingId id, uint8_t value)
+{
     return {
-        0x04, 0x00, 0x04, 0x00, 0x09, 0x00, 0x26,
-        enable ? static_cast<uint8_t>(0x01) : static_cast<uint8_t>(0x02),
-        0x00, 0x00, 0x00
-    };
+        0x04, 0x00, 0x04, 0x00, Helper::ToUnderlying(Opcode::Settings), 0x00,
+        Helper::ToUnderlying(id), value, 0x00, 0x00, 0x00};
+}
+
+// Noise Control Mode packet builder
+constexpr SettingPacket BuildNoiseControlPacket(NoiseControlMode mode)
+{
+    return BuildSettingPacket(SettingId::NoiseControl, Helper::ToUnderlying(mode));
+}
+
+// Conversational Awareness toggle packet builder
+constexpr SettingPacket BuildConversationalAwarenessPacket(bool enable)
+{
+    return BuildSettingPacket(SettingId::ConversationalAwareness, enable ? 0x01 : 0x02);
+}
+
+// Adaptive Audio Noise level packet builder (0-100)
+constexpr SettingPacket BuildAdaptiveNoisePacket(uint8_t level)
+{
+    return BuildSettingPacket(SettingId::AdaptiveNoise, level);
+}
+
+// Personalized Volume toggle packet builder
+constexpr SettingPacket BuildPersonalizedVolumePacket(bool enable)
+{
+    return BuildSettingPacket(SettingId::PersonalizedVolume, enable ? 0x01 : 0x02);
 }
 
 // Loud Sound Reduction toggle packet builder (Headphone Safety)
-inline std::vector<uint8_t> BuildLoudSoundReductionPacket(bool enable) {
-    return {
-        0x04, 0x00, 0x04, 0x00, 0x09, 0x00, 0x25,
-        enable ? static_cast<uint8_t>(0x01) : static_cast<uint8_t>(0x00),
-        0x00, 0x00, 0x00
-    };
+constexpr SettingPacket BuildLoudSoundReductionPacket(bool enable)
+{
+    return BuildSettingPacket(SettingId::LoudSoundReduction, enable ? 0x01 : 0x00);
 }
 
 // Off-Ear Auto Pause toggle packet builder (Automatic Ear Detection)
-inline std::vector<uint8_t> BuildAutomaticEarDetectionPacket(bool enable) {
-    return {
-        0x04, 0x00, 0x04, 0x00, 0x09, 0x00, 0x1B,
-        enable ? static_cast<uint8_t>(0x01) : static_cast<uint8_t>(0x02),
-        0x00, 0x00, 0x00
-    };
+constexpr SettingPacket BuildAutomaticEarDetectionPacket(bool enable)
+{
+    return BuildSettingPacket(SettingId::AutomaticEarDetection, enable ? 0x01 : 0x02);
 }
 
 // Adaptive Transparency level packet builder (0x00-0x32 = 0-50)
-inline std::vector<uint8_t> BuildAdaptiveTransparencyLevelPacket(uint8_t level) {
-    // Clamp level to 0-50
-    if (level > 50) level = 50;
-    return {
-        0x04, 0x00, 0x04, 0x00, 0x09, 0x00, 0x38,
-        level, 0x00, 0x00, 0x00
-    };
+constexpr SettingPacket BuildAdaptiveTransparencyLevelPacket(uint8_t level)
+{
+    return BuildSettingPacket(SettingId::AdaptiveTransparencyLevel, std::min<uint8_t>(level, 50));
 }
 
-// Request current settings packet
-inline const std::vector<uint8_t> RequestSettings = {
-    0x04, 0x00, 0x04, 0x00, 0x0D, 0x00, 0xFF, 0xFF, 0xFF, 0xFF
-};
+// Largest packet the host sends, so commands fit in fixed-size buffers
+constexpr size_t kMaxCommandSize = std::max({
+    Handshake.size(), EnableFeatures.size(), RequestNotifications.size(), RequestSettings.size(),
+    StartHeadTracking.size(), StopHeadTracking.size(), kSettingPacketSize});
+
+static_assert(BuildNoiseControlPacket(NoiseControlMode::Transparency) ==
+              SettingPacket{0x04, 0x00, 0x04, 0x00, 0x09, 0x00, 0x0D, 0x03, 0x00, 0x00, 0x00});
 
 } // namespace Packets
 
 //////////////////////////////////////////////////
-// Packet Parsing
+// Payload Decoding
+//
+// These functions assume the header has already been checked, they are shared by the `Parse*`
+// functions below and the packet dispatcher in `Manager`.
 //
 
-// Parse noise control mode from notification packet
-// Packet format: 04 00 04 00 09 00 0D [mode] 00 00 00
-inline std::optional<NoiseControlMode> ParseNoiseControlNotification(const std::vector<uint8_t>& data) {
-    if (data.size() < 8) {
-        return std::nullopt;
-    }
-    
-    // Check header bytes for noise control notification
-    if (data[0] != 0x04 || data[1] != 0x00 || data[2] != 0x04 || data[3] != 0x00 ||
-        data[4] != 0x09 || data[5] != 0x00 || data[6] != 0x0D) {
-        return std::nullopt;
-    }
-    
-    switch (data[7]) {
+namespace Decode {
+
+constexpr NoiseControlMode NoiseControl(uint8_t value)
+{
+    switch (value) {
         case 0x01: return NoiseControlMode::Off;
         case 0x02: return NoiseControlMode::NoiseCancellation;
         case 0x03: return NoiseControlMode::Transparency;
@@ -275,39 +321,17 @@ inline std::optional<NoiseControlMode> ParseNoiseControlNotification(const std::
     }
 }
 
-// Parse conversational awareness state from notification
-// Packet format: 04 00 04 00 09 00 28 [status] 00 00 00
-inline std::optional<ConversationalAwarenessState> ParseConversationalAwarenessState(const std::vector<uint8_t>& data) {
-    if (data.size() < 8) {
-        return std::nullopt;
-    }
-    
-    if (data[0] != 0x04 || data[1] != 0x00 || data[2] != 0x04 || data[3] != 0x00 ||
-        data[4] != 0x09 || data[5] != 0x00 || data[6] != 0x28) {
-        return std::nullopt;
-    }
-    
-    switch (data[7]) {
+constexpr ConversationalAwarenessState ConversationalAwareness(uint8_t value)
+{
+    switch (value) {
         case 0x01: return ConversationalAwarenessState::Enabled;
         case 0x02: return ConversationalAwarenessState::Disabled;
         default: return ConversationalAwarenessState::Unknown;
     }
 }
 
-// Parse conversational awareness speaking level notification
-// Packet format: 04 00 04 00 4B 00 02 00 01 [level]
-inline std::optional<SpeakingLevel> ParseSpeakingLevel(const std::vector<uint8_t>& data) {
-    if (data.size() < 10) {
-        return std::nullopt;
-    }
-    
-    if (data[0] != 0x04 || data[1] != 0x00 || data[2] != 0x04 || data[3] != 0x00 ||
-        data[4] != 0x4B || data[5] != 0x00 || data[6] != 0x02 || data[7] != 0x00 ||
-        data[8] != 0x01) {
-        return std::nullopt;
-    }
-    
-    uint8_t level = data[9];
+constexpr SpeakingLevel Speaking(uint8_t level)
+{
     if (level <= 0x02) {
         return SpeakingLevel::StartedSpeaking_GreatlyReduce;
     } else if (level == 0x03) {
@@ -319,97 +343,132 @@ inline std::optional<SpeakingLevel> ParseSpeakingLevel(const std::vector<uint8_t
     return SpeakingLevel::Unknown;
 }
 
-// Parse ear detection notification
-// Packet format: 04 00 04 00 06 00 [primary pod] [secondary pod]
-inline std::optional<std::pair<EarStatus, EarStatus>> ParseEarDetection(const std::vector<uint8_t>& data) {
-    if (data.size() < 8) {
+constexpr EarStatus Ear(uint8_t value)
+{
+    switch (value) {
+        case 0x00: return EarStatus::InEar;
+        case 0x01: return EarStatus::OutOfEar;
+        case 0x02: return EarStatus::InCase;
+        default: return EarStatus::Unknown;
+    }
+}
+
+constexpr PersonalizedVolumeState PersonalizedVolume(uint8_t value)
+{
+    switch (value) {
+        case 0x01: return PersonalizedVolumeState::Enabled;
+        case 0x02: return PersonalizedVolumeState::Disabled;
+        default: return PersonalizedVolumeState::Unknown;
+    }
+}
+
+// 0x01 = Enabled (pause on ear removal), 0x02 = Disabled
+constexpr bool AutomaticEarDetection(uint8_t value)
+{
+    return value == 0x01;
+}
+
+constexpr LoudSoundReductionState LoudSoundReduction(uint8_t value)
+{
+    switch (value) {
+        case 0x01: return LoudSoundReductionState::Enabled;
+        case 0x00: return LoudSoundReductionState::Disabled;
+        default: return LoudSoundReductionState::Unknown;
+    }
+}
+
+constexpr int16_t Int16LE(std::span<const uint8_t> data, size_t offset)
+{
+    return static_cast<int16_t>(data[offset] | (data[offset + 1] << 8));
+}
+
+} // namespace Decode
+
+//////////////////////////////////////////////////
+// Packet Parsing
+//
+
+// Parse noise control mode from notification packet
+// Packet format: 04 00 04 00 09 00 0D [mode] 00 00 00
+inline std::optional<NoiseControlMode> ParseNoiseControlNotification(std::span<const uint8_t> data)
+{
+    if (data.size() < 8 || !IsSettingOf(data, SettingId::NoiseControl)) {
         return std::nullopt;
     }
-    
-    if (data[0] != 0x04 || data[1] != 0x00 || data[2] != 0x04 || data[3] != 0x00 ||
-        data[4] != 0x06 || data[5] != 0x00) {
+    return Decode::NoiseControl(data[kSettingValueOffset]);
+}
+
+// Parse conversational awareness state from notification
+// Packet format: 04 00 04 00 09 00 28 [status] 00 00 00
+inline std::optional<ConversationalAwarenessState>
+ParseConversationalAwarenessState(std::span<const uint8_t> data)
+{
+    if (data.size() < 8 || !IsSettingOf(data, SettingId::ConversationalAwareness)) {
         return std::nullopt;
     }
-    
-    auto toEarStatus = [](uint8_t b) -> EarStatus {
-        switch (b) {
-            case 0x00: return EarStatus::InEar;
-            case 0x01: return EarStatus::OutOfEar;
-            case 0x02: return EarStatus::InCase;
-            default: return EarStatus::Unknown;
-        }
-    };
-    
-    return std::make_pair(toEarStatus(data[6]), toEarStatus(data[7]));
+    return Decode::ConversationalAwareness(data[kSettingValueOffset]);
 }
 
-// Parse personalized volume state from notification
-// Packet format: 04 00 04 00 09 00 26 [status] 00 00 00
-inline std::optional<PersonalizedVolumeState> ParsePersonalizedVolumeState(const std::vector<uint8_t>& data) {
-    if (data.size() < 8) {
+// Parse conversational awareness speaking level notification
+// Packet format: 04 00 04 00 4B 00 02 00 01 [level]
+inline std::optional<SpeakingLevel> ParseSpeakingLevel(std::span<const uint8_t> data)
+{
+    if (data.size() < 10 || !IsPacketOf(data, Opcode::SpeakingLevel) || data[6] != 0x02 ||
+        data[7] != 0x00 || data[8] != 0x01)
+    {
         return std::nullopt;
     }
-    
-    if (data[0] != 0x04 || data[1] != 0x00 || data[2] != 0x04 || data[3] != 0x00 ||
-        data[4] != 0x09 || data[5] != 0x00 || data[6] != 0x26) {
+    return Decode::Speaking(data[9]);
+}
+
+// Parse ear detection notification
+// Packet format: 04 00 04 00 06 00 [primary pod] [secondary pod]
+inline std::optional<std::pair<EarStatus, EarStatus>> ParseEarDetection(std::span<const uint8_t> data)
+{
+    if (data.size() < 8 || !IsPacketOf(data, Opcode::EarDetection)) {
         return std::nullopt;
     }
-    
-    switch (data[7]) {
-        case 0x01: return PersonalizedVolumeState::Enabled;
-        case 0x02: return PersonalizedVolumeState::Disabled;
-        default: return PersonalizedVolumeState::Unknown;
+    return std::make_pair(Decode::Ear(data[6]), Decode::Ear(data[7]));
+}
+
+// Parse personalized volume state from notification
+// Packet format: 04 00 04 00 09 00 26 [status] 00 00 00
+inline std::optional<PersonalizedVolumeState> ParsePersonalizedVolumeState(std::span<const uint8_t> data)
+{
+    if (data.size() < 8 || !IsSettingOf(data, SettingId::PersonalizedVolume)) {
+        return std::nullopt;
     }
+    return Decode::PersonalizedVolume(data[kSettingValueOffset]);
 }
 
 // Parse automatic ear detection (off-ear pause) state from notification
 // Packet format: 04 00 04 00 09 00 1B [status] 00 00 00
-inline std::optional<bool> ParseAutomaticEarDetectionState(const std::vector<uint8_t>& data) {
-    if (data.size() < 8) {
-        return std::nullopt;
-    }
-    
-    if (data[0] != 0x04 || data[1] != 0x00 || data[2] != 0x04 || data[3] != 0x00 ||
-        data[4] != 0x09 || data[5] != 0x00 || data[6] != 0x1B) {
+inline std::optional<bool> ParseAutomaticEarDetectionState(std::span<const uint8_t> data)
+{
+    if (data.size() < 8 || !IsSettingOf(data, SettingId::AutomaticEarDetection)) {
         return std::nullopt;
     }
-    
-    // 0x01 = Enabled (pause on ear removal), 0x02 = Disabled
-    return data[7] == 0x01;
+    return Decode::AutomaticEarDetection(data[kSettingValueOffset]);
 }
 
 // Parse loud sound reduction (headphone safety) state
 // Packet format: 04 00 04 00 09 00 25 [status] 00 00 00
-inline std::optional<LoudSoundReductionState> ParseLoudSoundReductionState(const std::vector<uint8_t>& data) {
-    if (data.size() < 8) {
-        return std::nullopt;
-    }
-    
-    if (data[0] != 0x04 || data[1] != 0x00 || data[2] != 0x04 || data[3] != 0x00 ||
-        data[4] != 0x09 || data[5] != 0x00 || data[6] != 0x25) {
+inline std::optional<LoudSoundReductionState> ParseLoudSoundReductionState(std::span<const uint8_t> data)
+{
+    if (data.size() < 8 || !IsSettingOf(data, SettingId::LoudSoundReduction)) {
         return std::nullopt;
     }
-    
-    switch (data[7]) {
-        case 0x01: return LoudSoundReductionState::Enabled;
-        case 0x00: return LoudSoundReductionState::Disabled;
-        default: return LoudSoundReductionState::Unknown;
-    }
+    return Decode::LoudSoundReduction(data[kSettingValueOffset]);
 }
 
 // Parse adaptive transparency level
 // Packet format: 04 00 04 00 09 00 38 [level] 00 00 00
-inline std::optional<uint8_t> ParseAdaptiveTransparencyLevel(const std::vector<uint8_t>& data) {
-    if (data.size() < 8) {
-        return std::nullopt;
-    }
-    
-    if (data[0] != 0x04 || data[1] != 0x00 || data[2] != 0x04 || data[3] != 0x00 ||
-        data[4] != 0x09 || data[5] != 0x00 || data[6] != 0x38) {
+inline std::optional<uint8_t> ParseAdaptiveTransparencyLevel(std::span<const uint8_t> data)
+{
+    if (data.size() < 8 || !IsSettingOf(data, SettingId::AdaptiveTransparencyLevel)) {
         return std::nullopt;
     }
-    
-    return data[7];
+    return data[kSettingValueOffset];
 }
 
 // Structure to hold head tracking data
@@ -423,23 +482,18 @@ struct HeadTrackingData {
 
 // Parse head tracking sensor data
 // Offsets: orientation1=43, orientation2=45, orientation3=47, hAccel=51, vAccel=53
-inline std::optional<HeadTrackingData> ParseHeadTrackingData(const std::vector<uint8_t>& data) {
-    if (data.size() < 56) {
+inline std::optional<HeadTrackingData> ParseHeadTrackingData(std::span<const uint8_t> data)
+{
+    if (data.size() < kHeadTrackingPacketSize) {
         return std::nullopt;
     }
-    
+
     HeadTrackingData result;
-    
-    auto readInt16LE = [&data](size_t offset) -> int16_t {
-        return static_cast<int16_t>(data[offset] | (data[offset + 1] << 8));
-    };
-    
-    result.orientation1 = readInt16LE(43);
-    result.orientation2 = readInt16LE(45);
-    result.orientation3 = readInt16LE(47);
-    result.horizontalAcceleration = readInt16LE(51);
-    result.verticalAcceleration = readInt16LE(53);
-    
+    result.orientation1 = Decode::Int16LE(data, 43);
+    result.orientation2 = Decode::Int16LE(data, 45);
+    result.orientation3 = Decode::Int16LE(data, 47);
+    result.horizontalAcceleration = Decode::Int16LE(data, 51);
+    result.verticalAcceleration = Decode::Int16LE(data, 53);
     return result;
 }
 
@@ -447,74 +501,65 @@ inline std::optional<HeadTrackingData> ParseHeadTrackingData(const std::vector<u
 // Check if packet is a specific type
 //
 
-inline bool IsNoiseControlNotification(const std::vector<uint8_t>& data) {
-    return data.size() >= 7 &&
-           data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 && data[3] == 0x00 &&
-           data[4] == 0x09 && data[5] == 0x00 && data[6] == 0x0D;
+inline bool IsNoiseControlNotification(std::span<const uint8_t> data)
+{
+    return IsSettingOf(data, SettingId::NoiseControl);
 }
 
-inline bool IsConversationalAwarenessNotification(const std::vector<uint8_t>& data) {
-    return data.size() >= 7 &&
-           data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 && data[3] == 0x00 &&
-           data[4] == 0x09 && data[5] == 0x00 && data[6] == 0x28;
+inline bool IsConversationalAwarenessNotification(std::span<const uint8_t> data)
+{
+    return IsSettingOf(data, SettingId::ConversationalAwareness);
 }
 
-inline bool IsSpeakingLevelNotification(const std::vector<uint8_t>& data) {
-    return data.size() >= 9 &&
-           data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 && data[3] == 0x00 &&
-           data[4] == 0x4B && data[5] == 0x00 && data[6] == 0x02 && data[7] == 0x00 &&
-           data[8] == 0x01;
+inline bool IsSpeakingLevelNotification(std::span<const uint8_t> data)
+{
+    return data.size() >= 9 && IsPacketOf(data, Opcode::SpeakingLevel) && data[6] == 0x02 &&
+           data[7] == 0x00 && data[8] == 0x01;
 }
 
-inline bool IsEarDetectionNotification(const std::vector<uint8_t>& data) {
-    return data.size() >= 6 &&
-           data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 && data[3] == 0x00 &&
-           data[4] == 0x06 && data[5] == 0x00;
+inline bool IsEarDetectionNotification(std::span<const uint8_t> data)
+{
+    return IsPacketOf(data, Opcode::EarDetection);
 }
 
-inline bool IsBatteryNotification(const std::vector<uint8_t>& data) {
-    return data.size() >= 7 &&
-           data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 && data[3] == 0x00 &&
-           data[4] == 0x04 && data[5] == 0x00;
+inline bool IsBatteryNotification(std::span<const uint8_t> data)
+{
+    return data.size() >= 7 && IsPacketOf(data, Opcode::Battery);
 }
 
-inline bool IsPersonalizedVolumeNotification(const std::vector<uint8_t>& data) {
-    return data.size() >= 7 &&
-           data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 && data[3] == 0x00 &&
-           data[4] == 0x09 && data[5] == 0x00 && data[6] == 0x26;
+inline bool IsPersonalizedVolumeNotification(std::span<const uint8_t> data)
+{
+    return IsSettingOf(data, SettingId::PersonalizedVolume);
 }
 
-inline bool IsAutomaticEarDetectionNotification(const std::vector<uint8_t>& data) {
-    return data.size() >= 7 &&
-           data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 && data[3] == 0x00 &&
-           data[4] == 0x09 && data[5] == 0x00 && data[6] == 0x1B;
+inline bool IsAutomaticEarDetectionNotification(std::span<const uint8_t> data)
+{
+    return IsSettingOf(data, SettingId::AutomaticEarDetection);
 }
 
-inline bool IsLoudSoundReductionNotification(const std::vector<uint8_t>& data) {
-    return data.size() >= 7 &&
-           data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 && data[3] == 0x00 &&
-           data[4] == 0x09 && data[5] == 0x00 && data[6] == 0x25;
+inline bool IsLoudSoundReductionNotification(std::span<const uint8_t> data)
+{
+    return IsSettingOf(data, SettingId::LoudSoundReduction);
 }
 
-inline bool IsAdaptiveTransparencyLevelNotification(const std::vector<uint8_t>& data) {
-    return data.size() >= 7 &&
-           data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 && data[3] == 0x00 &&
-           data[4] == 0x09 && data[5] == 0x00 && data[6] == 0x38;
+inline bool IsAdaptiveTransparencyLevelNotification(std::span<const uint8_t> data)
+{
+    return IsSettingOf(data, SettingId::AdaptiveTransparencyLevel);
 }
 
 // Check if packet is a settings notification (type 0x09)
-inline bool IsSettingsNotification(const std::vector<uint8_t>& data) {
-    return data.size() >= 6 &&
-           data[0] == 0x04 && data[1] == 0x00 && data[2] == 0x04 && data[3] == 0x00 &&
-           data[4] == 0x09 && data[5] == 0x00;
+inline bool IsSettingsNotification(std::span<const uint8_t> data)
+{
+    return IsPacketOf(data, Opcode::Settings);
 }
 
 // Get the setting type from a settings notification
-inline std::optional<uint8_t> GetSettingType(const std::vector<uint8_t>& data) {
-    if (!IsSettingsNotification(data) || data.size() < 7) {
+inline std::optional<uint8_t> GetSettingType(std::span<const uint8_t> data)
+{
+    if (!IsSettingsNotification(data) || data.size() <= kSettingIdOffset) {
         return std::nullopt;
     }
-    return data[6];
+    return data[kSettingIdOffset];
 }
 
 } // namespace Core::AAP
@@ -552,3 +597,69 @@ inline QString Helper::ToString<Core::AAP::ConversationalAwarenessState>(const C
             return QObject::tr("Unknown");
     }
 }
+
+//////////////////////////////////////////////////
+// fmt formatters
+//
+// The untranslated names, the reader thread logs them without building a `QString`.
+//
+
+template <>
+struct fmt::formatter<Core::AAP::NoiseControlMode>
+{
+    constexpr auto parse(format_parse_context &ctx)
+    {
+        return ctx.begin();
+    }
+
+    template <class FormatContext>
+    auto format(Core::AAP::NoiseControlMode value, FormatContext &ctx) const
+    {
+        const char *name;
+        switch (value) {
+            case Core::AAP::NoiseControlMode::Off:
+                name = "Off";
+                break;
+            case Core::AAP::NoiseControlMode::NoiseCancellation:
+                name = "Noise Cancellation";
+                break;
+            case Core::AAP::NoiseControlMode::Transparency:
+                name = "Transparency";
+                break;
+            case Core::AAP::NoiseControlMode::Adaptive:
+                name = "Adaptive";
+                break;
+            default:
+                name = "Unknown";
+                break;
+        }
+        return fmt::format_to(ctx.out(), "{}", name);
+    }
+};
+
+template <>
+struct fmt::formatter<Core::AAP::ConversationalAwarenessState>
+{
+    constexpr auto parse(format_parse_context &ctx)
+    {
+        return ctx.begin();
+    }
+
+    template <class FormatContext>
+    auto format(Core::AAP::ConversationalAwarenessState value, FormatContext &ctx) const
+    {
+        const char *name;
+        switch (value) {
+            case Core::AAP::ConversationalAwarenessState::Enabled:
+                name = "Enabled";
+                break;
+            case Core::AAP::ConversationalAwarenessState::Disabled:
+                name = "Disabled";
+                break;
+            default:
+                name = "Unknown";
+                break;
+        }
+        return fmt::format_to(ctx.out(), "{}", name);
+    }
+};
@@ -0,0 +1,333 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "AAPCapture.h"
+
+#include <limits>
+#include <algorithm>
+
+#include "../Logger.h"
+
+namespace Core::AAP {
+
+namespace {
+
+template <class T>
+void StoreLE(uint8_t *out, T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+template <class T>
+T LoadLE(const uint8_t *in)
+{
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<T>(static_cast<T>(in[i]) << (i * 8));
+    }
+    return value;
+}
+
+} // namespace
+
+//////////////////////////////////////////////////
+// CaptureWriter
+//
+
+std::unique_ptr<CaptureWriter> CaptureWriter::Create(const std::string &path)
+{
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    if (!file) {
+        LOG(Warn, "AAP: Failed to create capture file '{}'", path);
+        return nullptr;
+    }
+
+    std::array<uint8_t, kCaptureHeaderSize> header{};
+    std::ranges::copy(kCaptureMagic, header.begin());
+    StoreLE<uint16_t>(&header[4], kCaptureVersion);
+    StoreLE<uint16_t>(&header[6], static_cast<uint16_t>(kCaptureHeaderSize));
+    StoreLE<uint64_t>(
+        &header[8], std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                        .count());
+
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+    file.flush();
+    if (!file) {
+        LOG(Warn, "AAP: Failed to write capture file '{}'", path);
+        return nullptr;
+    }
+    return std::unique_ptr<CaptureWriter>{new CaptureWriter{std::move(file)}};
+}
+
+CaptureWriter::CaptureWriter(std::ofstream file)
+    : _file{std::move(file)}, _start{std::chrono::steady_clock::now()}, _lastWrite{_start}
+{
+    _buffer.reserve(kWriteSize + kCaptureFrameHeaderSize + std::numeric_limits<uint16_t>::max());
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    Flush();
+}
+
+void CaptureWriter::Write(CaptureDirection direction, std::span<const uint8_t> packet)
+{
+    const auto timestamp = std::chrono::steady_clock::now();
+    const size_t size = std::min<size_t>(packet.size(), std::numeric_limits<uint16_t>::max());
+
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    const size_t offset = _buffer.size();
+    _buffer.resize(offset + kCaptureFrameHeaderSize + size);
+    uint8_t *frame = &_buffer[offset];
+    StoreLE<uint64_t>(
+        &frame[0],
+        std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp - _start).count());
+    StoreLE<uint16_t>(&frame[8], static_cast<uint16_t>(size));
+    frame[10] = Helper::ToUnderlying(direction);
+    frame[11] = 0;
+    std::copy_n(packet.begin(), size, &frame[kCaptureFrameHeaderSize]);
+    ++_frameCount;
+
+    if (_buffer.size() >= kWriteSize || timestamp - _lastWrite >= kWriteInterval) {
+        WriteBuffered(timestamp);
+    }
+}
+
+void CaptureWriter::Flush()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    WriteBuffered(std::chrono::steady_clock::now());
+}
+
+void CaptureWriter::WriteBuffered(std::chrono::steady_clock::time_point now)
+{
+    _lastWrite = now;
+    if (_buffer.empty()) {
+        return;
+    }
+    _file.write(reinterpret_cast<const char *>(_buffer.data()), _buffer.size());
+    _file.flush();
+    _buffer.clear();
+}
+
+uint64_t CaptureWriter::GetFrameCount() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return _frameCount;
+}
+
+//////////////////////////////////////////////////
+// CaptureReader
+//
+
+CaptureReader::CaptureReader(std::span<const uint8_t> data) : _data{data}
+{
+    if (data.size() < kCaptureHeaderSize ||
+        !std::ranges::equal(data.first(kCaptureMagic.size()), kCaptureMagic))
+    {
+        return;
+    }
+
+    const auto version = LoadLE<uint16_t>(&data[4]);
+    const auto headerSize = LoadLE<uint16_t>(&data[6]);
+    if (version != kCaptureVersion || headerSize < kCaptureHeaderSize ||
+        headerSize > data.size())
+    {
+        return;
+    }
+
+    _valid = true;
+    _firstFrameOffset = _offset = headerSize;
+}
+
+bool CaptureReader::IsValid() const
+{
+    return _valid;
+}
+
+uint64_t CaptureReader::GetStartTime() const
+{
+    return _valid ? LoadLE<uint64_t>(&_data[8]) : 0;
+}
+
+std::optional<CaptureFrame> CaptureReader::Next()
+{
+    if (!_valid || _data.size() - _offset < kCaptureFrameHeaderSize) {
+        return std::nullopt;
+    }
+
+    const uint8_t *header = _data.data() + _offset;
+    const size_t size = LoadLE<uint16_t>(header + 8);
+    if (_data.size() - _offset - kCaptureFrameHeaderSize < size) {
+        return std::nullopt;
+    }
+
+    CaptureFrame frame{
+        .timestamp = std::chrono::nanoseconds{LoadLE<uint64_t>(header)},
+        .direction = static_cast<CaptureDirection>(header[10]),
+        .packet = _data.subspan(_offset + kCaptureFrameHeaderSize, size),
+    };
+    _offset += kCaptureFrameHeaderSize + size;
+    return frame;
+}
+
+void CaptureReader::Rewind()
+{
+    _offset = _firstFrameOffset;
+}
+
+std::optional<std::vector<uint8_t>> LoadCaptureFile(const std::string &path)
+{
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+        LOG(Warn, "AAP: Failed to open capture file '{}'", path);
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> data{
+        std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    if (!CaptureReader{data}.IsValid()) {
+        LOG(Warn, "AAP: '{}' is not a capture file of a supported version", path);
+        return std::nullopt;
+    }
+    return data;
+}
+
+//////////////////////////////////////////////////
+// ReplayTransport
+//
+
+std::unique_ptr<ReplayTransport> ReplayTransport::Open(const std::string &path, ReplaySpeed speed)
+{
+    auto capture = LoadCaptureFile(path);
+    if (!capture.has_value()) {
+        return nullptr;
+    }
+    return std::make_unique<ReplayTransport>(std::move(*capture), speed);
+}
+
+ReplayTransport::ReplayTransport(std::vector<uint8_t> capture, ReplaySpeed speed)
+    : _capture{std::move(capture)}, _reader{_capture}, _speed{speed}
+{
+}
+
+void ReplayTransport::Start()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (!_start.has_value()) {
+            _start = std::chrono::steady_clock::now();
+        }
+    }
+    _cv.notify_all();
+}
+
+bool ReplayTransport::Send(std::span<const uint8_t>)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return !_closed;
+}
+
+ReceiveResult ReplayTransport::Receive(
+    std::span<uint8_t> buffer, std::optional<std::chrono::milliseconds> timeout)
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    auto now = std::chrono::steady_clock::now();
+    std::optional<std::chrono::steady_clock::time_point> timeoutAt;
+    if (timeout.has_value()) {
+        timeoutAt = now + *timeout;
+    }
+
+    const auto interrupted = [this] { return _woken || _closed; };
+    if (!_start.has_value()) {
+        const auto ready = [&] { return _start.has_value() || interrupted(); };
+        if (!timeoutAt.has_value()) {
+            _cv.wait(lock, ready);
+        }
+        else if (!_cv.wait_until(lock, *timeoutAt, ready)) {
+            return {ReceiveStatus::Timeout};
+        }
+        now = std::chrono::steady_clock::now();
+    }
+
+    while (_start.has_value() && !_pending.has_value()) {
+        _pending = _reader.Next();
+        if (!_pending.has_value()) {
+            break;
+        }
+        if (_pending->direction != CaptureDirection::Received) {
+            _pending.reset();
+        }
+    }
+
+    if (_pending.has_value() && !interrupted()) {
+        auto due = now;
+        if (_speed == ReplaySpeed::Original) {
+            due = std::max(
+                now, *_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                   _pending->timestamp));
+        }
+        // Even an expired wait costs the timer slack, which would dominate an unthrottled replay
+        const auto until = timeoutAt.has_value() ? std::min(due, *timeoutAt) : due;
+        if (until > now) {
+            _cv.wait_until(lock, until, interrupted);
+        }
+
+        if (!interrupted() && std::chrono::steady_clock::now() < due) {
+            return {ReceiveStatus::Timeout};
+        }
+    }
+
+    if (_woken) {
+        _woken = false;
+        return {ReceiveStatus::Woken};
+    }
+    if (_closed || !_pending.has_value()) {
+        return {ReceiveStatus::Closed};
+    }
+
+    const size_t size = std::min(_pending->packet.size(), buffer.size());
+    std::copy_n(_pending->packet.begin(), size, buffer.begin());
+    _pending.reset();
+    return {ReceiveStatus::Data, size};
+}
+
+void ReplayTransport::Wake()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _woken = true;
+    }
+    _cv.notify_all();
+}
+
+void ReplayTransport::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _closed = true;
+    }
+    _cv.notify_all();
+}
+
+} // namespace Core::AAP
@@ -0,0 +1,193 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <span>
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <condition_variable>
+
+#include "AAPTransport.h"
+#include "../Helper.h"
+
+namespace Core::AAP {
+
+//////////////////////////////////////////////////
+// Capture file format
+//
+// Everything the manager sends and receives, in order. All integers are little-endian.
+//
+//   File header (16 bytes)
+//     0  char[4]  magic "AAPC"
+//     4  uint16   format version
+//     6  uint16   size of the file header
+//     8  uint64   wall clock time the capture started, microseconds since the Unix epoch
+//
+//   Frame, repeated until the end of the file
+//     0  uint64   monotonic time since the capture started, nanoseconds
+//     8  uint16   size of the packet
+//    10  uint8    direction (0 received, 1 sent)
+//    11  uint8    reserved
+//    12  ...      packet
+//
+// Frames are only ever appended and parsed in place, so a file can be read straight from a
+// memory mapping. A frame cut off at the end (e.g. the process died while writing) is ignored.
+//
+
+inline constexpr std::array<uint8_t, 4> kCaptureMagic{'A', 'A', 'P', 'C'};
+inline constexpr uint16_t kCaptureVersion = 1;
+inline constexpr size_t kCaptureHeaderSize = 16;
+inline constexpr size_t kCaptureFrameHeaderSize = 12;
+
+enum class CaptureDirection : uint8_t {
+    Received = 0,
+    Sent = 1,
+};
+
+struct CaptureFrame {
+    std::chrono::nanoseconds timestamp;
+    CaptureDirection direction;
+    // Points into the parsed buffer
+    std::span<const uint8_t> packet;
+};
+
+//////////////////////////////////////////////////
+// CaptureWriter - Appends frames to a capture file
+//
+
+class CaptureWriter : Helper::NonCopyable
+{
+public:
+    // Frames are collected in memory and written out once this much is buffered, or once a frame
+    // comes in this long after the last write. A crash loses at most that much.
+    static constexpr size_t kWriteSize = 64 * 1024;
+    static constexpr auto kWriteInterval = std::chrono::seconds(1);
+
+    // Returns nullptr if the file can't be created
+    static std::unique_ptr<CaptureWriter> Create(const std::string &path);
+
+    // Writes out what's still buffered
+    ~CaptureWriter();
+
+    // Thread-safe
+    void Write(CaptureDirection direction, std::span<const uint8_t> packet);
+    void Flush();
+
+    uint64_t GetFrameCount() const;
+
+private:
+    explicit CaptureWriter(std::ofstream file);
+
+    mutable std::mutex _mutex;
+    std::ofstream _file;
+    std::chrono::steady_clock::time_point _start, _lastWrite;
+    // Frames not written to the file yet
+    std::vector<uint8_t> _buffer;
+    uint64_t _frameCount{0};
+
+    void WriteBuffered(std::chrono::steady_clock::time_point now);
+};
+
+//////////////////////////////////////////////////
+// CaptureReader - Walks the frames of a capture in place
+//
+
+class CaptureReader
+{
+public:
+    // The data must outlive the reader and the frames returned by it
+    explicit CaptureReader(std::span<const uint8_t> data);
+
+    // False if the data doesn't start with a capture header of a known version
+    bool IsValid() const;
+
+    // Microseconds since the Unix epoch
+    uint64_t GetStartTime() const;
+
+    // Returns nullopt at the end of the capture
+    std::optional<CaptureFrame> Next();
+
+    void Rewind();
+
+private:
+    std::span<const uint8_t> _data;
+    size_t _offset{0};
+    size_t _firstFrameOffset{0};
+    bool _valid{false};
+};
+
+// Reads a whole capture file, returns nullopt if it can't be read or isn't a capture
+std::optional<std::vector<uint8_t>> LoadCaptureFile(const std::string &path);
+
+//////////////////////////////////////////////////
+// ReplayTransport - Plays the received side of a capture back to the manager
+//
+// Sent packets are accepted and discarded, the peer's responses are already in the capture. The
+// transport reports `Closed` once all received frames have been delivered.
+//
+// Nothing is delivered before `Start()`, so the manager can be set up (e.g. head tracking turned
+// on) before the first frame, even when replaying unthrottled.
+//
+
+enum class ReplaySpeed : uint32_t {
+    // Frames are delivered at their recorded times, relative to `Start()`
+    Original,
+    // Frames are delivered as fast as they are received
+    Unthrottled,
+};
+
+class ReplayTransport final : public Transport
+{
+public:
+    // Returns nullptr if the file can't be loaded
+    static std::unique_ptr<ReplayTransport> Open(const std::string &path, ReplaySpeed speed);
+
+    ReplayTransport(std::vector<uint8_t> capture, ReplaySpeed speed);
+
+    void Start();
+
+    bool Send(std::span<const uint8_t> packet) override;
+    ReceiveResult Receive(
+        std::span<uint8_t> buffer,
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt) override;
+    void Wake() override;
+    void Close() override;
+
+private:
+    std::vector<uint8_t> _capture;
+    CaptureReader _reader;
+    ReplaySpeed _speed;
+    // Next received frame, kept until it's due
+    std::optional<CaptureFrame> _pending;
+    std::optional<std::chrono::steady_clock::time_point> _start;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _woken{false};
+    bool _closed{false};
+};
+
+} // namespace Core::AAP
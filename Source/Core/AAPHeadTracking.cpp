@@ -0,0 +1,295 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "AAPHeadTracking.h"
+
+#include <cmath>
+#include <algorithm>
+
+// SSE2 is the baseline of every x64 target, so no runtime dispatch is needed
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+    #define APD_AAP_HAS_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+namespace Core::AAP {
+
+namespace {
+
+// Samples further apart than this restart the filters instead of smoothing across the gap
+constexpr auto kMaxSampleGap = std::chrono::milliseconds(500);
+
+// Assumed, not verified against real AirPods: the three orientation fields are yaw, pitch and roll
+// in that order, each a signed 16-bit fraction of a half turn. Neither is documented anywhere, the
+// gesture thresholds depend on both.
+constexpr float kDegreesPerRaw = 180.0f / 32768.0f;
+
+// Wraps an angle (or the difference of two) into [-180, 180)
+float WrapDegrees(float degrees)
+{
+    degrees = std::fmod(degrees + 180.0f, 360.0f);
+    return (degrees < 0 ? degrees + 360.0f : degrees) - 180.0f;
+}
+
+// Share of the way to a new value an exponential low-pass covers in `elapsed`
+float SmoothingFactor(
+    std::chrono::steady_clock::duration elapsed, std::chrono::milliseconds timeConstant)
+{
+    if (timeConstant.count() <= 0) {
+        return 1.0f;
+    }
+    return 1.0f - std::exp(
+                      -std::chrono::duration<float>{elapsed}.count() /
+                      std::chrono::duration<float>{timeConstant}.count());
+}
+
+bool IsGap(std::chrono::steady_clock::duration elapsed)
+{
+    return elapsed < std::chrono::steady_clock::duration::zero() || elapsed > kMaxSampleGap;
+}
+
+// Offsets of the values in a frame. The first three and the last two are adjacent, with one
+// unused value at 49 in between.
+constexpr size_t kOrientation1Offset = 43;
+constexpr size_t kOrientation2Offset = 45;
+constexpr size_t kOrientation3Offset = 47;
+constexpr size_t kHorizontalAccelerationOffset = 51;
+constexpr size_t kVerticalAccelerationOffset = 53;
+
+size_t FrameCount(std::span<const uint8_t> frames, const HeadTrackingColumns &out)
+{
+    return std::min(
+        {frames.size() / kHeadTrackingPacketSize, out.orientation1.size(),
+         out.orientation2.size(), out.orientation3.size(), out.horizontalAcceleration.size(),
+         out.verticalAcceleration.size()});
+}
+
+void DecodeScalar(
+    std::span<const uint8_t> frames, const HeadTrackingColumns &out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i) {
+        const auto frame = frames.subspan(i * kHeadTrackingPacketSize, kHeadTrackingPacketSize);
+        out.orientation1[i] = Decode::Int16LE(frame, kOrientation1Offset);
+        out.orientation2[i] = Decode::Int16LE(frame, kOrientation2Offset);
+        out.orientation3[i] = Decode::Int16LE(frame, kOrientation3Offset);
+        out.horizontalAcceleration[i] = Decode::Int16LE(frame, kHorizontalAccelerationOffset);
+        out.verticalAcceleration[i] = Decode::Int16LE(frame, kVerticalAccelerationOffset);
+    }
+}
+
+#if defined APD_AAP_HAS_SSE2
+// One unaligned 16 byte load at offset 43 covers all values of a frame, as int16 lanes
+// [o1, o2, o3, -, hAccel, vAccel, -, -]. Eight frames are loaded as rows and transposed, which
+// turns every lane into a column of eight frames. x86 is little-endian, so the lanes are the
+// decoded values already.
+//
+// The load reads 3 bytes past the end of its frame, so the last frame of the buffer is always
+// left to the scalar loop. Returns the number of frames decoded.
+//
+size_t DecodeSse2(std::span<const uint8_t> frames, const HeadTrackingColumns &out, size_t count)
+{
+    constexpr size_t kBlock = 8;
+    static_assert(kOrientation1Offset + sizeof(__m128i) <= kHeadTrackingPacketSize * 2);
+
+    const size_t wholeFrames = frames.size() / kHeadTrackingPacketSize;
+    const size_t blocks = (std::min(count, wholeFrames - 1)) / kBlock;
+
+    const uint8_t *data = frames.data() + kOrientation1Offset;
+    for (size_t block = 0; block < blocks; ++block) {
+        const size_t first = block * kBlock;
+
+        __m128i row[kBlock];
+        for (size_t i = 0; i < kBlock; ++i) {
+            row[i] = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(data + (first + i) * kHeadTrackingPacketSize));
+        }
+
+        const __m128i t0 = _mm_unpacklo_epi16(row[0], row[1]);
+        const __m128i t1 = _mm_unpackhi_epi16(row[0], row[1]);
+        const __m128i t2 = _mm_unpacklo_epi16(row[2], row[3]);
+        const __m128i t3 = _mm_unpackhi_epi16(row[2], row[3]);
+        const __m128i t4 = _mm_unpacklo_epi16(row[4], row[5]);
+        const __m128i t5 = _mm_unpackhi_epi16(row[4], row[5]);
+        const __m128i t6 = _mm_unpacklo_epi16(row[6], row[7]);
+        const __m128i t7 = _mm_unpackhi_epi16(row[6], row[7]);
+
+        // Lane pairs 0-1, 2-3 and 4-5 of rows 0-3 and rows 4-7, lanes 6-7 are not needed
+        const __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+        const __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+        const __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+        const __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+        const __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+        const __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+
+        const auto store = [first](std::span<int16_t> column, __m128i values) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(column.data() + first), values);
+        };
+        store(out.orientation1, _mm_unpacklo_epi64(u0, u4));
+        store(out.orientation2, _mm_unpackhi_epi64(u0, u4));
+        store(out.orientation3, _mm_unpacklo_epi64(u1, u5));
+        store(out.horizontalAcceleration, _mm_unpacklo_epi64(u2, u6));
+        store(out.verticalAcceleration, _mm_unpackhi_epi64(u2, u6));
+    }
+    return blocks * kBlock;
+}
+#endif
+
+} // namespace
+
+//////////////////////////////////////////////////
+// HeadOrientationFilter
+//
+
+HeadOrientationFilter::HeadOrientationFilter() : HeadOrientationFilter{Config{}} {}
+
+HeadOrientationFilter::HeadOrientationFilter(Config config) : _config{config} {}
+
+std::optional<HeadOrientation> HeadOrientationFilter::Update(const HeadTrackingSample &sample)
+{
+    const HeadOrientation raw{
+        .yaw = sample.data.orientation1 * kDegreesPerRaw,
+        .pitch = sample.data.orientation2 * kDegreesPerRaw,
+        .roll = sample.data.orientation3 * kDegreesPerRaw,
+        .timestamp = sample.timestamp,
+    };
+
+    if (!_initialized || IsGap(sample.timestamp - _current.timestamp)) {
+        _initialized = true;
+        _current = raw;
+        _nextOutput = sample.timestamp;
+    }
+    else {
+        const float k =
+            SmoothingFactor(sample.timestamp - _current.timestamp, _config.timeConstant);
+        _current.yaw = WrapDegrees(_current.yaw + k * WrapDegrees(raw.yaw - _current.yaw));
+        _current.pitch = WrapDegrees(_current.pitch + k * WrapDegrees(raw.pitch - _current.pitch));
+        _current.roll = WrapDegrees(_current.roll + k * WrapDegrees(raw.roll - _current.roll));
+        _current.timestamp = sample.timestamp;
+    }
+
+    if (sample.timestamp < _nextOutput) {
+        return std::nullopt;
+    }
+
+    // Stay on a fixed grid, but don't burst to catch up after a stall
+    _nextOutput += _config.outputInterval;
+    if (_nextOutput <= sample.timestamp) {
+        _nextOutput = sample.timestamp + _config.outputInterval;
+    }
+    return _current;
+}
+
+//////////////////////////////////////////////////
+// HeadGestureDetector
+//
+
+HeadGestureDetector::HeadGestureDetector() : HeadGestureDetector{Config{}} {}
+
+HeadGestureDetector::HeadGestureDetector(Config config) : _config{config} {}
+
+std::optional<HeadGesture> HeadGestureDetector::Update(const HeadOrientation &orientation)
+{
+    const auto now = orientation.timestamp;
+
+    if (!_initialized || IsGap(now - _last)) {
+        _initialized = true;
+        _last = now;
+        _pitch.Restart();
+        _pitch.baseline = orientation.pitch;
+        _yaw.Restart();
+        _yaw.baseline = orientation.yaw;
+        return std::nullopt;
+    }
+
+    const float k = SmoothingFactor(now - _last, _config.baselineTimeConstant);
+    _last = now;
+    UpdateAxis(_pitch, orientation.pitch, k, now);
+    UpdateAxis(_yaw, orientation.yaw, k, now);
+
+    if (now < _cooldownUntil) {
+        // The head swinging back after a gesture must not start the next one
+        _pitch.Restart();
+        _yaw.Restart();
+        return std::nullopt;
+    }
+
+    const bool nod = _pitch.swings >= _config.swings;
+    const bool shake = _yaw.swings >= _config.swings;
+    if (!nod && !shake) {
+        return std::nullopt;
+    }
+
+    const auto gesture =
+        nod && (!shake || _pitch.peak >= _yaw.peak) ? HeadGesture::Nod : HeadGesture::Shake;
+    _cooldownUntil = now + _config.cooldown;
+    _pitch.Restart();
+    _yaw.Restart();
+    return gesture;
+}
+
+void HeadGestureDetector::UpdateAxis(
+    Axis &axis, float value, float k, std::chrono::steady_clock::time_point now)
+{
+    const float deviation = WrapDegrees(value - axis.baseline);
+    axis.baseline = WrapDegrees(axis.baseline + k * deviation);
+
+    if (axis.swings != 0 && now - axis.firstSwing > _config.window) {
+        axis.Restart();
+    }
+
+    const int32_t direction = deviation > _config.threshold    ? 1
+                              : deviation < -_config.threshold ? -1
+                                                               : 0;
+    if (direction != 0 && direction != axis.direction) {
+        if (axis.swings == 0) {
+            axis.firstSwing = now;
+        }
+        axis.direction = direction;
+        ++axis.swings;
+    }
+    axis.peak = std::max(axis.peak, std::abs(deviation));
+}
+
+//////////////////////////////////////////////////
+// Batch decoding
+//
+
+size_t DecodeHeadTrackingFrames(std::span<const uint8_t> frames, const HeadTrackingColumns &out)
+{
+    const size_t count = FrameCount(frames, out);
+    size_t decoded = 0;
+
+#if defined APD_AAP_HAS_SSE2
+    if (count != 0) {
+        decoded = DecodeSse2(frames, out, count);
+    }
+#endif
+
+    DecodeScalar(frames, out, decoded, count);
+    return count;
+}
+
+size_t
+DecodeHeadTrackingFramesScalar(std::span<const uint8_t> frames, const HeadTrackingColumns &out)
+{
+    const size_t count = FrameCount(frames, out);
+    DecodeScalar(frames, out, 0, count);
+    return count;
+}
+
+} // namespace Core::AAP
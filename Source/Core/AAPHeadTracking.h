@@ -0,0 +1,172 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <span>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "AAP.h"
+
+namespace Core::AAP {
+
+//////////////////////////////////////////////////
+// Head tracking stream
+//
+// The reader thread pushes samples into a ring and never waits for the consumer, which pulls them
+// in batches at its own rate. If the consumer falls behind, new samples are dropped and the next
+// sample that makes it into the ring carries the count.
+//
+
+struct HeadTrackingSample {
+    HeadTrackingData data;
+    // When the frame was received
+    std::chrono::steady_clock::time_point timestamp;
+    // Samples dropped right before this one because the ring was full
+    uint32_t dropped{0};
+};
+
+//////////////////////////////////////////////////
+// Head orientation filter
+//
+// The frames carry an absolute orientation but no angular rates, so there is nothing for a
+// complementary filter to fuse. What is left is smoothing: an exponential low-pass per axis whose
+// coefficient follows the actual time between samples, so it behaves the same at any frame rate
+// and across dropped samples. The smoothed orientation is emitted at a fixed output rate.
+//
+
+struct HeadOrientation {
+    // Degrees in [-180, 180), the full int16 range of a raw value maps to a full turn
+    float yaw{0}, pitch{0}, roll{0};
+    std::chrono::steady_clock::time_point timestamp;
+};
+
+class HeadOrientationFilter
+{
+public:
+    struct Config {
+        std::chrono::milliseconds timeConstant{50};
+        std::chrono::milliseconds outputInterval{20};
+    };
+
+    HeadOrientationFilter();
+    explicit HeadOrientationFilter(Config config);
+
+    // Returns the smoothed orientation whenever an output is due
+    std::optional<HeadOrientation> Update(const HeadTrackingSample &sample);
+
+    // Smoothed orientation as of the last sample
+    const HeadOrientation &Current() const
+    {
+        return _current;
+    }
+
+private:
+    Config _config;
+    bool _initialized{false};
+    HeadOrientation _current;
+    std::chrono::steady_clock::time_point _nextOutput;
+};
+
+//////////////////////////////////////////////////
+// Head gesture detector
+//
+// Fed with every smoothed orientation. A nod swings the pitch and a shake swings the yaw back and
+// forth around where the head was resting, so each axis tracks its deviation from a slow baseline
+// and counts swings past a threshold in alternating directions. Constant work per sample.
+//
+
+enum class HeadGesture : uint32_t {
+    Nod,
+    Shake,
+};
+
+class HeadGestureDetector
+{
+public:
+    struct Config {
+        // Degrees a swing has to move away from the resting position
+        float threshold{10};
+        // Swings in alternating directions that make up a gesture (down, up, down for a nod)
+        uint32_t swings{3};
+        // Time the swings have to happen in
+        std::chrono::milliseconds window{1200};
+        // Time constant of the resting position
+        std::chrono::milliseconds baselineTimeConstant{800};
+        // No new gesture is reported for this long after one
+        std::chrono::milliseconds cooldown{600};
+    };
+
+    HeadGestureDetector();
+    explicit HeadGestureDetector(Config config);
+
+    std::optional<HeadGesture> Update(const HeadOrientation &orientation);
+
+private:
+    struct Axis {
+        float baseline{0};
+        int32_t direction{0};
+        uint32_t swings{0};
+        float peak{0};
+        std::chrono::steady_clock::time_point firstSwing;
+
+        // Forgets the swings, keeps the resting position
+        void Restart()
+        {
+            direction = 0;
+            swings = 0;
+            peak = 0;
+        }
+    };
+
+    Config _config;
+    bool _initialized{false};
+    std::chrono::steady_clock::time_point _last, _cooldownUntil;
+    Axis _pitch, _yaw;
+
+    void UpdateAxis(Axis &axis, float value, float k, std::chrono::steady_clock::time_point now);
+};
+
+//////////////////////////////////////////////////
+// Head tracking batch decoding
+//
+// Decodes blocks of buffered head tracking frames at once, e.g. a recorded session or a batch
+// pulled from the manager. `frames` holds whole `kHeadTrackingPacketSize` byte frames back to
+// back, the values are written column by column (structure of arrays).
+//
+
+// Every column must hold at least as many elements as frames are decoded
+struct HeadTrackingColumns {
+    std::span<int16_t> orientation1;
+    std::span<int16_t> orientation2;
+    std::span<int16_t> orientation3;
+    std::span<int16_t> horizontalAcceleration;
+    std::span<int16_t> verticalAcceleration;
+};
+
+// Returns the number of frames decoded, limited by the whole frames in `frames` and the size of
+// the smallest column. Uses SSE2 where available.
+size_t DecodeHeadTrackingFrames(std::span<const uint8_t> frames, const HeadTrackingColumns &out);
+
+// Portable reference implementation, same contract as above
+size_t
+DecodeHeadTrackingFramesScalar(std::span<const uint8_t> frames, const HeadTrackingColumns &out);
+
+} // namespace Core::AAP
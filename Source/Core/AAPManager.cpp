@@ -17,169 +17,208 @@
 //
 
 #include "AAPManager.h"
+
+#include <algorithm>
+
 #include "../Logger.h"
 
 #if defined APD_OS_WIN
+    #include "MagicAAPWinRT.h"
+#endif
 
-#include <WinSock2.h>
-#include <ws2bth.h>
-#include <BluetoothAPIs.h>
-#include <initguid.h>
-#include "MagicAAPWinRT.h"
+namespace Core::AAP {
 
-#pragma comment(lib, "Ws2_32.lib")
-#pragma comment(lib, "Bthprops.lib")
+// How long a handshake phase waits for the peer to answer before moving on regardless
+constexpr auto kHandshakePhaseTimeout = std::chrono::milliseconds(100);
 
-// AAP Service UUID: 74ec2172-0bad-4d01-8f77-997b2be0722a
-// {74EC2172-0BAD-4D01-8F77-997B2BE0722A}
-DEFINE_GUID(AAP_SERVICE_UUID, 
-    0x74ec2172, 0x0bad, 0x4d01, 0x8f, 0x77, 0x99, 0x7b, 0x2b, 0xe0, 0x72, 0x2a);
+// How long a connect method gets before the next one is started alongside it
+constexpr auto kConnectStagger = std::chrono::milliseconds(250);
 
-namespace Core::AAP {
+// How long a settings command waits for the peer to notify the setting back
+constexpr auto kCommandAckTimeout = std::chrono::milliseconds(1000);
+
+// How long changed traffic statistics may stay unpublished by the reader thread
+constexpr auto kTrafficStatsInterval = std::chrono::milliseconds(100);
 
-Manager::Manager()
+namespace {
+
+// Whether the peer notifies the setting back once it's changed, which acknowledges the command.
+// The adaptive noise level isn't notified, a command for it would hold the setting until timeout.
+bool IsSettingNotified(uint8_t setting)
 {
-    // Initialize Winsock
-    WSADATA wsaData;
-    int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (result != 0) {
-        LOG(Error, "WSAStartup failed: {}", result);
+    return setting != Helper::ToUnderlying(SettingId::AdaptiveNoise);
+}
+
+// Whether `packet` is the peer's answer to the packet sent by `phase`
+bool IsHandshakeReply(HandshakePhase phase, std::span<const uint8_t> packet)
+{
+    switch (phase) {
+    case HandshakePhase::Handshake:
+        // The peer doesn't send anything before the handshake, its first packet answers it
+        return true;
+    case HandshakePhase::EnableFeatures:
+        // Enabling conversational awareness notifies its setting
+        return IsSettingOf(packet, SettingId::ConversationalAwareness);
+    default:
+        return false;
     }
 }
 
+} // namespace
+
+Manager::Manager() {}
+
 Manager::~Manager()
 {
     Disconnect();
-    WSACleanup();
+
+    // The reader of a connection lost on the remote side, or disconnected from one of its own
+    // callbacks, exits on its own
+    if (_readerThread.joinable()) {
+        _readerThread.join();
+    }
 }
 
-bool Manager::Connect(uint64_t deviceAddress)
+template <class FnUpdateT>
+void Manager::UpdateState(FnUpdateT &&update)
 {
-    // First disconnect if already connected (without holding lock to avoid deadlock)
-    if (_connected) {
-        LOG(Warn, "AAP: Already connected, disconnecting first");
-        Disconnect();
+    std::lock_guard<std::mutex> lock{_stateUpdateMutex};
+
+    std::shared_ptr<DeviceState> state;
+    for (auto &pooled : _statePool) {
+        if (!pooled) {
+            pooled = std::make_shared<DeviceState>();
+        }
+        else if (pooled.use_count() != 1) {
+            // The current state, or a reader still holds it
+            continue;
+        }
+        state = pooled;
+        break;
+    }
+    if (!state) {
+        state = std::make_shared<DeviceState>();
     }
+    // Pairs with the release of the last reference, the reader is done with the old contents
+    std::atomic_thread_fence(std::memory_order_acquire);
 
-    std::lock_guard<std::mutex> lock{_mutex};
+    *state = *_state.load(std::memory_order_relaxed);
+    update(*state);
+    ++state->generation;
 
-    SOCKET sock = INVALID_SOCKET;
-    bool connected = false;
-
-    // Method 1: Try L2CAP with SOCK_SEQPACKET (datagram-oriented, more native for L2CAP)
-    LOG(Info, "AAP: Attempting L2CAP SEQPACKET connection to {:016X} on PSM {}", deviceAddress, kPSM);
-    sock = socket(AF_BTH, SOCK_SEQPACKET, BTHPROTO_L2CAP);
-    if (sock != INVALID_SOCKET) {
-        SOCKADDR_BTH addr{};
-        addr.addressFamily = AF_BTH;
-        addr.btAddr = deviceAddress;
-        addr.port = kPSM;
-
-        if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != SOCKET_ERROR) {
-            connected = true;
-            LOG(Info, "AAP: L2CAP SEQPACKET connection successful");
-        } else {
-            int error = WSAGetLastError();
-            LOG(Warn, "AAP: L2CAP SEQPACKET failed: {}", error);
-            closesocket(sock);
-            sock = INVALID_SOCKET;
-        }
-    } else {
-        LOG(Warn, "AAP: Failed to create L2CAP SEQPACKET socket: {}", WSAGetLastError());
-    }
-
-    // Method 2: Try L2CAP with SOCK_STREAM
-    if (!connected) {
-        LOG(Info, "AAP: Attempting L2CAP STREAM connection");
-        sock = socket(AF_BTH, SOCK_STREAM, BTHPROTO_L2CAP);
-        if (sock != INVALID_SOCKET) {
-            SOCKADDR_BTH addr{};
-            addr.addressFamily = AF_BTH;
-            addr.btAddr = deviceAddress;
-            addr.port = kPSM;
-
-            if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != SOCKET_ERROR) {
-                connected = true;
-                LOG(Info, "AAP: L2CAP STREAM connection successful");
-            } else {
-                int error = WSAGetLastError();
-                LOG(Warn, "AAP: L2CAP STREAM failed: {}", error);
-                closesocket(sock);
-                sock = INVALID_SOCKET;
-            }
-        }
+    const uint64_t generation = state->generation;
+    _state.store(std::move(state), std::memory_order_release);
+    _stateGeneration.store(generation, std::memory_order_release);
+}
+
+template <class FnCallbackT, class... ArgsT>
+void Manager::Notify(FnCallbackT Callbacks::*callback, ArgsT &&...args) const
+{
+    const auto callbacks = _callbacks.load(std::memory_order_acquire);
+    const auto &function = (*callbacks).*callback;
+    if (function) {
+        function(std::forward<ArgsT>(args)...);
     }
+}
 
-    // Method 3: Try RFCOMM with service UUID
-    if (!connected) {
-        LOG(Info, "AAP: Attempting RFCOMM with AAP UUID");
-        sock = socket(AF_BTH, SOCK_STREAM, BTHPROTO_RFCOMM);
-        if (sock != INVALID_SOCKET) {
-            SOCKADDR_BTH addr{};
-            addr.addressFamily = AF_BTH;
-            addr.btAddr = deviceAddress;
-            addr.serviceClassId = AAP_SERVICE_UUID;
-            addr.port = BT_PORT_ANY;
-
-            if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != SOCKET_ERROR) {
-                connected = true;
-                LOG(Info, "AAP: RFCOMM connection successful");
-            } else {
-                int error = WSAGetLastError();
-                LOG(Warn, "AAP: RFCOMM failed: {}", error);
-                closesocket(sock);
-                sock = INVALID_SOCKET;
-            }
-        }
+bool Manager::Connect(uint64_t deviceAddress)
+{
+    const auto &methods = GetConnectMethods();
+    if (methods.empty()) {
+        LOG(Error, "AAP: No connection method available on this platform");
+        return false;
     }
 
-    if (!connected || sock == INVALID_SOCKET) {
-        LOG(Info, "AAP: Traditional socket methods failed, trying MagicAAP WinRT...");
-        
-        // Method 4: Try MagicAAP WinRT (requires MagicAAP driver)
-        if (ConnectViaMagicAAP(deviceAddress)) {
-            // MagicAAP connection successful - don't need socket-based logic
-            return true;
+    std::vector<const ConnectMethod *> order;
+    order.reserve(methods.size());
+    for (const auto &method : methods) {
+        order.push_back(&method);
+    }
+
+    // What worked last time for this device is likely to work again
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        auto iter = _preferredConnectMethods.find(deviceAddress);
+        if (iter != _preferredConnectMethods.end()) {
+            std::ranges::stable_partition(
+                order, [&](const ConnectMethod *method) { return method->name == iter->second; });
         }
-        
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto result = RaceConnect(order, deviceAddress, kConnectStagger);
+    if (result.transport == nullptr) {
         LOG(Error, "AAP: All connection methods failed");
         return false;
     }
 
-    _socket = reinterpret_cast<void*>(sock);
-    _connected = true;
+    LOG(Info, "AAP: {} connection successful after {} ms", result.method->name,
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _preferredConnectMethods[deviceAddress] = result.method->name;
+    }
+    return Start(std::move(result.transport), result.method->backend);
+}
 
-    LOG(Info, "AAP: Connected successfully");
+bool Manager::Connect(std::unique_ptr<Transport> transport)
+{
+    return Start(std::move(transport), Backend::External);
+}
 
-    // Initialize the connection (send handshake, enable features, request notifications)
-    if (!InitializeConnection()) {
-        LOG(Error, "AAP: Failed to initialize connection");
-        // Clean up without calling Disconnect to avoid lock issues
-        _connected = false;
-        closesocket(sock);
-        _socket = nullptr;
+bool Manager::Start(std::shared_ptr<Transport> transport, Backend backend)
+{
+    // First disconnect if already connected (without holding lock to avoid deadlock)
+    if (_connected) {
+        LOG(Warn, "AAP: Already connected, disconnecting first");
+        Disconnect();
+    }
+
+    if (_readerThread.get_id() == std::this_thread::get_id()) {
+        LOG(Error, "AAP: Can't connect from a callback on the reader thread");
         return false;
     }
 
-    // Start reader thread
-    _stopReader = false;
-    _readerExited = false;
-    _readerThread = std::thread(&Manager::ReaderLoop, this);
+    // The reader of a connection lost on the remote side, or disconnected from one of its own
+    // callbacks, exits on its own. Waited for, it fails its commands and notifies first.
+    if (_readerThread.joinable()) {
+        _readerThread.join();
+    }
+
+    // Commands that slipped in while the last connection was going down
+    FailCommands();
+
+    std::unique_lock<std::mutex> lock{_mutex};
 
-    if (_callbacks.onConnected) {
-        _callbacks.onConnected();
+    {
+        std::lock_guard<std::mutex> transportLock{_transportMutex};
+        _transport = transport;
     }
+    _usingMagicAAP = backend == Backend::MagicAAP;
+    _connected = true;
 
-    return true;
+    LOG(Info, "AAP: Connected successfully");
+
+    // Start reader thread, it runs the handshake and invokes `onConnected` once it's done
+    ResetReceiveStats();
+    _handshakeStats = {};
+    _setupFinished = false;
+    _connectStart = std::chrono::steady_clock::now();
+    _stopReader = false;
+    _readerThread = std::thread(&Manager::ReaderLoop, this, std::move(transport));
+
+    // The handshake is bounded by the phase timeouts
+    _setupConVar.wait(lock, [this] { return _setupFinished; });
+    return _handshakeStats.complete;
 }
 
 void Manager::Disconnect()
 {
     // Move resources that may block into local variables while holding the lock,
     // then perform blocking operations outside the lock to avoid deadlocks.
-    AAP::Callbacks::FnOnDisconnectedT callback;
-    std::unique_ptr<MagicAAPWinRT::MagicAAPWinRTClient> magicClient;
-    void* socketPtr = nullptr;
+    std::shared_ptr<Transport> transport;
     std::thread localReaderThread;
 
     {
@@ -193,72 +232,44 @@ void Manager::Disconnect()
         _stopReader = true;
         _connected = false;
         _headTrackingActive = false;
-
-        // Move magic client out so we can call its Disconnect() without holding _mutex
-        if (_magicAAPClient) {
-            magicClient = std::move(_magicAAPClient);
-        }
         _usingMagicAAP = false;
 
-        // Move socket out for closing outside lock
-        socketPtr = _socket;
-        _socket = nullptr;
+        // Move transport out for closing outside lock
+        {
+            std::lock_guard<std::mutex> transportLock{_transportMutex};
+            transport = std::move(_transport);
+        }
 
-        // Move reader thread out so we can join/detach outside the lock
-        if (_readerThread.joinable()) {
+        // Move reader thread out so we can join outside the lock. Disconnecting from a callback
+        // on the reader thread leaves it in place, it exits once that returns and the next
+        // `Start()` joins it. It can't fail the commands of the next connection then.
+        if (_readerThread.joinable() && _readerThread.get_id() != std::this_thread::get_id()) {
             localReaderThread = std::move(_readerThread);
         }
-
-        // Copy callback to invoke later outside lock
-        callback = _callbacks.onDisconnected;
-    }
-
-    // Perform potentially blocking operations without holding the mutex
-    if (magicClient) {
-        magicClient->Disconnect();
-        magicClient.reset();
     }
 
-    if (socketPtr != nullptr) {
-        SOCKET sock = reinterpret_cast<SOCKET>(socketPtr);
-        closesocket(sock);
-        socketPtr = nullptr;
+    // Wake the reader out of its blocking receive, it sees `_stopReader` and returns right away.
+    // Only then close the transport, so it is never closed under a pending receive.
+    if (transport) {
+        transport->Wake();
     }
 
-    // Wait for reader thread to exit up to 5 seconds; if it doesn't exit, detach it.
     if (localReaderThread.joinable()) {
-        auto start = std::chrono::steady_clock::now();
-        auto timeout = std::chrono::seconds(5);
-        while (!_readerExited && (std::chrono::steady_clock::now() - start) < timeout) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(20));
-        }
-
-        if (_readerExited) {
-            try {
-                localReaderThread.join();
-            } catch (...) {
-            }
-        } else {
-            try {
-                localReaderThread.detach();
-            } catch (...) {
-            }
-        }
+        localReaderThread.join();
     }
 
-    // Clear cached states under lock
-    {
-        std::lock_guard<std::mutex> lock{_mutex};
-        _noiseControlMode.reset();
-        _conversationalAwarenessState.reset();
+    if (transport) {
+        transport->Close();
+        transport.reset();
     }
 
-    LOG(Info, "AAP: Disconnected");
+    UpdateState([](DeviceState &cached) {
+        cached.noiseControlMode.reset();
+        cached.conversationalAwarenessState.reset();
+    });
 
-    // Invoke callback outside lock
-    if (callback) {
-        callback();
-    }
+    const auto stats = GetReceiveStats();
+    LOG(Info, "AAP: Disconnected. Received {} packets ({} bytes)", stats.packets, stats.bytes);
 }
 
 bool Manager::IsConnected() const
@@ -266,7 +277,7 @@ bool Manager::IsConnected() const
     return _connected;
 }
 
-bool Manager::SetNoiseControlMode(NoiseControlMode mode)
+bool Manager::SetNoiseControlMode(NoiseControlMode mode, FnCommandCompletedT onCompleted)
 {
     if (!_connected) {
         LOG(Warn, "AAP: Cannot set noise control mode - not connected");
@@ -274,7 +285,7 @@ bool Manager::SetNoiseControlMode(NoiseControlMode mode)
     }
 
     auto packet = Packets::BuildNoiseControlPacket(mode);
-    if (!SendPacket(packet)) {
+    if (!QueueCommand(packet, std::move(onCompleted))) {
         return false;
     }
 
@@ -284,11 +295,10 @@ bool Manager::SetNoiseControlMode(NoiseControlMode mode)
 
 std::optional<NoiseControlMode> Manager::GetNoiseControlMode() const
 {
-    std::lock_guard<std::mutex> lock{_mutex};
-    return _noiseControlMode;
+    return GetState()->noiseControlMode;
 }
 
-bool Manager::SetConversationalAwareness(bool enable)
+bool Manager::SetConversationalAwareness(bool enable, FnCommandCompletedT onCompleted)
 {
     if (!_connected) {
         LOG(Warn, "AAP: Cannot set conversational awareness - not connected");
@@ -296,7 +306,7 @@ bool Manager::SetConversationalAwareness(bool enable)
     }
 
     auto packet = Packets::BuildConversationalAwarenessPacket(enable);
-    if (!SendPacket(packet)) {
+    if (!QueueCommand(packet, std::move(onCompleted))) {
         return false;
     }
 
@@ -306,11 +316,10 @@ bool Manager::SetConversationalAwareness(bool enable)
 
 std::optional<ConversationalAwarenessState> Manager::GetConversationalAwarenessState() const
 {
-    std::lock_guard<std::mutex> lock{_mutex};
-    return _conversationalAwarenessState;
+    return GetState()->conversationalAwarenessState;
 }
 
-bool Manager::SetPersonalizedVolume(bool enable)
+bool Manager::SetPersonalizedVolume(bool enable, FnCommandCompletedT onCompleted)
 {
     if (!_connected) {
         LOG(Warn, "AAP: Cannot set personalized volume - not connected");
@@ -318,7 +327,7 @@ bool Manager::SetPersonalizedVolume(bool enable)
     }
 
     auto packet = Packets::BuildPersonalizedVolumePacket(enable);
-    if (!SendPacket(packet)) {
+    if (!QueueCommand(packet, std::move(onCompleted))) {
         return false;
     }
 
@@ -328,11 +337,10 @@ bool Manager::SetPersonalizedVolume(bool enable)
 
 std::optional<PersonalizedVolumeState> Manager::GetPersonalizedVolumeState() const
 {
-    std::lock_guard<std::mutex> lock{_mutex};
-    return _personalizedVolumeState;
+    return GetState()->personalizedVolumeState;
 }
 
-bool Manager::SetAutomaticEarDetection(bool enable)
+bool Manager::SetAutomaticEarDetection(bool enable, FnCommandCompletedT onCompleted)
 {
     if (!_connected) {
         LOG(Warn, "AAP: Cannot set automatic ear detection - not connected");
@@ -340,7 +348,7 @@ bool Manager::SetAutomaticEarDetection(bool enable)
     }
 
     auto packet = Packets::BuildAutomaticEarDetectionPacket(enable);
-    if (!SendPacket(packet)) {
+    if (!QueueCommand(packet, std::move(onCompleted))) {
         return false;
     }
 
@@ -350,11 +358,10 @@ bool Manager::SetAutomaticEarDetection(bool enable)
 
 std::optional<bool> Manager::GetAutomaticEarDetectionState() const
 {
-    std::lock_guard<std::mutex> lock{_mutex};
-    return _automaticEarDetectionState;
+    return GetState()->automaticEarDetectionState;
 }
 
-bool Manager::SetLoudSoundReduction(bool enable)
+bool Manager::SetLoudSoundReduction(bool enable, FnCommandCompletedT onCompleted)
 {
     if (!_connected) {
         LOG(Warn, "AAP: Cannot set loud sound reduction - not connected");
@@ -362,7 +369,7 @@ bool Manager::SetLoudSoundReduction(bool enable)
     }
 
     auto packet = Packets::BuildLoudSoundReductionPacket(enable);
-    if (!SendPacket(packet)) {
+    if (!QueueCommand(packet, std::move(onCompleted))) {
         return false;
     }
 
@@ -372,11 +379,10 @@ bool Manager::SetLoudSoundReduction(bool enable)
 
 std::optional<LoudSoundReductionState> Manager::GetLoudSoundReductionState() const
 {
-    std::lock_guard<std::mutex> lock{_mutex};
-    return _loudSoundReductionState;
+    return GetState()->loudSoundReductionState;
 }
 
-bool Manager::SetAdaptiveTransparencyLevel(uint8_t level)
+bool Manager::SetAdaptiveTransparencyLevel(uint8_t level, FnCommandCompletedT onCompleted)
 {
     if (!_connected) {
         LOG(Warn, "AAP: Cannot set adaptive transparency level - not connected");
@@ -388,7 +394,7 @@ bool Manager::SetAdaptiveTransparencyLevel(uint8_t level)
     }
 
     auto packet = Packets::BuildAdaptiveTransparencyLevelPacket(level);
-    if (!SendPacket(packet)) {
+    if (!QueueCommand(packet, std::move(onCompleted))) {
         return false;
     }
 
@@ -398,11 +404,10 @@ bool Manager::SetAdaptiveTransparencyLevel(uint8_t level)
 
 std::optional<uint8_t> Manager::GetAdaptiveTransparencyLevel() const
 {
-    std::lock_guard<std::mutex> lock{_mutex};
-    return _adaptiveTransparencyLevel;
+    return GetState()->adaptiveTransparencyLevel;
 }
 
-bool Manager::SetAdaptiveNoiseLevel(uint8_t level)
+bool Manager::SetAdaptiveNoiseLevel(uint8_t level, FnCommandCompletedT onCompleted)
 {
     if (!_connected) {
         LOG(Warn, "AAP: Cannot set adaptive noise level - not connected");
@@ -414,7 +419,7 @@ bool Manager::SetAdaptiveNoiseLevel(uint8_t level)
     }
 
     auto packet = Packets::BuildAdaptiveNoisePacket(level);
-    if (!SendPacket(packet)) {
+    if (!QueueCommand(packet, std::move(onCompleted))) {
         return false;
     }
 
@@ -434,10 +439,11 @@ bool Manager::StartHeadTracking()
         return true;
     }
 
-    if (!SendPacket(Packets::StartHeadTracking)) {
+    if (!QueueCommand(Packets::StartHeadTracking, {})) {
         return false;
     }
 
+    _headTrackingStarts.fetch_add(1, std::memory_order_relaxed);
     _headTrackingActive = true;
     LOG(Info, "AAP: Started head tracking");
     return true;
@@ -453,7 +459,7 @@ bool Manager::StopHeadTracking()
         return true;
     }
 
-    if (!SendPacket(Packets::StopHeadTracking)) {
+    if (!QueueCommand(Packets::StopHeadTracking, {})) {
         return false;
     }
 
@@ -467,402 +473,657 @@ bool Manager::IsHeadTrackingActive() const
     return _headTrackingActive;
 }
 
+size_t Manager::PopHeadTrackingSamples(std::span<HeadTrackingSample> out)
+{
+    return _headTrackingRing.PopBatch(out);
+}
+
+uint64_t Manager::GetHeadTrackingDroppedCount() const
+{
+    return _headTrackingDropped.load(std::memory_order_relaxed);
+}
+
+std::shared_ptr<const DeviceState> Manager::GetState() const
+{
+    return _state.load(std::memory_order_acquire);
+}
+
+uint64_t Manager::GetStateGeneration() const
+{
+    return _stateGeneration.load(std::memory_order_acquire);
+}
+
 void Manager::SetCallbacks(Callbacks callbacks)
 {
-    std::lock_guard<std::mutex> lock{_mutex};
-    _callbacks = std::move(callbacks);
+    _callbacks.store(
+        std::make_shared<const Callbacks>(std::move(callbacks)), std::memory_order_release);
 }
 
-bool Manager::SendPacket(const std::vector<uint8_t>& packet)
+bool Manager::Send(Transport &transport, std::span<const uint8_t> packet)
 {
-    if (!_connected) {
+    if (const auto capture = _capture.load(std::memory_order_acquire)) {
+        capture->Write(CaptureDirection::Sent, packet);
+    }
+
+    if (!transport.Send(packet)) {
+        ++_trafficStats.sendFailures;
+        TrafficStatsChanged();
         return false;
     }
-    
-    // Use MagicAAP client if available
-    if (_usingMagicAAP && _magicAAPClient) {
-        bool success = _magicAAPClient->SendData(packet);
-        if (success) {
-            LOG(Trace, "AAP: Sent {} bytes via MagicAAP", packet.size());
-        }
-        return success;
+    CountPacket(_trafficStats.sent, packet);
+    return true;
+}
+
+void Manager::CountPacket(DirectionTrafficStats &direction, std::span<const uint8_t> packet)
+{
+    const auto count = [&](TrafficCounter &counter) {
+        ++counter.packets;
+        counter.bytes += packet.size();
+    };
+
+    TrafficStatsChanged();
+    if (!HasHeader(packet)) {
+        count(direction.headerless);
+        return;
+    }
+    count(direction.opcodes[packet[kOpcodeOffset]]);
+    if (IsPacketOf(packet, Opcode::Settings) && packet.size() > kSettingIdOffset) {
+        count(direction.settings[packet[kSettingIdOffset]]);
     }
+}
 
-    // Use traditional socket
-    if (_socket == nullptr) {
+bool Manager::QueueCommand(std::span<const uint8_t> packet, FnCommandCompletedT onCompleted)
+{
+    if (!_connected) {
         return false;
     }
 
-    SOCKET sock = reinterpret_cast<SOCKET>(_socket);
-    int sent = send(sock, reinterpret_cast<const char*>(packet.data()),
-                    static_cast<int>(packet.size()), 0);
+    if (packet.size() > Packets::kMaxCommandSize) {
+        LOG(Error, "AAP: Command of {} bytes exceeds the command buffer", packet.size());
+        return false;
+    }
 
-    if (sent == SOCKET_ERROR) {
-        LOG(Error, "AAP: Failed to send packet: {}", WSAGetLastError());
+    const auto transport = GetTransport();
+    if (!transport) {
         return false;
     }
 
-    LOG(Trace, "AAP: Sent {} bytes", sent);
+    std::optional<uint8_t> setting;
+    if (IsPacketOf(packet, Opcode::Settings) && packet.size() > kSettingValueOffset) {
+        setting = packet[kSettingIdOffset];
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{_commandMutex};
+
+        auto iter = _queuedCommands.end();
+        if (setting.has_value()) {
+            iter = std::ranges::find(_queuedCommands, setting, &QueuedCommand::setting);
+        }
+
+        if (iter != _queuedCommands.end()) {
+            // Not sent yet, the new value replaces the old one
+            LOG(Trace, "AAP: Coalesced command for setting {}", *setting);
+        }
+        else {
+            iter = _queuedCommands.emplace(_queuedCommands.end());
+            iter->setting = setting;
+            iter->acknowledged = setting.has_value() && IsSettingNotified(*setting);
+        }
+        std::ranges::copy(packet, iter->buffer.begin());
+        iter->size = packet.size();
+        if (onCompleted) {
+            iter->completions.push_back(std::move(onCompleted));
+        }
+    }
+
+    transport->Wake();
     return true;
 }
 
-void Manager::ProcessPacket(const std::vector<uint8_t>& packet)
+void Manager::SendQueuedCommands(Transport &transport)
 {
-    // Noise control notification
-    if (IsNoiseControlNotification(packet)) {
-        auto mode = ParseNoiseControlNotification(packet);
-        if (mode.has_value()) {
+    // Taken out of the queue first, setters must never wait for a send to finish. The list keeps
+    // its capacity between calls.
+    auto &sending = _sendingCommands;
+    sending.clear();
+    {
+        std::lock_guard<std::mutex> lock{_commandMutex};
+
+        for (auto iter = _queuedCommands.begin(); iter != _queuedCommands.end();) {
+            // Wait for the previous value of the setting to be acknowledged
+            if (iter->acknowledged &&
+                std::ranges::find(_inFlightCommands, *iter->setting, &InFlightCommand::setting) !=
+                    _inFlightCommands.end())
             {
-                std::lock_guard<std::mutex> lock{_mutex};
-                _noiseControlMode = mode;
-            }
-            LOG(Info, "AAP: Noise control mode changed to {}", Helper::ToString(mode.value()).toStdString());
-            if (_callbacks.onNoiseControlChanged) {
-                _callbacks.onNoiseControlChanged(mode.value());
+                ++iter;
+                continue;
             }
+            sending.push_back(std::move(*iter));
+            iter = _queuedCommands.erase(iter);
         }
-        return;
     }
 
-    // Conversational awareness notification
-    if (IsConversationalAwarenessNotification(packet)) {
-        auto state = ParseConversationalAwarenessState(packet);
-        if (state.has_value()) {
-            {
-                std::lock_guard<std::mutex> lock{_mutex};
-                _conversationalAwarenessState = state;
-            }
-            LOG(Info, "AAP: Conversational awareness state: {}", Helper::ToString(state.value()).toStdString());
-            if (_callbacks.onConversationalAwarenessChanged) {
-                _callbacks.onConversationalAwarenessChanged(state.value());
-            }
+    for (auto &command : sending) {
+        CommandResult result = CommandResult::Sent;
+        if (!Send(transport, std::span{command.buffer.data(), command.size})) {
+            LOG(Warn, "AAP: Failed to send command ({} bytes)", command.size);
+            result = CommandResult::Failed;
+        }
+        else if (command.acknowledged) {
+            const auto now = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock{_commandMutex};
+            _inFlightCommands.push_back(
+                {*command.setting, now, now + kCommandAckTimeout, std::move(command.completions)});
+            continue;
         }
-        return;
-    }
 
-    // Personalized volume notification
-    if (IsPersonalizedVolumeNotification(packet)) {
-        auto state = ParsePersonalizedVolumeState(packet);
-        if (state.has_value()) {
-            {
-                std::lock_guard<std::mutex> lock{_mutex};
-                _personalizedVolumeState = state;
-            }
-            LOG(Info, "AAP: Personalized volume state: {}", static_cast<int>(state.value()));
-            if (_callbacks.onPersonalizedVolumeChanged) {
-                _callbacks.onPersonalizedVolumeChanged(state.value());
-            }
+        for (const auto &completion : command.completions) {
+            completion(result);
         }
-        return;
     }
+    sending.clear();
+}
 
-    // Automatic ear detection notification
-    if (IsAutomaticEarDetectionNotification(packet)) {
-        auto state = ParseAutomaticEarDetectionState(packet);
-        if (state.has_value()) {
-            {
-                std::lock_guard<std::mutex> lock{_mutex};
-                _automaticEarDetectionState = state;
-            }
-            LOG(Info, "AAP: Automatic ear detection: {}", state.value() ? "enabled" : "disabled");
-            if (_callbacks.onAutomaticEarDetectionChanged) {
-                _callbacks.onAutomaticEarDetectionChanged(state.value());
-            }
+void Manager::AcknowledgeCommand(uint8_t setting)
+{
+    // Taken out whole, the completions are invoked from the entry without copying them
+    InFlightCommand command;
+    {
+        std::lock_guard<std::mutex> lock{_commandMutex};
+        auto iter = std::ranges::find(_inFlightCommands, setting, &InFlightCommand::setting);
+        if (iter == _inFlightCommands.end()) {
+            return;
         }
-        return;
+        command = std::move(*iter);
+        _inFlightCommands.erase(iter);
     }
+    _trafficStats.commandLatency.Record(std::chrono::steady_clock::now() - command.sent);
 
-    // Loud sound reduction notification
-    if (IsLoudSoundReductionNotification(packet)) {
-        auto state = ParseLoudSoundReductionState(packet);
-        if (state.has_value()) {
-            {
-                std::lock_guard<std::mutex> lock{_mutex};
-                _loudSoundReductionState = state;
-            }
-            LOG(Info, "AAP: Loud sound reduction: {}", static_cast<int>(state.value()));
-            if (_callbacks.onLoudSoundReductionChanged) {
-                _callbacks.onLoudSoundReductionChanged(state.value());
-            }
-        }
-        return;
+    for (const auto &completion : command.completions) {
+        completion(CommandResult::Acknowledged);
     }
+}
 
-    // Adaptive transparency level notification
-    if (IsAdaptiveTransparencyLevelNotification(packet)) {
-        auto level = ParseAdaptiveTransparencyLevel(packet);
-        if (level.has_value()) {
-            {
-                std::lock_guard<std::mutex> lock{_mutex};
-                _adaptiveTransparencyLevel = level;
-            }
-            LOG(Info, "AAP: Adaptive transparency level: {}", level.value());
-            if (_callbacks.onAdaptiveTransparencyLevelChanged) {
-                _callbacks.onAdaptiveTransparencyLevelChanged(level.value());
+void Manager::ExpireCommands()
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    std::vector<FnCommandCompletedT> completions;
+    {
+        std::lock_guard<std::mutex> lock{_commandMutex};
+        std::erase_if(_inFlightCommands, [&](InFlightCommand &command) {
+            if (command.deadline > now) {
+                return false;
             }
-        }
-        return;
+            LOG(Warn, "AAP: Setting {} was not acknowledged in time", command.setting);
+            std::ranges::move(command.completions, std::back_inserter(completions));
+            return true;
+        });
     }
 
-    // Speaking level notification (conversational awareness active)
-    if (IsSpeakingLevelNotification(packet)) {
-        auto level = ParseSpeakingLevel(packet);
-        if (level.has_value() && _callbacks.onSpeakingLevelChanged) {
-            _callbacks.onSpeakingLevelChanged(level.value());
-        }
-        return;
+    for (const auto &completion : completions) {
+        completion(CommandResult::TimedOut);
     }
+}
 
-    // Ear detection notification
-    if (IsEarDetectionNotification(packet)) {
-        auto earStatus = ParseEarDetection(packet);
-        if (earStatus.has_value() && _callbacks.onEarDetectionChanged) {
-            _callbacks.onEarDetectionChanged(earStatus->first, earStatus->second);
+void Manager::FailCommands()
+{
+    std::vector<FnCommandCompletedT> completions;
+    {
+        std::lock_guard<std::mutex> lock{_commandMutex};
+        for (auto &command : _queuedCommands) {
+            std::ranges::move(command.completions, std::back_inserter(completions));
         }
-        return;
+        for (auto &command : _inFlightCommands) {
+            std::ranges::move(command.completions, std::back_inserter(completions));
+        }
+        _queuedCommands.clear();
+        _inFlightCommands.clear();
     }
 
-    // Head tracking data
-    if (_headTrackingActive && packet.size() >= 56) {
-        auto trackingData = ParseHeadTrackingData(packet);
-        if (trackingData.has_value() && _callbacks.onHeadTrackingData) {
-            _callbacks.onHeadTrackingData(trackingData.value());
-        }
-        return;
+    for (const auto &completion : completions) {
+        completion(CommandResult::Failed);
     }
+}
 
-    // Log unknown packets for debugging
-    LOG(Trace, "AAP: Received unknown packet ({} bytes)", packet.size());
+std::shared_ptr<Transport> Manager::GetTransport()
+{
+    std::lock_guard<std::mutex> lock{_transportMutex};
+    return _transport;
 }
 
-void Manager::ReaderLoop()
+ReceiveStats Manager::GetReceiveStats() const
 {
-    constexpr size_t bufferSize = 1024;
-    std::vector<char> buffer(bufferSize);
+    return ReceiveStats{
+        .packets = _receivedPackets,
+        .bytes = _receivedBytes,
+    };
+}
 
-    while (!_stopReader && _connected) {
-        SOCKET sock = reinterpret_cast<SOCKET>(_socket);
-        
-        // Set socket to non-blocking mode for timeout handling
-        fd_set readSet;
-        FD_ZERO(&readSet);
-        FD_SET(sock, &readSet);
+TrafficStats Manager::GetTrafficStats() const
+{
+    std::lock_guard<std::mutex> lock{_trafficStatsMutex};
+    return _publishedTrafficStats;
+}
 
-        timeval timeout{};
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
+void Manager::ResetReceiveStats()
+{
+    _receivedPackets = 0;
+    _receivedBytes = 0;
 
-        int selectResult = select(0, &readSet, nullptr, nullptr, &timeout);
-        
-        if (selectResult == SOCKET_ERROR) {
-            LOG(Error, "AAP: Select error: {}", WSAGetLastError());
-            break;
-        }
+    // The reader isn't running yet
+    _trafficStats = {};
+    _trafficStatsPublishAt.reset();
 
-        if (selectResult == 0) {
-            // Timeout, continue loop
-            continue;
-        }
+    std::lock_guard<std::mutex> lock{_trafficStatsMutex};
+    _publishedTrafficStats = {};
+}
 
-        int received = recv(sock, buffer.data(), static_cast<int>(bufferSize), 0);
-        
-        if (received == SOCKET_ERROR) {
-            int error = WSAGetLastError();
-            if (error != WSAEWOULDBLOCK) {
-                LOG(Error, "AAP: Receive error: {}", error);
-                break;
-            }
-            continue;
-        }
+void Manager::TrafficStatsChanged()
+{
+    // Every packet lands in a counter, the clock is only read for the first change since the
+    // last publish
+    if (!_trafficStatsPublishAt.has_value()) {
+        _trafficStatsPublishAt = std::chrono::steady_clock::now() + kTrafficStatsInterval;
+    }
+}
 
-        if (received == 0) {
-            LOG(Info, "AAP: Connection closed by remote");
-            break;
-        }
+void Manager::PublishTrafficStats()
+{
+    _trafficStatsPublishAt.reset();
 
-        std::vector<uint8_t> packet(buffer.begin(), buffer.begin() + received);
-        ProcessPacket(packet);
-    }
+    std::lock_guard<std::mutex> lock{_trafficStatsMutex};
+    _publishedTrafficStats = _trafficStats;
+}
 
-    if (!_stopReader) {
-        // Connection was lost unexpectedly
-        AAP::Callbacks::FnOnDisconnectedT callback;
-        {
-            std::lock_guard<std::mutex> lock{_mutex};
-            _connected = false;
-            callback = _callbacks.onDisconnected;
-        }
-        // Invoke callback outside the lock to avoid potential deadlocks
-        if (callback) {
-            callback();
+void Manager::OnPacketReceived(std::span<const uint8_t> packet)
+{
+    _receivedPackets.fetch_add(1, std::memory_order_relaxed);
+    _receivedBytes.fetch_add(packet.size(), std::memory_order_relaxed);
+    CountPacket(_trafficStats.received, packet);
+    ProcessPacket(packet);
+}
+
+void Manager::ProcessPacket(std::span<const uint8_t> packet)
+{
+    static constexpr auto kOpcodeHandlers = [] {
+        std::array<PacketHandlerT, 256> table{};
+        table[Helper::ToUnderlying(Opcode::EarDetection)] = &Manager::OnEarDetectionPacket;
+        table[Helper::ToUnderlying(Opcode::Settings)] = &Manager::OnSettingsPacket;
+        table[Helper::ToUnderlying(Opcode::HeadTracking)] = &Manager::OnHeadTrackingPacket;
+        table[Helper::ToUnderlying(Opcode::SpeakingLevel)] = &Manager::OnSpeakingLevelPacket;
+        return table;
+    }();
+
+    if (HasHeader(packet)) {
+        const auto handler = kOpcodeHandlers[packet[kOpcodeOffset]];
+        if (handler != nullptr && (this->*handler)(packet)) {
+            return;
         }
     }
 
-    // Mark reader exited so Disconnect can join safely
-    _readerExited = true;
+    // Head tracking frames are also recognized by their size while the stream is active
+    if (_headTrackingActive && packet.size() >= kHeadTrackingPacketSize) {
+        OnHeadTrackingPacket(packet);
+        return;
+    }
+
+    ++_trafficStats.unknownPackets;
+    // Log unknown packets for debugging
+    LOG(Trace, "AAP: Received unknown packet ({} bytes)", packet.size());
 }
 
-// Protocol timing constants
-constexpr auto kPacketProcessingDelay = std::chrono::milliseconds(100);
+bool Manager::OnSettingsPacket(std::span<const uint8_t> packet)
+{
+    static constexpr auto kSettingHandlers = [] {
+        std::array<SettingHandlerT, 256> table{};
+        table[Helper::ToUnderlying(SettingId::NoiseControl)] = &Manager::OnNoiseControlSetting;
+        table[Helper::ToUnderlying(SettingId::ConversationalAwareness)] =
+            &Manager::OnConversationalAwarenessSetting;
+        table[Helper::ToUnderlying(SettingId::PersonalizedVolume)] =
+            &Manager::OnPersonalizedVolumeSetting;
+        table[Helper::ToUnderlying(SettingId::AutomaticEarDetection)] =
+            &Manager::OnAutomaticEarDetectionSetting;
+        table[Helper::ToUnderlying(SettingId::LoudSoundReduction)] =
+            &Manager::OnLoudSoundReductionSetting;
+        table[Helper::ToUnderlying(SettingId::AdaptiveTransparencyLevel)] =
+            &Manager::OnAdaptiveTransparencyLevelSetting;
+        return table;
+    }();
+
+    if (packet.size() <= kSettingValueOffset) {
+        return false;
+    }
+
+    const auto setting = packet[kSettingIdOffset];
+    const auto handler = kSettingHandlers[setting];
+    if (handler != nullptr) {
+        (this->*handler)(packet[kSettingValueOffset]);
+    }
 
-bool Manager::InitializeConnection()
+    // Complete after the handler, so the cached state already has the new value
+    AcknowledgeCommand(setting);
+    return handler != nullptr;
+}
+
+bool Manager::OnEarDetectionPacket(std::span<const uint8_t> packet)
 {
-    // Send handshake
-    if (!SendPacket(Packets::Handshake)) {
-        LOG(Error, "AAP: Failed to send handshake");
+    if (packet.size() < 8) {
         return false;
     }
-    LOG(Info, "AAP: Sent handshake");
 
-    // Small delay to allow handshake to be processed
-    std::this_thread::sleep_for(kPacketProcessingDelay);
+    Notify(&Callbacks::onEarDetectionChanged, Decode::Ear(packet[6]), Decode::Ear(packet[7]));
+    return true;
+}
 
-    // Enable features (Conversational Awareness, Adaptive Transparency)
-    if (!SendPacket(Packets::EnableFeatures)) {
-        LOG(Warn, "AAP: Failed to send enable features packet");
-        // Continue anyway - some features may still work
+bool Manager::OnSpeakingLevelPacket(std::span<const uint8_t> packet)
+{
+    if (packet.size() < 10 || packet[6] != 0x02 || packet[7] != 0x00 || packet[8] != 0x01) {
+        return false;
     }
-    LOG(Info, "AAP: Sent enable features");
 
-    std::this_thread::sleep_for(kPacketProcessingDelay);
+    Notify(&Callbacks::onSpeakingLevelChanged, Decode::Speaking(packet[9]));
+    return true;
+}
 
-    // Request notifications (battery, ear detection, noise control, etc.)
-    if (!SendPacket(Packets::RequestNotifications)) {
-        LOG(Error, "AAP: Failed to send request notifications");
+bool Manager::OnHeadTrackingPacket(std::span<const uint8_t> packet)
+{
+    if (!_headTrackingActive || packet.size() < kHeadTrackingPacketSize) {
         return false;
     }
-    LOG(Info, "AAP: Sent request notifications");
 
+    const HeadTrackingSample sample{
+        .data = ParseHeadTrackingData(packet).value(),
+        .timestamp = std::chrono::steady_clock::now(),
+        .dropped = _headTrackingPendingDrops,
+    };
+    const auto starts = _headTrackingStarts.load(std::memory_order_relaxed);
+    if (_lastHeadTrackingFrame.has_value() && _lastHeadTrackingStart == starts) {
+        _trafficStats.headTrackingInterval.Record(sample.timestamp - *_lastHeadTrackingFrame);
+    }
+    _lastHeadTrackingFrame = sample.timestamp;
+    _lastHeadTrackingStart = starts;
+
+    if (_headTrackingRing.TryPush(sample)) {
+        _headTrackingPendingDrops = 0;
+    }
+    else {
+        ++_headTrackingPendingDrops;
+        _headTrackingDropped.fetch_add(1, std::memory_order_relaxed);
+    }
     return true;
 }
 
-bool Manager::IsMagicAAPDriverAvailable()
+void Manager::OnNoiseControlSetting(uint8_t value)
 {
-    return MagicAAPWinRT::MagicAAPWinRTClient::IsDriverInstalled() &&
-           MagicAAPWinRT::MagicAAPWinRTClient::IsDriverRunning();
+    const auto mode = Decode::NoiseControl(value);
+    UpdateState([&](DeviceState &cached) { cached.noiseControlMode = mode; });
+    LOG(Info, "AAP: Noise control mode changed to {}", mode);
+    Notify(&Callbacks::onNoiseControlChanged, mode);
 }
 
-bool Manager::ConnectViaMagicAAP(uint64_t deviceAddress)
+void Manager::OnConversationalAwarenessSetting(uint8_t value)
 {
-    // Check if MagicAAP driver is available
-    if (!MagicAAPWinRT::MagicAAPWinRTClient::IsDriverInstalled()) {
-        LOG(Info, "AAP: MagicAAP driver not installed");
-        return false;
+    const auto state = Decode::ConversationalAwareness(value);
+    UpdateState([&](DeviceState &cached) { cached.conversationalAwarenessState = state; });
+    LOG(Info, "AAP: Conversational awareness state: {}", state);
+    Notify(&Callbacks::onConversationalAwarenessChanged, state);
+}
+
+void Manager::OnPersonalizedVolumeSetting(uint8_t value)
+{
+    const auto state = Decode::PersonalizedVolume(value);
+    UpdateState([&](DeviceState &cached) { cached.personalizedVolumeState = state; });
+    LOG(Info, "AAP: Personalized volume state: {}", static_cast<int>(state));
+    Notify(&Callbacks::onPersonalizedVolumeChanged, state);
+}
+
+void Manager::OnAutomaticEarDetectionSetting(uint8_t value)
+{
+    const auto state = Decode::AutomaticEarDetection(value);
+    UpdateState([&](DeviceState &cached) { cached.automaticEarDetectionState = state; });
+    LOG(Info, "AAP: Automatic ear detection: {}", state ? "enabled" : "disabled");
+    Notify(&Callbacks::onAutomaticEarDetectionChanged, state);
+}
+
+void Manager::OnLoudSoundReductionSetting(uint8_t value)
+{
+    const auto state = Decode::LoudSoundReduction(value);
+    UpdateState([&](DeviceState &cached) { cached.loudSoundReductionState = state; });
+    LOG(Info, "AAP: Loud sound reduction: {}", static_cast<int>(state));
+    Notify(&Callbacks::onLoudSoundReductionChanged, state);
+}
+
+void Manager::OnAdaptiveTransparencyLevelSetting(uint8_t value)
+{
+    UpdateState([&](DeviceState &cached) { cached.adaptiveTransparencyLevel = value; });
+    LOG(Info, "AAP: Adaptive transparency level: {}", value);
+    Notify(&Callbacks::onAdaptiveTransparencyLevelChanged, value);
+}
+
+void Manager::ReaderLoop(std::shared_ptr<Transport> transport)
+{
+    // Allocated once per connection, every packet is processed in place as a span over it
+    if (_receiveBuffer.size() < kReceiveBufferSize) {
+        _receiveBuffer.resize(kReceiveBufferSize);
     }
-    
-    if (!MagicAAPWinRT::MagicAAPWinRTClient::IsDriverRunning()) {
-        LOG(Warn, "AAP: MagicAAP driver installed but not running");
-        return false;
+
+    bool setUp = EnterHandshakePhase(*transport, HandshakePhase::Handshake);
+
+    // Blocks until a packet arrives, or a queued command or `Disconnect()` wakes us, no periodic
+    // polling. Timeouts are only set for a handshake phase, a command the peer has not answered
+    // or traffic statistics that have not been published yet.
+    while (setUp && !_stopReader) {
+        if (_trafficStatsPublishAt.has_value() &&
+            std::chrono::steady_clock::now() >= *_trafficStatsPublishAt) {
+            PublishTrafficStats();
+        }
+
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        if (_handshakePhase != HandshakePhase::Complete) {
+            deadline = _phaseStart + kHandshakePhaseTimeout;
+        }
+        else {
+            // Commands queued during the handshake are held back until it's done
+            ExpireCommands();
+            SendQueuedCommands(*transport);
+
+            std::lock_guard<std::mutex> lock{_commandMutex};
+            for (const auto &command : _inFlightCommands) {
+                deadline = std::min(deadline.value_or(command.deadline), command.deadline);
+            }
+        }
+        if (_trafficStatsPublishAt.has_value()) {
+            const auto publishAt = *_trafficStatsPublishAt;
+            deadline = std::min(deadline.value_or(publishAt), publishAt);
+        }
+
+        std::optional<std::chrono::milliseconds> timeout;
+        if (deadline.has_value()) {
+            timeout = std::max(
+                std::chrono::ceil<std::chrono::milliseconds>(
+                    *deadline - std::chrono::steady_clock::now()),
+                std::chrono::milliseconds::zero());
+        }
+
+        const auto result = transport->Receive(_receiveBuffer, timeout);
+
+        if (result.status == ReceiveStatus::Data) {
+            const std::span<const uint8_t> packet{_receiveBuffer.data(), result.size};
+            if (const auto capture = _capture.load(std::memory_order_acquire)) {
+                capture->Write(CaptureDirection::Received, packet);
+            }
+            OnPacketReceived(packet);
+            if (_handshakePhase != HandshakePhase::Complete &&
+                IsHandshakeReply(_handshakePhase, packet)) {
+                setUp = AdvanceHandshake(*transport, true);
+            }
+            continue;
+        }
+        if (result.status == ReceiveStatus::Timeout) {
+            if (_handshakePhase != HandshakePhase::Complete) {
+                setUp = AdvanceHandshake(*transport, false);
+            }
+            continue;
+        }
+        if (result.status == ReceiveStatus::Woken) {
+            continue;
+        }
+        if (result.status == ReceiveStatus::Closed) {
+            LOG(Info, "AAP: Connection closed by remote");
+        }
+        break;
     }
-    
-    LOG(Info, "AAP: MagicAAP driver is available, attempting connection...");
-    
-    // Create MagicAAP client
-    _magicAAPClient = std::make_unique<MagicAAPWinRT::MagicAAPWinRTClient>();
-    
-    // Set callbacks
-    _magicAAPClient->SetOnDataReceived([this](const std::vector<uint8_t>& data) {
-        ProcessPacket(data);
-    });
-    
-    _magicAAPClient->SetOnDisconnected([this]() {
-        LOG(Info, "AAP: MagicAAP connection lost");
-        AAP::Callbacks::FnOnDisconnectedT callback;
-        {
-            std::lock_guard<std::mutex> lock{_mutex};
+
+    // Complete by the time `Connect()` fails or `onDisconnected` is invoked
+    PublishTrafficStats();
+
+    std::shared_ptr<Transport> lostTransport;
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (!_stopReader) {
+            // Connection was lost unexpectedly, or couldn't be set up. Nobody else closes it.
             _connected = false;
+            _headTrackingActive = false;
             _usingMagicAAP = false;
-            callback = _callbacks.onDisconnected;
+
+            std::lock_guard<std::mutex> transportLock{_transportMutex};
+            if (_transport == transport) {
+                lostTransport = std::move(_transport);
+            }
+        }
+        _setupFinished = true;
+    }
+    _setupConVar.notify_all();
+
+    if (lostTransport) {
+        lostTransport->Close();
+    }
+
+    // Invoke callback outside the lock to avoid potential deadlocks
+    if (_connectedNotified) {
+        _connectedNotified = false;
+        Notify(&Callbacks::onDisconnected);
+    }
+
+    // Not connected anymore at this point, nothing can be queued after this
+    FailCommands();
+}
+
+bool Manager::EnterHandshakePhase(Transport &transport, HandshakePhase phase)
+{
+    _handshakePhase = phase;
+    _phaseStart = std::chrono::steady_clock::now();
+
+    switch (phase) {
+    case HandshakePhase::Handshake:
+        // Without this, AirPods will not respond to any packets
+        if (!Send(transport, Packets::Handshake)) {
+            LOG(Error, "AAP: Failed to send handshake");
+            return false;
         }
-        if (callback) {
-            callback();
+        LOG(Info, "AAP: Sent handshake");
+        return true;
+
+    case HandshakePhase::EnableFeatures:
+        // Enable features (Conversational Awareness, Adaptive Transparency)
+        if (!Send(transport, Packets::EnableFeatures)) {
+            LOG(Warn, "AAP: Failed to send enable features packet");
+            // Continue anyway - some features may still work
         }
-    });
-    
-    // First, try device interface connection (direct file I/O)
-    LOG(Info, "AAP: Trying device interface connection...");
-    if (_magicAAPClient->ConnectViaDeviceInterface(deviceAddress)) {
-        LOG(Info, "AAP: Connected via MagicAAP device interface!");
-        
-        _connected = true;
-        _usingMagicAAP = true;
-        
-        // Initialize the AAP protocol
-        if (!InitializeConnection()) {
-            LOG(Error, "AAP: Failed to initialize MagicAAP connection");
-            _magicAAPClient->Disconnect();
-            _magicAAPClient.reset();
-            _connected = false;
-            _usingMagicAAP = false;
+        else {
+            LOG(Info, "AAP: Sent enable features");
+        }
+        return true;
+
+    case HandshakePhase::RequestNotifications:
+        // Request notifications (battery, ear detection, noise control, etc.)
+        if (!Send(transport, Packets::RequestNotifications)) {
+            LOG(Error, "AAP: Failed to send request notifications");
             return false;
         }
-        
-        if (_callbacks.onConnected) {
-            _callbacks.onConnected();
+        LOG(Info, "AAP: Sent request notifications");
+        // Nothing answers it, the notifications just start arriving
+        return AdvanceHandshake(transport, false);
+
+    case HandshakePhase::Complete: {
+        const auto total = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - _connectStart);
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _handshakeStats.total = total;
+            _handshakeStats.complete = true;
         }
-        
+        LOG(Info, "AAP: Connection set up in {} ms", total.count() / 1000.0);
+
+        _connectedNotified = true;
+        Notify(&Callbacks::onConnected);
+
+        // `Connect()` returns once `onConnected` has been invoked
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _setupFinished = true;
+        }
+        _setupConVar.notify_all();
         return true;
     }
-    
-    // Fallback: try WinRT RFCOMM connection
-    LOG(Info, "AAP: Device interface failed, trying WinRT RFCOMM...");
-    if (!_magicAAPClient->Connect(deviceAddress)) {
-        std::wstring errorW = _magicAAPClient->GetLastError();
-        std::string error(errorW.begin(), errorW.end());
-        LOG(Warn, "AAP: MagicAAP WinRT connection failed: {}", error);
-        _magicAAPClient.reset();
-        return false;
     }
-    
-    LOG(Info, "AAP: Connected via MagicAAP WinRT!");
-    
-    _connected = true;
-    _usingMagicAAP = true;
-    
-    // Initialize the AAP protocol
-    if (!InitializeConnection()) {
-        LOG(Error, "AAP: Failed to initialize MagicAAP connection");
-        _magicAAPClient->Disconnect();
-        _magicAAPClient.reset();
-        _connected = false;
-        _usingMagicAAP = false;
-        return false;
+    return false;
+}
+
+bool Manager::AdvanceHandshake(Transport &transport, bool acknowledged)
+{
+    const auto index = Helper::ToUnderlying(_handshakePhase);
+    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - _phaseStart);
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _handshakeStats.phaseDurations[index] = duration;
+        _handshakeStats.acknowledged[index] = acknowledged;
     }
-    
-    if (_callbacks.onConnected) {
-        _callbacks.onConnected();
+    LOG(Info, "AAP: Handshake phase {} {} after {} ms", index,
+        acknowledged ? "answered" : "not answered", duration.count() / 1000.0);
+
+    return EnterHandshakePhase(transport, static_cast<HandshakePhase>(index + 1));
+}
+
+HandshakeStats Manager::GetHandshakeStats() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return _handshakeStats;
+}
+
+bool Manager::StartCapture(const std::string &path)
+{
+    auto capture = CaptureWriter::Create(path);
+    if (capture == nullptr) {
+        return false;
     }
-    
+    _capture.store(std::move(capture), std::memory_order_release);
+    LOG(Info, "AAP: Capturing packets to '{}'", path);
     return true;
 }
 
-} // namespace Core::AAP
+void Manager::StopCapture()
+{
+    const auto capture = _capture.exchange(nullptr, std::memory_order_acq_rel);
+    if (capture != nullptr) {
+        // Complete once this returns. A frame the reader is writing right now follows when the
+        // reader lets go of the writer.
+        capture->Flush();
+        LOG(Info, "AAP: Capture stopped after {} packets", capture->GetFrameCount());
+    }
+}
 
+bool Manager::IsMagicAAPDriverAvailable()
+{
+#if defined APD_OS_WIN
+    return MagicAAPWinRT::MagicAAPWinRTClient::IsDriverInstalled() &&
+           MagicAAPWinRT::MagicAAPWinRTClient::IsDriverRunning();
 #else
-// Stub implementation for non-Windows platforms
-namespace Core::AAP {
-
-Manager::Manager() {}
-Manager::~Manager() { Disconnect(); }
-bool Manager::Connect(uint64_t) { return false; }
-void Manager::Disconnect() {}
-bool Manager::IsConnected() const { return false; }
-bool Manager::SetNoiseControlMode(NoiseControlMode) { return false; }
-std::optional<NoiseControlMode> Manager::GetNoiseControlMode() const { return std::nullopt; }
-bool Manager::SetConversationalAwareness(bool) { return false; }
-std::optional<ConversationalAwarenessState> Manager::GetConversationalAwarenessState() const { return std::nullopt; }
-bool Manager::SetAdaptiveNoiseLevel(uint8_t) { return false; }
-bool Manager::StartHeadTracking() { return false; }
-bool Manager::StopHeadTracking() { return false; }
-bool Manager::IsHeadTrackingActive() const { return false; }
-void Manager::SetCallbacks(Callbacks) {}
-bool Manager::IsMagicAAPDriverAvailable() { return false; }
-bool Manager::SendPacket(const std::vector<uint8_t>&) { return false; }
-void Manager::ProcessPacket(const std::vector<uint8_t>&) {}
-void Manager::ReaderLoop() {}
-bool Manager::InitializeConnection() { return false; }
-bool Manager::ConnectViaMagicAAP(uint64_t) { return false; }
+    return false;
+#endif
+}
 
 } // namespace Core::AAP
-
-#endif
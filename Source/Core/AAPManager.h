@@ -18,46 +18,53 @@
 
 #pragma once
 
+#include <span>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <mutex>
+#include <deque>
+#include <condition_variable>
 #include <thread>
 #include <functional>
 #include <optional>
 #include <memory>
+#include <string_view>
+#include <unordered_map>
 
 #include "AAP.h"
+#include "AAPCapture.h"
+#include "AAPHeadTracking.h"
+#include "AAPTransport.h"
 #include "Base.h"
 #include "../Helper.h"
 
-// Forward declaration for MagicAAP WinRT client
-namespace Core::MagicAAPWinRT {
-    class MagicAAPWinRTClient;
-}
-
 namespace Core::AAP {
 
 //////////////////////////////////////////////////
 // Callbacks for AAP events
 //
 
+// All of them are invoked on the reader thread, keep them short. `onConnected` is invoked once the
+// handshake is done, and `onDisconnected` only after `onConnected`, when the connection is lost
+// or disconnected.
 struct Callbacks {
-    using FnOnNoiseControlChangedT = std::function<void(NoiseControlMode)>;
-    using FnOnConversationalAwarenessChangedT = std::function<void(ConversationalAwarenessState)>;
-    using FnOnSpeakingLevelChangedT = std::function<void(SpeakingLevel)>;
-    using FnOnEarDetectionChangedT = std::function<void(EarStatus, EarStatus)>;
-    using FnOnHeadTrackingDataT = std::function<void(HeadTrackingData)>;
-    using FnOnPersonalizedVolumeChangedT = std::function<void(PersonalizedVolumeState)>;
-    using FnOnLoudSoundReductionChangedT = std::function<void(LoudSoundReductionState)>;
-    using FnOnAutomaticEarDetectionChangedT = std::function<void(bool)>;
-    using FnOnAdaptiveTransparencyLevelChangedT = std::function<void(uint8_t)>;
-    using FnOnConnectedT = std::function<void()>;
-    using FnOnDisconnectedT = std::function<void()>;
+    using FnOnNoiseControlChangedT = Helper::InplaceFunction<void(NoiseControlMode)>;
+    using FnOnConversationalAwarenessChangedT =
+        Helper::InplaceFunction<void(ConversationalAwarenessState)>;
+    using FnOnSpeakingLevelChangedT = Helper::InplaceFunction<void(SpeakingLevel)>;
+    using FnOnEarDetectionChangedT = Helper::InplaceFunction<void(EarStatus, EarStatus)>;
+    using FnOnPersonalizedVolumeChangedT = Helper::InplaceFunction<void(PersonalizedVolumeState)>;
+    using FnOnLoudSoundReductionChangedT = Helper::InplaceFunction<void(LoudSoundReductionState)>;
+    using FnOnAutomaticEarDetectionChangedT = Helper::InplaceFunction<void(bool)>;
+    using FnOnAdaptiveTransparencyLevelChangedT = Helper::InplaceFunction<void(uint8_t)>;
+    using FnOnConnectedT = Helper::InplaceFunction<void()>;
+    using FnOnDisconnectedT = Helper::InplaceFunction<void()>;
     
     FnOnNoiseControlChangedT onNoiseControlChanged;
     FnOnConversationalAwarenessChangedT onConversationalAwarenessChanged;
     FnOnSpeakingLevelChangedT onSpeakingLevelChanged;
     FnOnEarDetectionChangedT onEarDetectionChanged;
-    FnOnHeadTrackingDataT onHeadTrackingData;
     FnOnPersonalizedVolumeChangedT onPersonalizedVolumeChanged;
     FnOnLoudSoundReductionChangedT onLoudSoundReductionChanged;
     FnOnAutomaticEarDetectionChangedT onAutomaticEarDetectionChanged;
@@ -66,6 +73,116 @@ struct Callbacks {
     FnOnDisconnectedT onDisconnected;
 };
 
+//////////////////////////////////////////////////
+// Receive path statistics
+//
+
+struct ReceiveStats {
+    uint64_t packets{0};
+    uint64_t bytes{0};
+};
+
+//////////////////////////////////////////////////
+// Traffic statistics
+//
+// Counted by the reader thread for the current (or last) connection. Tells apart where a slow
+// command is stuck: sent late (us), answered late (the link or the firmware) or not answered.
+//
+
+struct TrafficCounter {
+    uint64_t packets{0};
+    uint64_t bytes{0};
+};
+
+struct DirectionTrafficStats {
+    // Packets with an AAP header, by opcode
+    std::array<TrafficCounter, 256> opcodes{};
+    // Settings packets by setting id, also counted in `opcodes`
+    std::array<TrafficCounter, 256> settings{};
+    // Packets without an AAP header
+    TrafficCounter headerless;
+};
+
+struct TrafficStats {
+    DirectionTrafficStats received, sent;
+    // Received packets no handler took
+    uint64_t unknownPackets{0};
+    uint64_t sendFailures{0};
+    // From sending a settings command until the peer notifies the setting back
+    Helper::LatencyHistogram commandLatency;
+    // Between consecutive head tracking frames of a stream
+    Helper::LatencyHistogram headTrackingInterval;
+};
+
+//////////////////////////////////////////////////
+// Connection setup
+//
+// Run by the reader thread once the transport is up. Each phase sends its packet and moves on as
+// soon as the peer sends the expected answer back, falling back to a timeout if it doesn't. A
+// phase the peer doesn't answer at all moves on right away.
+//
+
+enum class HandshakePhase : uint32_t {
+    Handshake,
+    EnableFeatures,
+    RequestNotifications,
+    Complete,
+};
+
+struct HandshakeStats {
+    static constexpr size_t kPhaseCount = Helper::ToUnderlying(HandshakePhase::Complete);
+
+    // Time spent in each phase, from sending its packet until moving on
+    std::array<std::chrono::microseconds, kPhaseCount> phaseDurations{};
+    // False if the phase moved on without an answer, because of the timeout or because the peer
+    // doesn't answer it
+    std::array<bool, kPhaseCount> acknowledged{};
+    std::chrono::microseconds total{0};
+    bool complete{false};
+};
+
+//////////////////////////////////////////////////
+// Device state
+//
+// Everything the manager caches from notifications, published as an immutable snapshot. Readers
+// get a consistent view of all fields without contending with the reader thread.
+//
+
+struct DeviceState {
+    std::optional<NoiseControlMode> noiseControlMode;
+    std::optional<ConversationalAwarenessState> conversationalAwarenessState;
+    std::optional<PersonalizedVolumeState> personalizedVolumeState;
+    std::optional<bool> automaticEarDetectionState;
+    std::optional<LoudSoundReductionState> loudSoundReductionState;
+    std::optional<uint8_t> adaptiveTransparencyLevel;
+
+    // Incremented on every change, equal generations mean equal states
+    uint64_t generation{0};
+};
+
+//////////////////////////////////////////////////
+// Outbound commands
+//
+// Setters don't touch the transport, they queue their command and wake the reader thread, which
+// sends it. A setting has at most one command in flight until the peer notifies it back. Newer
+// values queued meanwhile replace each other, so only the latest one is sent.
+//
+
+enum class CommandResult : uint32_t {
+    // The peer notified the setting back
+    Acknowledged,
+    // Sent, the command isn't acknowledged by the peer
+    Sent,
+    // Sent, but the peer didn't notify the setting in time
+    TimedOut,
+    // Not sent, the send failed or the connection went down
+    Failed,
+};
+
+// Invoked on the reader thread, or on the thread calling `Connect()` for the commands left over
+// from the last connection. Commands coalesced into a newer one complete with its result.
+using FnCommandCompletedT = Helper::InplaceFunction<void(CommandResult result)>;
+
 //////////////////////////////////////////////////
 // AAP Manager - Manages L2CAP connection and protocol
 //
@@ -75,46 +192,76 @@ public:
     Manager();
     ~Manager();
 
-    // Connection management
+    // Connection management. `Connect()` returns once the handshake is done, true if it succeeded.
     bool Connect(uint64_t deviceAddress);
+    // Runs the protocol over an already connected transport, e.g. one end of a loopback pair
+    bool Connect(std::unique_ptr<Transport> transport);
     void Disconnect();
     bool IsConnected() const;
 
+    // Setters return false if not connected, otherwise the command is queued and `onCompleted`
+    // reports its outcome.
+
     // Noise control
-    bool SetNoiseControlMode(NoiseControlMode mode);
+    bool SetNoiseControlMode(NoiseControlMode mode, FnCommandCompletedT onCompleted = {});
     std::optional<NoiseControlMode> GetNoiseControlMode() const;
 
     // Conversational awareness
-    bool SetConversationalAwareness(bool enable);
+    bool SetConversationalAwareness(bool enable, FnCommandCompletedT onCompleted = {});
     std::optional<ConversationalAwarenessState> GetConversationalAwarenessState() const;
 
     // Personalized volume
-    bool SetPersonalizedVolume(bool enable);
+    bool SetPersonalizedVolume(bool enable, FnCommandCompletedT onCompleted = {});
     std::optional<PersonalizedVolumeState> GetPersonalizedVolumeState() const;
 
     // Automatic ear detection (off-ear auto pause)
-    bool SetAutomaticEarDetection(bool enable);
+    bool SetAutomaticEarDetection(bool enable, FnCommandCompletedT onCompleted = {});
     std::optional<bool> GetAutomaticEarDetectionState() const;
 
     // Loud sound reduction (headphone safety)
-    bool SetLoudSoundReduction(bool enable);
+    bool SetLoudSoundReduction(bool enable, FnCommandCompletedT onCompleted = {});
     std::optional<LoudSoundReductionState> GetLoudSoundReductionState() const;
 
     // Adaptive transparency level (0-50, only effective when noise control is Adaptive)
-    bool SetAdaptiveTransparencyLevel(uint8_t level);
+    bool SetAdaptiveTransparencyLevel(uint8_t level, FnCommandCompletedT onCompleted = {});
     std::optional<uint8_t> GetAdaptiveTransparencyLevel() const;
 
-    // Adaptive noise level (0-100, only effective when noise control is Adaptive)
-    bool SetAdaptiveNoiseLevel(uint8_t level);
+    // Adaptive noise level (0-100, only effective when noise control is Adaptive). The peer doesn't
+    // notify it back, the command completes with `Sent`.
+    bool SetAdaptiveNoiseLevel(uint8_t level, FnCommandCompletedT onCompleted = {});
 
     // Head tracking
     bool StartHeadTracking();
     bool StopHeadTracking();
     bool IsHeadTrackingActive() const;
+    // Moves the oldest buffered samples into `out`, returns how many. Only one thread may pull.
+    size_t PopHeadTrackingSamples(std::span<HeadTrackingSample> out);
+    // Samples dropped because the consumer fell behind, over the lifetime of the manager
+    uint64_t GetHeadTrackingDroppedCount() const;
 
-    // Callbacks
+    // Consistent snapshot of all cached states
+    std::shared_ptr<const DeviceState> GetState() const;
+    // Cheap check whether the state changed since a snapshot was taken
+    uint64_t GetStateGeneration() const;
+
+    // Callbacks. They are invoked without any lock held, on the reader thread.
     void SetCallbacks(Callbacks callbacks);
 
+    // Receive path statistics of the current (or last) connection
+    ReceiveStats GetReceiveStats() const;
+
+    // Traffic statistics of the current (or last) connection. Published by the reader thread, up
+    // to 100 ms behind while connected and complete once the connection is gone.
+    TrafficStats GetTrafficStats() const;
+
+    // Connection setup timings of the current (or last) connection
+    HandshakeStats GetHandshakeStats() const;
+
+    // Records every packet sent and received into a capture file, across connections, until
+    // stopped. Replaces a capture already running.
+    bool StartCapture(const std::string &path);
+    void StopCapture();
+
     // Check if connected via MagicAAP driver
     bool IsConnectedViaMagicAAP() const { return _usingMagicAAP.load(); }
     
@@ -127,37 +274,130 @@ private:
     std::atomic<bool> _headTrackingActive{false};
     std::atomic<bool> _usingMagicAAP{false};
     
-    // Cached states
-    std::optional<NoiseControlMode> _noiseControlMode;
-    std::optional<ConversationalAwarenessState> _conversationalAwarenessState;
-    std::optional<PersonalizedVolumeState> _personalizedVolumeState;
-    std::optional<bool> _automaticEarDetectionState;
-    std::optional<LoudSoundReductionState> _loudSoundReductionState;
-    std::optional<uint8_t> _adaptiveTransparencyLevel;
+    // Cached states, replaced as a whole on every change. Updates are serialized by
+    // `_stateUpdateMutex`, reads only load the pointer.
+    std::mutex _stateUpdateMutex;
+    std::atomic<std::shared_ptr<const DeviceState>> _state{std::make_shared<DeviceState>()};
+    // Snapshots reused once no reader holds them anymore, so updates don't allocate
+    std::array<std::shared_ptr<DeviceState>, 4> _statePool;
+    std::atomic<uint64_t> _stateGeneration{0};
     
-    // Callbacks
-    Callbacks _callbacks;
+    // Callbacks, replaced as a whole. The reader thread only loads the pointer.
+    std::atomic<std::shared_ptr<const Callbacks>> _callbacks{std::make_shared<Callbacks>()};
     
-    // Platform-specific socket handle (implemented in platform-specific file)
-    void* _socket{nullptr};
-    
-    // MagicAAP WinRT client (used when driver is available)
-    std::unique_ptr<MagicAAPWinRT::MagicAAPWinRTClient> _magicAAPClient;
+    // Connect method that won the last race for each device, tried first next time
+    std::unordered_map<uint64_t, std::string_view> _preferredConnectMethods;
+
+    // Capture tap, checked for every packet
+    std::atomic<std::shared_ptr<CaptureWriter>> _capture;
+
+    // Transport of the current connection, shared with the reader thread
+    std::mutex _transportMutex;
+    std::shared_ptr<Transport> _transport;
     
+    // Commands waiting to be sent by the reader thread
+    struct QueuedCommand {
+        // Inline, queuing a command doesn't allocate for the packet
+        std::array<uint8_t, Packets::kMaxCommandSize> buffer{};
+        size_t size{0};
+        // Setting id of settings commands, which are coalesced
+        std::optional<uint8_t> setting;
+        // Waits for the peer to notify the setting back, only one at a time is in flight
+        bool acknowledged{false};
+        std::vector<FnCommandCompletedT> completions;
+    };
+    struct InFlightCommand {
+        uint8_t setting{0};
+        std::chrono::steady_clock::time_point sent, deadline;
+        std::vector<FnCommandCompletedT> completions;
+    };
+    // Guards both lists. The reader thread sends and acknowledges, `Start()` fails what the last
+    // connection left over.
+    std::mutex _commandMutex;
+    std::deque<QueuedCommand> _queuedCommands;
+    // Sent and waiting for their notification
+    std::vector<InFlightCommand> _inFlightCommands;
+    // Reader thread only, what `SendQueuedCommands()` is sending
+    std::vector<QueuedCommand> _sendingCommands;
+
     // Reader thread
     std::thread _readerThread;
     std::atomic<bool> _stopReader{false};
-    // Indicates whether reader thread has exited
-    std::atomic<bool> _readerExited{true};
+
+    // Head tracking stream, about 2.5 s worth of samples at the AirPods' 100 Hz
+    static constexpr size_t kHeadTrackingRingSize = 256;
+    Helper::SpscRing<HeadTrackingSample, kHeadTrackingRingSize> _headTrackingRing;
+    // Dropped since the last sample that made it into the ring, only touched by the reader thread
+    uint32_t _headTrackingPendingDrops{0};
+    std::atomic<uint64_t> _headTrackingDropped{0};
+    // Bumped by every start, an interval is only measured between frames of the same stream
+    std::atomic<uint32_t> _headTrackingStarts{0};
+    uint32_t _lastHeadTrackingStart{0};
+    std::optional<std::chrono::steady_clock::time_point> _lastHeadTrackingFrame;
+
+    // Receive buffer, reused for every packet
+    static constexpr size_t kReceiveBufferSize = 1024;
+    std::vector<uint8_t> _receiveBuffer;
+    std::atomic<uint64_t> _receivedPackets{0};
+    std::atomic<uint64_t> _receivedBytes{0};
+
+    // Only touched by the reader thread, which copies them to `_publishedTrafficStats` at most
+    // 100 ms after they changed, so counting a packet takes no lock
+    TrafficStats _trafficStats;
+    std::optional<std::chrono::steady_clock::time_point> _trafficStatsPublishAt;
+    mutable std::mutex _trafficStatsMutex;
+    TrafficStats _publishedTrafficStats;
+
+    // Connection setup state, reset by `Start()` before the reader starts and only touched by the
+    // reader thread after that (stats are read under `_mutex`)
+    HandshakePhase _handshakePhase{HandshakePhase::Handshake};
+    std::chrono::steady_clock::time_point _connectStart, _phaseStart;
+    HandshakeStats _handshakeStats;
+    // Whether `onConnected` was invoked, `onDisconnected` is only invoked after it
+    bool _connectedNotified{false};
+    // Set under `_mutex` once the handshake is done or the reader gave up, `Start()` waits for it
+    std::condition_variable _setupConVar;
+    bool _setupFinished{false};
     
     // Internal methods
-    bool SendPacket(const std::vector<uint8_t>& packet);
-    void ProcessPacket(const std::vector<uint8_t>& packet);
-    void ReaderLoop();
-    bool InitializeConnection();
-    
-    // MagicAAP connection method
-    bool ConnectViaMagicAAP(uint64_t deviceAddress);
+    bool Send(Transport &transport, std::span<const uint8_t> packet);
+    void CountPacket(DirectionTrafficStats &direction, std::span<const uint8_t> packet);
+    bool QueueCommand(std::span<const uint8_t> packet, FnCommandCompletedT onCompleted);
+    void SendQueuedCommands(Transport &transport);
+    void AcknowledgeCommand(uint8_t setting);
+    void ExpireCommands();
+    void FailCommands();
+    void OnPacketReceived(std::span<const uint8_t> packet);
+    void ProcessPacket(std::span<const uint8_t> packet);
+    void ResetReceiveStats();
+    void TrafficStatsChanged();
+    void PublishTrafficStats();
+    template <class FnUpdateT>
+    void UpdateState(FnUpdateT &&update);
+    template <class FnCallbackT, class... ArgsT>
+    void Notify(FnCallbackT Callbacks::*callback, ArgsT &&...args) const;
+    std::shared_ptr<Transport> GetTransport();
+    void ReaderLoop(std::shared_ptr<Transport> transport);
+    bool EnterHandshakePhase(Transport &transport, HandshakePhase phase);
+    bool AdvanceHandshake(Transport &transport, bool acknowledged);
+    bool Start(std::shared_ptr<Transport> transport, Backend backend);
+
+    // Packet handlers, dispatched by opcode (byte 4) and setting id (byte 6).
+    // A handler returns false if the packet turns out to be malformed or unhandled.
+    using PacketHandlerT = bool (Manager::*)(std::span<const uint8_t>);
+    using SettingHandlerT = void (Manager::*)(uint8_t);
+
+    bool OnSettingsPacket(std::span<const uint8_t> packet);
+    bool OnEarDetectionPacket(std::span<const uint8_t> packet);
+    bool OnSpeakingLevelPacket(std::span<const uint8_t> packet);
+    bool OnHeadTrackingPacket(std::span<const uint8_t> packet);
+
+    void OnNoiseControlSetting(uint8_t value);
+    void OnConversationalAwarenessSetting(uint8_t value);
+    void OnPersonalizedVolumeSetting(uint8_t value);
+    void OnAutomaticEarDetectionSetting(uint8_t value);
+    void OnLoudSoundReductionSetting(uint8_t value);
+    void OnAdaptiveTransparencyLevelSetting(uint8_t value);
 };
 
 } // namespace Core::AAP
@@ -0,0 +1,597 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "AAPTransport.h"
+
+#include <algorithm>
+
+#include "../Logger.h"
+
+#if defined APD_OS_WIN
+    #include <WinSock2.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #if defined __linux__
+        #include <sys/eventfd.h>
+    #endif
+#endif
+
+using namespace std::chrono_literals;
+
+namespace Core::AAP {
+
+namespace {
+
+// Remaining time until the deadline in the form expected by the platform wait functions,
+// `nullopt` if there is no deadline.
+//
+std::optional<std::chrono::milliseconds>
+Remaining(const std::optional<std::chrono::steady_clock::time_point> &deadline)
+{
+    if (!deadline.has_value()) {
+        return std::nullopt;
+    }
+    const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+        deadline.value() - std::chrono::steady_clock::now());
+    return std::max(remaining, 0ms);
+}
+
+} // namespace
+
+#if defined APD_OS_WIN
+
+SocketTransport::SocketTransport(NativeSocket socket) : _socket{socket}
+{
+    _socketEvent = WSACreateEvent();
+    _wakeEvent = WSACreateEvent();
+
+    // Also puts the socket into non-blocking mode, `Receive()` waits on the event instead
+    if (WSAEventSelect(static_cast<SOCKET>(socket), _socketEvent, FD_READ | FD_CLOSE) ==
+        SOCKET_ERROR) {
+        LOG(Error, "AAP: WSAEventSelect failed: {}", WSAGetLastError());
+    }
+}
+
+SocketTransport::~SocketTransport()
+{
+    Close();
+    WSACloseEvent(_socketEvent);
+    WSACloseEvent(_wakeEvent);
+}
+
+bool SocketTransport::Send(std::span<const uint8_t> packet)
+{
+    const auto socket = static_cast<SOCKET>(_socket.load());
+    if (socket == INVALID_SOCKET) {
+        return false;
+    }
+
+    while (true) {
+        int sent = send(
+            socket, reinterpret_cast<const char *>(packet.data()), static_cast<int>(packet.size()),
+            0);
+        if (sent != SOCKET_ERROR) {
+            return true;
+        }
+
+        int error = WSAGetLastError();
+        if (error != WSAEWOULDBLOCK) {
+            LOG(Error, "AAP: Failed to send packet: {}", error);
+            return false;
+        }
+
+        // The socket is non-blocking, wait for the send buffer to drain
+        fd_set writeSet;
+        FD_ZERO(&writeSet);
+        FD_SET(socket, &writeSet);
+        timeval timeout{.tv_sec = 1, .tv_usec = 0};
+        if (select(0, nullptr, &writeSet, nullptr, &timeout) <= 0) {
+            LOG(Error, "AAP: Timed out waiting to send packet");
+            return false;
+        }
+    }
+}
+
+ReceiveResult SocketTransport::Receive(
+    std::span<uint8_t> buffer, std::optional<std::chrono::milliseconds> timeout)
+{
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    if (timeout.has_value()) {
+        deadline = std::chrono::steady_clock::now() + timeout.value();
+    }
+
+    while (true) {
+        const auto socket = static_cast<SOCKET>(_socket.load());
+        if (socket == INVALID_SOCKET) {
+            return {ReceiveStatus::Closed};
+        }
+
+        // Drain whatever is already queued before blocking
+        int received = recv(
+            socket, reinterpret_cast<char *>(buffer.data()), static_cast<int>(buffer.size()), 0);
+        if (received > 0) {
+            return {ReceiveStatus::Data, static_cast<size_t>(received)};
+        }
+        if (received == 0) {
+            return {ReceiveStatus::Closed};
+        }
+
+        int error = WSAGetLastError();
+        if (error != WSAEWOULDBLOCK) {
+            LOG(Error, "AAP: Receive error: {}", error);
+            return {ReceiveStatus::Error};
+        }
+
+        const auto remaining = Remaining(deadline);
+        if (remaining.has_value() && remaining.value() == 0ms) {
+            return {ReceiveStatus::Timeout};
+        }
+
+        WSAEVENT events[] = {_wakeEvent, _socketEvent};
+        DWORD waitResult = WSAWaitForMultipleEvents(
+            2, events, FALSE,
+            remaining.has_value() ? static_cast<DWORD>(remaining.value().count()) : WSA_INFINITE,
+            FALSE);
+
+        if (waitResult == WSA_WAIT_FAILED) {
+            LOG(Error, "AAP: WSAWaitForMultipleEvents failed: {}", WSAGetLastError());
+            return {ReceiveStatus::Error};
+        }
+        if (waitResult == WSA_WAIT_TIMEOUT) {
+            return {ReceiveStatus::Timeout};
+        }
+        if (waitResult == WSA_WAIT_EVENT_0) {
+            WSAResetEvent(_wakeEvent);
+            return {ReceiveStatus::Woken};
+        }
+
+        // Socket event, resets it. Pending data or the close is picked up by `recv` above.
+        WSANETWORKEVENTS networkEvents{};
+        WSAEnumNetworkEvents(socket, _socketEvent, &networkEvents);
+    }
+}
+
+void SocketTransport::Wake()
+{
+    WSASetEvent(_wakeEvent);
+}
+
+void SocketTransport::Close()
+{
+    const auto socket = static_cast<SOCKET>(_socket.exchange(INVALID_SOCKET));
+    if (socket != INVALID_SOCKET) {
+        closesocket(socket);
+        Wake();
+    }
+}
+
+#else
+
+SocketTransport::SocketTransport(NativeSocket socket) : _socket{socket}
+{
+    #if defined __linux__
+    _wakeReadFd = _wakeWriteFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeReadFd == -1) {
+        LOG(Error, "AAP: eventfd failed: {}", errno);
+    }
+    #else
+    int fds[2];
+    if (pipe(fds) == 0) {
+        for (int fd : fds) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        _wakeReadFd = fds[0];
+        _wakeWriteFd = fds[1];
+    }
+    else {
+        LOG(Error, "AAP: pipe failed: {}", errno);
+    }
+    #endif
+}
+
+SocketTransport::~SocketTransport()
+{
+    Close();
+    if (_wakeReadFd != -1) {
+        close(_wakeReadFd);
+    }
+    if (_wakeWriteFd != -1 && _wakeWriteFd != _wakeReadFd) {
+        close(_wakeWriteFd);
+    }
+}
+
+bool SocketTransport::Send(std::span<const uint8_t> packet)
+{
+    const int socket = _socket.load();
+    if (socket == -1) {
+        return false;
+    }
+
+    while (true) {
+        ssize_t sent = send(socket, packet.data(), packet.size(), MSG_NOSIGNAL);
+        if (sent >= 0) {
+            return true;
+        }
+        if (errno != EINTR) {
+            LOG(Error, "AAP: Failed to send packet: {}", errno);
+            return false;
+        }
+    }
+}
+
+ReceiveResult SocketTransport::Receive(
+    std::span<uint8_t> buffer, std::optional<std::chrono::milliseconds> timeout)
+{
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    if (timeout.has_value()) {
+        deadline = std::chrono::steady_clock::now() + timeout.value();
+    }
+
+    while (true) {
+        const int socket = _socket.load();
+        if (socket == -1) {
+            return {ReceiveStatus::Closed};
+        }
+
+        // Drain whatever is already queued before blocking
+        ssize_t received = recv(socket, buffer.data(), buffer.size(), MSG_DONTWAIT);
+        if (received > 0) {
+            return {ReceiveStatus::Data, static_cast<size_t>(received)};
+        }
+        if (received == 0) {
+            return {ReceiveStatus::Closed};
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOG(Error, "AAP: Receive error: {}", errno);
+            return {ReceiveStatus::Error};
+        }
+
+        const auto remaining = Remaining(deadline);
+        if (remaining.has_value() && remaining.value() == 0ms) {
+            return {ReceiveStatus::Timeout};
+        }
+
+        pollfd fds[] = {{_wakeReadFd, POLLIN, 0}, {socket, POLLIN, 0}};
+        int pollResult =
+            poll(fds, 2, remaining.has_value() ? static_cast<int>(remaining.value().count()) : -1);
+
+        if (pollResult < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG(Error, "AAP: poll failed: {}", errno);
+            return {ReceiveStatus::Error};
+        }
+        if (pollResult == 0) {
+            return {ReceiveStatus::Timeout};
+        }
+        if (fds[0].revents & POLLIN) {
+            DrainWake();
+            return {ReceiveStatus::Woken};
+        }
+
+        // Socket readable or hung up, picked up by `recv` above
+    }
+}
+
+void SocketTransport::Wake()
+{
+    #if defined __linux__
+    const uint64_t value = 1;
+    #else
+    const uint8_t value = 1;
+    #endif
+    [[maybe_unused]] auto written = write(_wakeWriteFd, &value, sizeof(value));
+}
+
+void SocketTransport::Close()
+{
+    const int socket = _socket.exchange(-1);
+    if (socket != -1) {
+        shutdown(socket, SHUT_RDWR);
+        close(socket);
+        Wake();
+    }
+}
+
+void SocketTransport::DrainWake()
+{
+    uint64_t value;
+    while (read(_wakeReadFd, &value, sizeof(value)) > 0) {
+    }
+}
+
+#endif
+
+//////////////////////////////////////////////////
+// PacketQueue
+//
+
+PacketQueue::PacketQueue()
+{
+    _freeBuffers.reserve(kMaxFreeBuffers);
+    _freeBuffers.resize(kPreallocatedBuffers);
+    for (auto &buffer : _freeBuffers) {
+        buffer.reserve(kBufferSize);
+    }
+}
+
+bool PacketQueue::Push(std::span<const uint8_t> packet)
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (_closed) {
+            return false;
+        }
+
+        std::vector<uint8_t> buffer;
+        if (!_freeBuffers.empty()) {
+            buffer = std::move(_freeBuffers.back());
+            _freeBuffers.pop_back();
+        }
+        buffer.assign(packet.begin(), packet.end());
+        _packets.push_back(std::move(buffer));
+    }
+    _cv.notify_one();
+    return true;
+}
+
+ReceiveResult
+PacketQueue::Pop(std::span<uint8_t> buffer, std::optional<std::chrono::milliseconds> timeout)
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    const auto ready = [this] { return !_packets.empty() || _woken || _closed; };
+    if (timeout.has_value()) {
+        if (!_cv.wait_for(lock, timeout.value(), ready)) {
+            return {ReceiveStatus::Timeout};
+        }
+    }
+    else {
+        _cv.wait(lock, ready);
+    }
+
+    if (!_packets.empty()) {
+        auto packet = std::move(_packets.front());
+        _packets.pop_front();
+
+        const size_t size = std::min(packet.size(), buffer.size());
+        std::copy_n(packet.begin(), size, buffer.begin());
+        if (_freeBuffers.size() < kMaxFreeBuffers) {
+            _freeBuffers.push_back(std::move(packet));
+        }
+        return {ReceiveStatus::Data, size};
+    }
+    if (_woken) {
+        _woken = false;
+        return {ReceiveStatus::Woken};
+    }
+    return {ReceiveStatus::Closed};
+}
+
+void PacketQueue::Wake()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _woken = true;
+    }
+    _cv.notify_all();
+}
+
+void PacketQueue::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _closed = true;
+    }
+    _cv.notify_all();
+}
+
+bool PacketQueue::IsClosed() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return _closed;
+}
+
+//////////////////////////////////////////////////
+// LoopbackTransport
+//
+
+std::pair<std::unique_ptr<LoopbackTransport>, std::unique_ptr<LoopbackTransport>>
+LoopbackTransport::CreatePair()
+{
+    auto first = std::make_shared<PacketQueue>(), second = std::make_shared<PacketQueue>();
+    return {
+        std::make_unique<LoopbackTransport>(first, second),
+        std::make_unique<LoopbackTransport>(second, first)};
+}
+
+LoopbackTransport::LoopbackTransport(
+    std::shared_ptr<PacketQueue> incoming, std::shared_ptr<PacketQueue> outgoing)
+    : _incoming{std::move(incoming)}, _outgoing{std::move(outgoing)}
+{
+}
+
+LoopbackTransport::~LoopbackTransport()
+{
+    Close();
+}
+
+bool LoopbackTransport::Send(std::span<const uint8_t> packet)
+{
+    return _outgoing->Push(packet);
+}
+
+ReceiveResult LoopbackTransport::Receive(
+    std::span<uint8_t> buffer, std::optional<std::chrono::milliseconds> timeout)
+{
+    return _incoming->Pop(buffer, timeout);
+}
+
+void LoopbackTransport::Wake()
+{
+    _incoming->Wake();
+}
+
+void LoopbackTransport::Close()
+{
+    // Closes both directions, the peer sees `Closed` after draining what was already sent
+    _incoming->Close();
+    _outgoing->Close();
+}
+
+//////////////////////////////////////////////////
+// Connect methods
+//
+
+bool ConnectCancellation::IsCancelled() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return _cancelled;
+}
+
+bool ConnectCancellation::SetAbort(std::function<void()> abort)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    if (_cancelled) {
+        return false;
+    }
+    _abort = std::move(abort);
+    return true;
+}
+
+bool ConnectCancellation::ClearAbort()
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+    _abortedConVar.wait(lock, [this] { return !_aborting; });
+    _abort = nullptr;
+    return !_cancelled;
+}
+
+void ConnectCancellation::Cancel()
+{
+    std::function<void()> abort;
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (_cancelled) {
+            return;
+        }
+        _cancelled = true;
+        abort = std::move(_abort);
+        _aborting = static_cast<bool>(abort);
+    }
+    if (!abort) {
+        return;
+    }
+
+    abort();
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _aborting = false;
+    }
+    _abortedConVar.notify_all();
+}
+
+ConnectResult RaceConnect(
+    std::span<const ConnectMethod *const> methods, uint64_t deviceAddress,
+    std::chrono::milliseconds stagger)
+{
+    // Shared with the attempts, which are detached and may outlive the race
+    struct Race {
+        std::mutex mutex;
+        std::condition_variable cv;
+        ConnectResult result;
+        size_t finished{0};
+        // Set by the winner, or by the caller once it gave up. Attempts connecting after that
+        // close their transport.
+        bool decided{false};
+    };
+    auto race = std::make_shared<Race>();
+    std::vector<std::shared_ptr<ConnectCancellation>> cancellations;
+
+    std::unique_lock<std::mutex> lock{race->mutex};
+
+    for (const ConnectMethod *method : methods) {
+        auto cancellation = std::make_shared<ConnectCancellation>();
+        cancellations.push_back(cancellation);
+
+        LOG(Info, "AAP: Attempting {} connection to {:016X}", method->name, deviceAddress);
+
+        std::thread{[race, cancellation, method, deviceAddress] {
+            auto transport = method->connect(deviceAddress, *cancellation);
+            if (!transport) {
+                LOG(Warn, "AAP: {} connection failed", method->name);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock{race->mutex};
+                ++race->finished;
+                if (transport && !race->decided) {
+                    race->result = {std::move(transport), method};
+                    race->decided = true;
+                }
+            }
+            race->cv.notify_all();
+
+            // Still ours if another attempt won
+            if (transport) {
+                LOG(Info, "AAP: {} connected after the race was decided, closing it",
+                    method->name);
+                transport->Close();
+            }
+        }}.detach();
+
+        const size_t launched = cancellations.size();
+        race->cv.wait_for(
+            lock, stagger, [&] { return race->decided || race->finished == launched; });
+        if (race->decided) {
+            break;
+        }
+    }
+
+    race->cv.wait(
+        lock, [&] { return race->decided || race->finished == cancellations.size(); });
+    race->decided = true;
+    ConnectResult result = std::move(race->result);
+    lock.unlock();
+
+    // The winner has unregistered its abort function already, this only hits pending attempts
+    for (const auto &cancellation : cancellations) {
+        cancellation->Cancel();
+    }
+    return result;
+}
+
+#if !defined APD_OS_WIN && !defined __linux__
+const std::vector<ConnectMethod> &GetConnectMethods()
+{
+    // No Bluetooth backend on this platform, only external transports can be used
+    static const std::vector<ConnectMethod> methods;
+    return methods;
+}
+#endif
+
+} // namespace Core::AAP
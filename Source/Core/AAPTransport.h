@@ -0,0 +1,259 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <span>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <functional>
+#include <string_view>
+#include <condition_variable>
+
+#include "../Helper.h"
+
+namespace Core::AAP {
+
+//////////////////////////////////////////////////
+// Transport - A packet-oriented, wakeable link to the AirPods
+//
+
+enum class ReceiveStatus : uint32_t {
+    Data,    // A packet has been received into the buffer
+    Timeout, // The timeout expired before anything happened
+    Woken,   // Wake() was called
+    Closed,  // The remote closed the connection
+    Error,
+};
+
+struct ReceiveResult {
+    ReceiveStatus status;
+    size_t size{0};
+};
+
+class Transport : Helper::NonCopyable
+{
+public:
+    virtual inline ~Transport() {}
+
+    virtual bool Send(std::span<const uint8_t> packet) = 0;
+
+    // Blocks until a packet is received, the timeout expires, `Wake()` is called from another
+    // thread or the connection is closed. Without a timeout it waits indefinitely.
+    //
+    virtual ReceiveResult Receive(
+        std::span<uint8_t> buffer,
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt) = 0;
+
+    // Interrupts a blocking `Receive()`. If no one is receiving, the next `Receive()` returns
+    // `Woken` immediately.
+    //
+    virtual void Wake() = 0;
+
+    // Closing must not race with a blocking `Receive()`, wake and join the receiving thread first.
+    //
+    virtual void Close() = 0;
+};
+
+//////////////////////////////////////////////////
+// SocketTransport - Transport over a connected socket
+//
+// Receiving blocks on both the socket and a wake handle (a WSA event on Windows, an eventfd or a
+// pipe elsewhere), so shutting down the reader is immediate instead of polling a stop flag.
+// Any connected datagram or stream socket works, e.g. an L2CAP socket or one end of a
+// `socketpair()` standing in for it.
+//
+
+class SocketTransport final : public Transport
+{
+public:
+#if defined APD_OS_WIN
+    using NativeSocket = uintptr_t; // SOCKET
+#else
+    using NativeSocket = int;
+#endif
+
+    explicit SocketTransport(NativeSocket socket);
+    ~SocketTransport() override;
+
+    bool Send(std::span<const uint8_t> packet) override;
+    ReceiveResult Receive(
+        std::span<uint8_t> buffer,
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt) override;
+    void Wake() override;
+    void Close() override;
+
+private:
+    std::atomic<NativeSocket> _socket;
+
+#if defined APD_OS_WIN
+    void *_socketEvent{nullptr}; // WSAEVENT
+    void *_wakeEvent{nullptr};   // WSAEVENT
+#else
+    int _wakeReadFd{-1};
+    int _wakeWriteFd{-1};
+
+    void DrainWake();
+#endif
+};
+
+//////////////////////////////////////////////////
+// PacketQueue - Packets handed over between threads
+//
+// For transports whose data does not come from a waitable handle, e.g. delivered by a driver
+// callback or sent by an in-process peer. Packet buffers are recycled, so a steady stream of
+// packets does not allocate once the queue has warmed up.
+//
+
+class PacketQueue : Helper::NonCopyable
+{
+public:
+    // Buffers kept for reuse. Some are allocated up front, so neither end allocates for packets
+    // of up to `kBufferSize` bytes, not even before the queue has warmed up.
+    static constexpr size_t kMaxFreeBuffers = 64;
+    static constexpr size_t kPreallocatedBuffers = 16;
+    static constexpr size_t kBufferSize = 256;
+
+    PacketQueue();
+
+    // Returns false if the queue has been closed
+    bool Push(std::span<const uint8_t> packet);
+
+    // Same semantics as `Transport::Receive()`. Queued packets are still delivered after closing,
+    // `Closed` is returned once they are drained. A packet larger than the buffer is truncated.
+    //
+    ReceiveResult Pop(
+        std::span<uint8_t> buffer, std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+    void Wake();
+    void Close();
+    bool IsClosed() const;
+
+private:
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<std::vector<uint8_t>> _packets;
+    std::vector<std::vector<uint8_t>> _freeBuffers;
+    bool _woken{false};
+    bool _closed{false};
+};
+
+//////////////////////////////////////////////////
+// LoopbackTransport - In-memory transport pair
+//
+// What is sent on one end is received on the other. Lets the whole manager run against a
+// simulated peer without any Bluetooth hardware.
+//
+
+class LoopbackTransport final : public Transport
+{
+public:
+    static std::pair<std::unique_ptr<LoopbackTransport>, std::unique_ptr<LoopbackTransport>>
+    CreatePair();
+
+    LoopbackTransport(std::shared_ptr<PacketQueue> incoming, std::shared_ptr<PacketQueue> outgoing);
+    ~LoopbackTransport() override;
+
+    bool Send(std::span<const uint8_t> packet) override;
+    ReceiveResult Receive(
+        std::span<uint8_t> buffer,
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt) override;
+    void Wake() override;
+    void Close() override;
+
+private:
+    std::shared_ptr<PacketQueue> _incoming;
+    std::shared_ptr<PacketQueue> _outgoing;
+};
+
+//////////////////////////////////////////////////
+// Connect methods - Platform backends establishing a transport to a device
+//
+
+enum class Backend : uint32_t {
+    Winsock,  // Windows L2CAP or RFCOMM socket
+    MagicAAP, // Windows MagicAAP driver
+    BlueZ,    // Linux L2CAP socket
+    External, // Transport handed to `Manager::Connect()` by the caller, e.g. a loopback
+};
+
+// Lets a connect attempt that lost the race be abandoned while it's still blocking
+//
+class ConnectCancellation : Helper::NonCopyable
+{
+public:
+    bool IsCancelled() const;
+
+    // Registers how to wake the attempt out of its wait, e.g. by signaling an event it waits on
+    // besides the socket. It is invoked from the cancelling thread, so it must not release
+    // anything the attempt still uses. Returns false without registering if the attempt has
+    // already been cancelled.
+    //
+    bool SetAbort(std::function<void()> abort);
+
+    // Unregisters the abort function once the wait has returned. Returns false if it has been
+    // cancelled in the meantime, the attempt has to give up then. Waits for an abort function
+    // that is still running, so what it uses can be released right after.
+    //
+    bool ClearAbort();
+
+    void Cancel();
+
+private:
+    mutable std::mutex _mutex;
+    std::condition_variable _abortedConVar;
+    bool _cancelled{false};
+    bool _aborting{false};
+    std::function<void()> _abort;
+};
+
+struct ConnectMethod {
+    using FnConnectT = std::function<std::unique_ptr<Transport>(
+        uint64_t deviceAddress, ConnectCancellation &cancellation)>;
+
+    std::string_view name;
+    Backend backend;
+    FnConnectT connect;
+};
+
+// Connect methods available on this platform, in order of preference.
+// Defined by the platform backend (`AAPTransport_win.cpp`, `AAPTransport_linux.cpp`).
+//
+const std::vector<ConnectMethod> &GetConnectMethods();
+
+struct ConnectResult {
+    std::unique_ptr<Transport> transport;
+    const ConnectMethod *method{nullptr};
+};
+
+// Races the connect methods in the given order ("happy eyeballs"). The next method is started
+// as soon as all started ones have failed, or once `stagger` has passed without a result. The
+// first one to succeed wins, those still pending are cancelled and closed if they succeed later.
+//
+ConnectResult RaceConnect(
+    std::span<const ConnectMethod *const> methods, uint64_t deviceAddress,
+    std::chrono::milliseconds stagger);
+
+} // namespace Core::AAP
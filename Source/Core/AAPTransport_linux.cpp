@@ -0,0 +1,143 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "AAPTransport.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "AAP.h"
+#include "../Logger.h"
+
+// Only the BlueZ headers are needed, nothing is linked from libbluetooth
+#if __has_include(<bluetooth/bluetooth.h>) && __has_include(<bluetooth/l2cap.h>)
+    #define APD_HAS_BLUEZ 1
+    #include <bluetooth/bluetooth.h>
+    #include <bluetooth/l2cap.h>
+#endif
+
+namespace Core::AAP {
+
+#if defined APD_HAS_BLUEZ
+namespace {
+
+// Waits for a non-blocking `connect()` to finish, returns its error or `ECANCELED` if `wakeFd`
+// was signaled first
+int WaitForConnect(int sock, int wakeFd)
+{
+    while (true) {
+        pollfd fds[] = {{wakeFd, POLLIN, 0}, {sock, POLLOUT, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (fds[0].revents & POLLIN) {
+            return ECANCELED;
+        }
+        if (fds[1].revents != 0) {
+            int error = 0;
+            socklen_t size = sizeof(error);
+            if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &size) != 0) {
+                return errno;
+            }
+            return error;
+        }
+    }
+}
+
+std::unique_ptr<Transport> ConnectBlueZ(uint64_t deviceAddress, ConnectCancellation &cancellation)
+{
+    int sock = socket(AF_BLUETOOTH, SOCK_SEQPACKET | SOCK_CLOEXEC, BTPROTO_L2CAP);
+    if (sock == -1) {
+        LOG(Warn, "AAP: Failed to create L2CAP socket: {}", errno);
+        return nullptr;
+    }
+
+    sockaddr_l2 addr{};
+    addr.l2_family = AF_BLUETOOTH;
+    addr.l2_psm = htobs(kPSM);
+    // `bdaddr_t` is stored little-endian, the same order as the 48-bit integer
+    for (size_t i = 0; i < sizeof(addr.l2_bdaddr.b); ++i) {
+        addr.l2_bdaddr.b[i] = static_cast<uint8_t>(deviceAddress >> (i * 8));
+    }
+
+    // `connect()` doesn't block, the attempt waits on the socket and on `wakeFd`. A cancelled
+    // attempt is woken through the latter and closes the socket itself, so the descriptor is never
+    // closed under a thread still using it.
+    const int wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd == -1) {
+        LOG(Warn, "AAP: eventfd failed: {}", errno);
+        close(sock);
+        return nullptr;
+    }
+    const int flags = fcntl(sock, F_GETFL);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    if (!cancellation.SetAbort([wakeFd] {
+            const uint64_t value = 1;
+            [[maybe_unused]] auto written = write(wakeFd, &value, sizeof(value));
+        }))
+    {
+        close(wakeFd);
+        close(sock);
+        return nullptr;
+    }
+
+    int error = 0;
+    if (connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        error = errno == EINPROGRESS ? WaitForConnect(sock, wakeFd) : errno;
+    }
+
+    const bool cancelled = !cancellation.ClearAbort();
+    close(wakeFd);
+
+    if (cancelled || error != 0) {
+        if (!cancelled) {
+            LOG(Warn, "AAP: L2CAP connect failed: {}", error);
+        }
+        // Also aborts a connection still being set up
+        shutdown(sock, SHUT_RDWR);
+        close(sock);
+        return nullptr;
+    }
+
+    // `SocketTransport` sends blocking
+    fcntl(sock, F_SETFL, flags);
+    return std::make_unique<SocketTransport>(sock);
+}
+
+} // namespace
+#endif
+
+const std::vector<ConnectMethod> &GetConnectMethods()
+{
+    static const std::vector<ConnectMethod> methods{
+#if defined APD_HAS_BLUEZ
+        {"L2CAP SEQPACKET", Backend::BlueZ, ConnectBlueZ},
+#endif
+    };
+    return methods;
+}
+
+} // namespace Core::AAP
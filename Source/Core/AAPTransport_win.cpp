@@ -0,0 +1,277 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "AAPTransport.h"
+
+#include <WinSock2.h>
+#include <ws2bth.h>
+#include <BluetoothAPIs.h>
+#include <initguid.h>
+
+#include "AAP.h"
+#include "MagicAAPWinRT.h"
+#include "../Logger.h"
+
+#pragma comment(lib, "Ws2_32.lib")
+#pragma comment(lib, "Bthprops.lib")
+
+// AAP Service UUID: 74ec2172-0bad-4d01-8f77-997b2be0722a
+// {74EC2172-0BAD-4D01-8F77-997B2BE0722A}
+DEFINE_GUID(AAP_SERVICE_UUID,
+    0x74ec2172, 0x0bad, 0x4d01, 0x8f, 0x77, 0x99, 0x7b, 0x2b, 0xe0, 0x72, 0x2a);
+
+namespace Core::AAP {
+
+namespace {
+
+bool InitializeWinsock()
+{
+    // Initialized once and kept for the lifetime of the process
+    static const bool initialized = [] {
+        WSADATA wsaData;
+        int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
+        if (result != 0) {
+            LOG(Error, "WSAStartup failed: {}", result);
+            return false;
+        }
+        return true;
+    }();
+    return initialized;
+}
+
+std::unique_ptr<Transport> ConnectWinsock(
+    uint64_t deviceAddress, ConnectCancellation &cancellation, int type, int protocol)
+{
+    if (!InitializeWinsock()) {
+        return nullptr;
+    }
+
+    SOCKET sock = socket(AF_BTH, type, protocol);
+    if (sock == INVALID_SOCKET) {
+        LOG(Warn, "AAP: Failed to create socket: {}", WSAGetLastError());
+        return nullptr;
+    }
+
+    SOCKADDR_BTH addr{};
+    addr.addressFamily = AF_BTH;
+    addr.btAddr = deviceAddress;
+    if (protocol == BTHPROTO_RFCOMM) {
+        addr.serviceClassId = AAP_SERVICE_UUID;
+        addr.port = BT_PORT_ANY;
+    }
+    else {
+        addr.port = kPSM;
+    }
+
+    // `connect()` doesn't block, the attempt waits on the connect event and on `wakeEvent`. A
+    // cancelled attempt is woken through the latter and closes the socket itself, so the socket
+    // is never closed under a thread still using it.
+    const WSAEVENT connectEvent = WSACreateEvent();
+    const WSAEVENT wakeEvent = WSACreateEvent();
+    const auto closeEvents = [&] {
+        for (WSAEVENT event : {connectEvent, wakeEvent}) {
+            if (event != WSA_INVALID_EVENT) {
+                WSACloseEvent(event);
+            }
+        }
+    };
+    if (connectEvent == WSA_INVALID_EVENT || wakeEvent == WSA_INVALID_EVENT) {
+        LOG(Warn, "AAP: WSACreateEvent failed: {}", WSAGetLastError());
+        closeEvents();
+        closesocket(sock);
+        return nullptr;
+    }
+
+    // Also puts the socket into non-blocking mode
+    if (WSAEventSelect(sock, connectEvent, FD_CONNECT) == SOCKET_ERROR ||
+        !cancellation.SetAbort([wakeEvent] { WSASetEvent(wakeEvent); }))
+    {
+        closeEvents();
+        closesocket(sock);
+        return nullptr;
+    }
+
+    int error = 0;
+    if (connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == SOCKET_ERROR) {
+        error = WSAGetLastError();
+        if (error == WSAEWOULDBLOCK) {
+            const WSAEVENT events[] = {connectEvent, wakeEvent};
+            const DWORD waited = WSAWaitForMultipleEvents(2, events, FALSE, WSA_INFINITE, FALSE);
+            WSANETWORKEVENTS networkEvents{};
+            if (waited != WSA_WAIT_EVENT_0) {
+                error = WSAECANCELLED;
+            }
+            else if (WSAEnumNetworkEvents(sock, connectEvent, &networkEvents) == SOCKET_ERROR) {
+                error = WSAGetLastError();
+            }
+            else {
+                error = networkEvents.iErrorCode[FD_CONNECT_BIT];
+            }
+        }
+    }
+
+    const bool cancelled = !cancellation.ClearAbort();
+    // `SocketTransport` selects its own events
+    WSAEventSelect(sock, nullptr, 0);
+    closeEvents();
+
+    if (cancelled || error != 0) {
+        if (!cancelled) {
+            LOG(Warn, "AAP: Socket connect failed: {}", error);
+        }
+        closesocket(sock);
+        return nullptr;
+    }
+
+    return std::make_unique<SocketTransport>(sock);
+}
+
+//////////////////////////////////////////////////
+// MagicAAPTransport - Transport over the MagicAAP driver client
+//
+// The client delivers data from its own receiver thread through a callback, which is queued
+// here and picked up by `Receive()`.
+//
+
+class MagicAAPTransport final : public Transport
+{
+public:
+    MagicAAPTransport(
+        std::unique_ptr<MagicAAPWinRT::MagicAAPWinRTClient> client,
+        std::shared_ptr<PacketQueue> queue)
+        : _client{std::move(client)}, _queue{std::move(queue)}
+    {
+    }
+
+    ~MagicAAPTransport() override
+    {
+        Close();
+    }
+
+    bool Send(std::span<const uint8_t> packet) override
+    {
+        return _client->SendData(packet);
+    }
+
+    ReceiveResult Receive(
+        std::span<uint8_t> buffer,
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt) override
+    {
+        return _queue->Pop(buffer, timeout);
+    }
+
+    void Wake() override
+    {
+        _queue->Wake();
+    }
+
+    void Close() override
+    {
+        _queue->Close();
+        _client->Disconnect();
+    }
+
+private:
+    std::unique_ptr<MagicAAPWinRT::MagicAAPWinRTClient> _client;
+    std::shared_ptr<PacketQueue> _queue;
+};
+
+// How the MagicAAP client reaches the device, raced against each other as separate methods
+enum class MagicAAPRoute : uint32_t {
+    DeviceInterface, // Direct file I/O on the driver's device interface
+    WinRT,           // WinRT RFCOMM
+};
+
+std::unique_ptr<Transport>
+ConnectMagicAAP(uint64_t deviceAddress, ConnectCancellation &cancellation, MagicAAPRoute route)
+{
+    using MagicAAPWinRT::MagicAAPWinRTClient;
+
+    if (!MagicAAPWinRTClient::IsDriverInstalled()) {
+        LOG(Info, "AAP: MagicAAP driver not installed");
+        return nullptr;
+    }
+
+    if (!MagicAAPWinRTClient::IsDriverRunning()) {
+        LOG(Warn, "AAP: MagicAAP driver installed but not running");
+        return nullptr;
+    }
+
+    auto client = std::make_unique<MagicAAPWinRTClient>();
+    auto queue = std::make_shared<PacketQueue>();
+
+    client->SetOnDataReceived([queue](std::span<const uint8_t> data) { queue->Push(data); });
+    client->SetOnDisconnected([queue]() {
+        LOG(Info, "AAP: MagicAAP connection lost");
+        queue->Close();
+    });
+
+    if (route == MagicAAPRoute::DeviceInterface) {
+        if (!client->ConnectViaDeviceInterface(deviceAddress)) {
+            LOG(Warn, "AAP: MagicAAP device interface connection failed");
+            return nullptr;
+        }
+    }
+    else if (!client->Connect(deviceAddress)) {
+        std::wstring errorW = client->GetLastError();
+        std::string error(errorW.begin(), errorW.end());
+        LOG(Warn, "AAP: MagicAAP WinRT connection failed: {}", error);
+        return nullptr;
+    }
+
+    // The client can't be interrupted while connecting, so a lost race is only noticed here
+    if (cancellation.IsCancelled()) {
+        return nullptr;
+    }
+
+    return std::make_unique<MagicAAPTransport>(std::move(client), std::move(queue));
+}
+
+} // namespace
+
+const std::vector<ConnectMethod> &GetConnectMethods()
+{
+    static const std::vector<ConnectMethod> methods{
+        // L2CAP with SOCK_SEQPACKET (datagram-oriented, more native for L2CAP)
+        {"L2CAP SEQPACKET", Backend::Winsock,
+         [](uint64_t address, ConnectCancellation &cancellation) {
+             return ConnectWinsock(address, cancellation, SOCK_SEQPACKET, BTHPROTO_L2CAP);
+         }},
+        {"L2CAP STREAM", Backend::Winsock,
+         [](uint64_t address, ConnectCancellation &cancellation) {
+             return ConnectWinsock(address, cancellation, SOCK_STREAM, BTHPROTO_L2CAP);
+         }},
+        // RFCOMM with service UUID
+        {"RFCOMM", Backend::Winsock,
+         [](uint64_t address, ConnectCancellation &cancellation) {
+             return ConnectWinsock(address, cancellation, SOCK_STREAM, BTHPROTO_RFCOMM);
+         }},
+        // Require MagicAAP driver
+        {"MagicAAP Device Interface", Backend::MagicAAP,
+         [](uint64_t address, ConnectCancellation &cancellation) {
+             return ConnectMagicAAP(address, cancellation, MagicAAPRoute::DeviceInterface);
+         }},
+        {"MagicAAP WinRT", Backend::MagicAAP,
+         [](uint64_t address, ConnectCancellation &cancellation) {
+             return ConnectMagicAAP(address, cancellation, MagicAAPRoute::WinRT);
+         }},
+    };
+    return methods;
+}
+
+} // namespace Core::AAP
@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cmath>
 #include <chrono>
 #include <mutex>
 #include <string>
@@ -106,30 +107,27 @@ namespace Details {
 // Advertisement
 //
 
-bool Advertisement::IsDesiredAdv(const Bluetooth::AdvertisementWatcher::ReceivedData &data)
+std::optional<Advertisement>
+Advertisement::Parse(const Bluetooth::AdvertisementWatcher::ReceivedData &data)
 {
-    auto iter = data.manufacturerDataMap.find(AppleCP::VendorId);
-    if (iter == data.manufacturerDataMap.end()) {
-        return false;
+    const auto manufacturerData = data.manufacturerData.Find(AppleCP::VendorId);
+    if (!manufacturerData.has_value()) {
+        return std::nullopt;
     }
 
-    const auto &manufacturerData = (*iter).second;
-    if (!AppleCP::AirPods::IsValid(manufacturerData)) {
-        return false;
+    auto protocol = AppleCP::AirPods::Parse(manufacturerData.value());
+    if (!protocol.has_value()) {
+        return std::nullopt;
     }
 
-    return true;
+    return Advertisement{data, std::move(protocol.value())};
 }
 
-Advertisement::Advertisement(const Bluetooth::AdvertisementWatcher::ReceivedData &data)
+Advertisement::Advertisement(
+    const Bluetooth::AdvertisementWatcher::ReceivedData &data, AppleCP::AirPods protocol)
+    : _rssi{data.rssi}, _timestamp{data.timestamp}, _address{data.address},
+      _protocol{std::move(protocol)}
 {
-    APD_ASSERT(IsDesiredAdv(data));
-    _data = data;
-
-    auto protocol = AppleCP::As<AppleCP::AirPods>(GetMfrData());
-    APD_ASSERT(protocol.has_value());
-    _protocol = std::move(protocol.value());
-
     // Store state
     //
 
@@ -163,26 +161,23 @@ Advertisement::Advertisement(const Bluetooth::AdvertisementWatcher::ReceivedData
 
 int16_t Advertisement::GetRssi() const
 {
-    return _data.rssi;
+    return _rssi;
 }
 
-const auto &Advertisement::GetTimestamp() const
+auto Advertisement::GetTimestamp() const -> const TimestampType &
 {
-    return _data.timestamp;
+    return _timestamp;
 }
 
 auto Advertisement::GetAddress() const -> AddressType
 {
-    return _data.address;
+    return _address;
 }
 
 std::vector<uint8_t> Advertisement::GetDesensitizedData() const
 {
-    auto desensitizedData = _protocol.Desensitize();
-
-    std::vector<uint8_t> result(sizeof(desensitizedData), 0);
-    std::memcpy(result.data(), &desensitizedData, sizeof(desensitizedData));
-    return result;
+    const auto desensitizedData = _protocol.Desensitize();
+    return {desensitizedData.begin(), desensitizedData.end()};
 }
 
 auto Advertisement::GetAdvState() const -> const AdvState &
@@ -190,12 +185,261 @@ auto Advertisement::GetAdvState() const -> const AdvState &
     return _state;
 }
 
-const std::vector<uint8_t> &Advertisement::GetMfrData() const
+//
+// CandidateTable
+//
+
+namespace {
+
+// Candidates not heard of for this long are gone
+constexpr auto kCandidateTimeout = 10s;
+// A bound candidate this quiet can be replaced by any other one
+constexpr auto kBoundQuietAfter = 3s;
+// Another candidate must be this much stronger to take over a bound one, so two devices at a
+// similar distance don't take turns
+constexpr float kRebindRssiMargin = 15.0f;
+// Two advertisements of the same device can't be further apart than this
+constexpr float kMaxRssiDiff = 50.0f;
+// Batteries are advertised in steps of 10%, one can't move more than a step between two
+// advertisements of the same device
+constexpr Battery::ValueType kMaxBatteryDiff = 10;
+constexpr float kBatteryMatchScore = 10.0f;
+
+} // namespace
+
+size_t CandidateTable::Update(Advertisement adv, Timestamp now)
+{
+    Prune(now);
+
+    const auto address = adv.GetAddress();
+
+    size_t index;
+    if (const auto iter = _indexByAddress.find(address); iter != _indexByAddress.end()) {
+        index = iter->second;
+    }
+    else if (const auto match = FindMatch(adv); match.has_value()) {
+        index = match.value();
+        LOG(Trace, "CandidateTable: New address attributed to candidate '{}'.",
+            _candidates[index]->id);
+    }
+    else {
+        index = Insert(adv);
+        LOG(Trace, "CandidateTable: New candidate '{}', {} nearby.", _candidates[index]->id,
+            Size());
+    }
+
+    auto &candidate = _candidates[index].value();
+    const auto &state = adv.GetAdvState();
+    const bool isLeft = state.side == Side::Left;
+
+    auto &sideAddress = isLeft ? candidate.address.left : candidate.address.right;
+    const auto &otherAddress = isLeft ? candidate.address.right : candidate.address.left;
+    if (sideAddress != address) {
+        if (sideAddress.has_value() && sideAddress != otherAddress) {
+            _indexByAddress.erase(sideAddress.value());
+        }
+        sideAddress = address;
+        _indexByAddress.insert_or_assign(address, index);
+    }
+
+    if (state.pods.left.battery.Available()) {
+        candidate.podsBattery.left = state.pods.left.battery;
+    }
+    if (state.pods.right.battery.Available()) {
+        candidate.podsBattery.right = state.pods.right.battery;
+    }
+    if (state.caseBox.battery.Available()) {
+        candidate.caseBattery = state.caseBox.battery;
+    }
+    (isLeft ? candidate.rssi.left : candidate.rssi.right).Update(adv.GetRssi(), now);
+    // Both sides are asked, so that each one keeps its hysteresis state
+    const bool leftInRange = candidate.rssi.left.PassesThreshold(_rssiMin);
+    const bool rightInRange = candidate.rssi.right.PassesThreshold(_rssiMin);
+    candidate.inRange = leftInRange || rightInRange;
+    candidate.lastSeen = now;
+
+    (isLeft ? candidate.adv.left : candidate.adv.right) = std::make_pair(std::move(adv), now);
+    return index;
+}
+
+bool CandidateTable::Rebind(std::optional<Model> expectedModel, Timestamp now)
+{
+    // New models are advertised as unknown, they may still be ours
+    const auto isEligible = [&](const Candidate &candidate) {
+        return candidate.inRange &&
+               (!expectedModel.has_value() || candidate.model == expectedModel.value() ||
+                candidate.model == Model::Unknown);
+    };
+
+    std::optional<size_t> best;
+    for (size_t i = 0; i < _candidates.size(); ++i) {
+        if (_candidates[i].has_value() && isEligible(_candidates[i].value()) &&
+            (!best.has_value() ||
+             _candidates[i]->GetRssi() > _candidates[best.value()]->GetRssi()))
+        {
+            best = i;
+        }
+    }
+
+    if (best == _bound) {
+        return false;
+    }
+
+    if (_bound.has_value() && best.has_value()) {
+        const auto &bound = _candidates[_bound.value()].value();
+        if (isEligible(bound) && now - bound.lastSeen < kBoundQuietAfter &&
+            _candidates[best.value()]->GetRssi() < bound.GetRssi() + kRebindRssiMargin)
+        {
+            return false;
+        }
+    }
+
+    _bound = best;
+    return true;
+}
+
+std::optional<size_t> CandidateTable::GetBoundIndex() const
+{
+    return _bound;
+}
+
+auto CandidateTable::GetBound() const -> const Candidate *
+{
+    return _bound.has_value() ? &_candidates[_bound.value()].value() : nullptr;
+}
+
+auto CandidateTable::GetBound() -> Candidate *
+{
+    return _bound.has_value() ? &_candidates[_bound.value()].value() : nullptr;
+}
+
+size_t CandidateTable::Size() const
+{
+    return static_cast<size_t>(std::ranges::count_if(
+        _candidates, [](const auto &candidate) { return candidate.has_value(); }));
+}
+
+void CandidateTable::SetRssiMin(int16_t rssiMin)
+{
+    _rssiMin = rssiMin;
+}
+
+void CandidateTable::Clear()
+{
+    for (auto &candidate : _candidates) {
+        candidate.reset();
+    }
+    _indexByAddress.clear();
+    _bound.reset();
+}
+
+float CandidateTable::Candidate::GetRssi() const
+{
+    if (rssi.left.HasValue() && rssi.right.HasValue()) {
+        return std::max(rssi.left.Value(), rssi.right.Value());
+    }
+    return rssi.left.HasValue() ? rssi.left.Value() : rssi.right.Value();
+}
+
+std::optional<float>
+CandidateTable::MatchScore(const Candidate &candidate, const Advertisement &adv) const
+{
+    const auto &state = adv.GetAdvState();
+    if (candidate.model != state.model) {
+        return std::nullopt;
+    }
+
+    float score = 0;
+    const auto matchBattery = [&](const Battery &known, const Battery &current) {
+        if (!known.Available() || !current.Available()) {
+            return true;
+        }
+        const auto diff = known.Value() > current.Value() ? known.Value() - current.Value()
+                                                          : current.Value() - known.Value();
+        score += diff == 0 ? kBatteryMatchScore : kBatteryMatchScore / 2;
+        return diff <= kMaxBatteryDiff;
+    };
+    if (!matchBattery(candidate.podsBattery.left, state.pods.left.battery) ||
+        !matchBattery(candidate.podsBattery.right, state.pods.right.battery) ||
+        !matchBattery(candidate.caseBattery, state.caseBox.battery))
+    {
+        return std::nullopt;
+    }
+
+    const float rssiDiff = std::abs(static_cast<float>(adv.GetRssi()) - candidate.GetRssi());
+    if (rssiDiff > kMaxRssiDiff) {
+        return std::nullopt;
+    }
+    return score - rssiDiff;
+}
+
+std::optional<size_t> CandidateTable::FindMatch(const Advertisement &adv) const
+{
+    std::optional<size_t> best;
+    float bestScore = 0;
+    for (size_t i = 0; i < _candidates.size(); ++i) {
+        if (!_candidates[i].has_value()) {
+            continue;
+        }
+        const auto score = MatchScore(_candidates[i].value(), adv);
+        if (score.has_value() && (!best.has_value() || score.value() > bestScore)) {
+            best = i;
+            bestScore = score.value();
+        }
+    }
+    return best;
+}
+
+size_t CandidateTable::Insert(const Advertisement &adv)
+{
+    std::optional<size_t> index;
+    for (size_t i = 0; i < _candidates.size(); ++i) {
+        if (!_candidates[i].has_value()) {
+            index = i;
+            break;
+        }
+        // Full, evict the one seen least recently, but never the bound one
+        if (i != _bound && (!index.has_value() ||
+                            _candidates[i]->lastSeen < _candidates[index.value()]->lastSeen))
+        {
+            index = i;
+        }
+    }
+
+    if (_candidates[index.value()].has_value()) {
+        LOG(Trace, "CandidateTable: Full, evicting candidate '{}'.",
+            _candidates[index.value()]->id);
+        Remove(index.value());
+    }
+
+    auto &candidate = _candidates[index.value()].emplace();
+    candidate.id = _nextId++;
+    candidate.model = adv.GetAdvState().model;
+    return index.value();
+}
+
+void CandidateTable::Remove(size_t index)
 {
-    auto iter = _data.manufacturerDataMap.find(AppleCP::VendorId);
-    APD_ASSERT(iter != _data.manufacturerDataMap.end());
+    const auto &candidate = _candidates[index].value();
+    for (const auto &address : {candidate.address.left, candidate.address.right}) {
+        if (address.has_value()) {
+            _indexByAddress.erase(address.value());
+        }
+    }
+    _candidates[index].reset();
+
+    if (_bound == index) {
+        _bound.reset();
+    }
+}
 
-    return (*iter).second;
+void CandidateTable::Prune(Timestamp now)
+{
+    for (size_t i = 0; i < _candidates.size(); ++i) {
+        if (_candidates[i].has_value() && now - _candidates[i]->lastSeen > kCandidateTimeout) {
+            Remove(i);
+        }
+    }
 }
 
 //
@@ -230,12 +474,31 @@ auto StateManager::OnAdvReceived(Advertisement adv) -> std::optional<UpdateEvent
 {
     std::lock_guard<std::mutex> lock{_mutex};
 
-    if (!IsPossibleDesiredAdv(adv)) {
-        LOG(Warn, "This adv may not be broadcast from the device we desire.");
+    const auto now = Clock::now();
+    const auto side = adv.GetAdvState().side;
+    const size_t index = _candidates.Update(std::move(adv), now);
+
+    if (_candidates.Rebind(_expectedModel, now)) {
+        const auto *bound = _candidates.GetBound();
+        if (bound == nullptr) {
+            LOG(Info, "StateManager: No candidate to bind, {} nearby.", _candidates.Size());
+            return std::nullopt;
+        }
+        LOG(Info, "StateManager: Bound candidate '{}', model: '{}', rssi: '{}', {} nearby.",
+            bound->id, Helper::ToString(bound->model), bound->GetRssi(), _candidates.Size());
+
+        _lostTimer.Reset();
+        _stateResetTimer.left.Reset();
+        _stateResetTimer.right.Reset();
+        return UpdateState();
+    }
+
+    if (_candidates.GetBoundIndex() != index) {
         return std::nullopt;
     }
 
-    UpdateAdv(std::move(adv));
+    _lostTimer.Reset();
+    (side == Side::Left ? _stateResetTimer.left : _stateResetTimer.right).Reset();
     return UpdateState();
 }
 
@@ -250,115 +513,31 @@ void StateManager::Disconnect()
 void StateManager::OnRssiMinChanged(int16_t rssiMin)
 {
     std::lock_guard<std::mutex> lock{_mutex};
-    _rssiMin = rssiMin;
+    _candidates.SetRssiMin(rssiMin);
 }
 
-bool StateManager::IsPossibleDesiredAdv(const Advertisement &adv) const
+void StateManager::SetExpectedModel(std::optional<Model> model)
 {
-    const auto advRssi = adv.GetRssi();
-    if (advRssi < _rssiMin) {
-        LOG(Warn,
-            "IsPossibleDesiredAdv returns false. Reason: RSSI is less than the limit. "
-            "curr: '{}' min: '{}'",
-            advRssi, _rssiMin);
-        return false;
-    }
-
-    const auto &advState = adv.GetAdvState();
-
-    auto &lastAdv = advState.side == Side::Left ? _adv.left : _adv.right;
-    auto &lastAnotherAdv = advState.side == Side::Left ? _adv.right : _adv.left;
-
-    // If the Random Non-resolvable Address of our devices is changed
-    // or the packet is sent from another device that it isn't ours
-    //
-    if (lastAdv.has_value() && lastAdv->first.GetAddress() != adv.GetAddress()) {
-        const auto &lastAdvState = lastAdv->first.GetAdvState();
-
-        if (advState.model != lastAdvState.model) {
-            LOG(Warn, "IsPossibleDesiredAdv returns false. Reason: model new='{}' old='{}'",
-                Helper::ToString(advState.model), Helper::ToString(lastAdvState.model));
-            return false;
-        }
-
-        Battery::ValueType leftBatteryDiff = 0, rightBatteryDiff = 0, caseBatteryDiff = 0;
-
-        using SignedBatteryValueT = std::make_signed_t<Battery::ValueType>;
-
-        if (advState.pods.left.battery.Available() && lastAdvState.pods.left.battery.Available()) {
-            leftBatteryDiff = std::abs(
-                static_cast<SignedBatteryValueT>(advState.pods.left.battery.Value()) -
-                static_cast<SignedBatteryValueT>(lastAdvState.pods.left.battery.Value()));
-        }
-        if (advState.pods.right.battery.Available() && lastAdvState.pods.right.battery.Available())
-        {
-            rightBatteryDiff = std::abs(
-                static_cast<SignedBatteryValueT>(advState.pods.right.battery.Value()) -
-                static_cast<SignedBatteryValueT>(lastAdvState.pods.right.battery.Value()));
-        }
-        if (advState.caseBox.battery.Available() && lastAdvState.caseBox.battery.Available()) {
-            caseBatteryDiff = std::abs(
-                static_cast<SignedBatteryValueT>(advState.caseBox.battery.Value()) -
-                static_cast<SignedBatteryValueT>(lastAdvState.caseBox.battery.Value()));
-        }
-
-        // The battery changes in steps of 1, so the data of two packets in a short time
-        // can not exceed 1, otherwise it is not our device
-        //
-        if (leftBatteryDiff > 1 || rightBatteryDiff > 1 || caseBatteryDiff > 1) {
-            LOG(Warn,
-                "IsPossibleDesiredAdv returns false. Reason: BatteryDiff l='{}' r='{}' c='{}'",
-                leftBatteryDiff, rightBatteryDiff, caseBatteryDiff);
-            return false;
-        }
-
-        int16_t rssiDiff = std::abs(advRssi - lastAdv->first.GetRssi());
-        if (rssiDiff > 50) {
-            LOG(Warn, "IsPossibleDesiredAdv returns false. Reason: Current side rssiDiff '{}'",
-                rssiDiff);
-            return false;
-        }
-
-        LOG(Warn, "Address changed, but it might still be the same device.");
-    }
-
-    if (lastAnotherAdv.has_value()) {
-        int16_t rssiDiff = std::abs(advRssi - lastAnotherAdv->first.GetRssi());
-        if (rssiDiff > 50) {
-            LOG(Warn, "IsPossibleDesiredAdv returns false. Reason: Another side rssiDiff '{}'",
-                rssiDiff);
-            return false;
-        }
-    }
-
-    return true;
+    std::lock_guard<std::mutex> lock{_mutex};
+    _expectedModel = model;
 }
 
-void StateManager::UpdateAdv(Advertisement adv)
+auto StateManager::UpdateState() -> std::optional<UpdateEvent>
 {
-    _lostTimer.Reset();
-
-    const auto &advState = adv.GetAdvState();
-
-    if (advState.side == Side::Left) {
-        _stateResetTimer.left.Reset();
-        _adv.left = std::make_pair(std::move(adv), Clock::now());
-    }
-    else if (advState.side == Side::Right) {
-        _stateResetTimer.right.Reset();
-        _adv.right = std::make_pair(std::move(adv), Clock::now());
+    const auto *bound = _candidates.GetBound();
+    if (bound == nullptr) {
+        return std::nullopt;
     }
-}
 
-auto StateManager::UpdateState() -> std::optional<UpdateEvent>
-{
     Helper::Sides<std::pair<Advertisement::AdvState, Timestamp>> cachedAdvState;
 
-    if (_adv.left.has_value()) {
-        cachedAdvState.left = std::make_pair(_adv.left->first.GetAdvState(), _adv.left->second);
+    if (bound->adv.left.has_value()) {
+        cachedAdvState.left =
+            std::make_pair(bound->adv.left->first.GetAdvState(), bound->adv.left->second);
     }
-    if (_adv.right.has_value()) {
-        cachedAdvState.right = std::make_pair(_adv.right->first.GetAdvState(), _adv.right->second);
+    if (bound->adv.right.has_value()) {
+        cachedAdvState.right =
+            std::make_pair(bound->adv.right->first.GetAdvState(), bound->adv.right->second);
     }
 
     State newState;
@@ -402,8 +581,7 @@ void StateManager::ResetAll()
         ApdApp->GetMainWindow()->DisconnectSafely();
     }
 
-    _adv.left.reset();
-    _adv.right.reset();
+    _candidates.Clear();
     _cachedState.reset();
 }
 
@@ -417,9 +595,20 @@ void StateManager::DoLost()
 
 void StateManager::DoStateReset(Side side)
 {
-    auto &adv = side == Side::Left ? _adv.left : _adv.right;
+    auto *bound = _candidates.GetBound();
+    if (bound == nullptr) {
+        return;
+    }
+
+    auto &adv = side == Side::Left ? bound->adv.left : bound->adv.right;
     if (adv.has_value()) {
-        LOG(Info, "StateManager: DoStateReset called. Side: {}", Helper::ToString(side));
+        const auto quality =
+            (side == Side::Left ? bound->rssi.left : bound->rssi.right).GetQuality();
+        LOG(Info,
+            "StateManager: DoStateReset called. Side: {}, rssi: '{}', deviation: '{}', "
+            "interval: '{}' ms, samples: '{}'",
+            Helper::ToString(side), quality.rssi, quality.deviation, quality.interval.count(),
+            quality.samples);
         adv.reset();
     }
 }
@@ -431,6 +620,10 @@ void StateManager::DoStateReset(Side side)
 
 Manager::Manager()
 {
+    _adWatcher.SetPrefilter([](uint16_t companyId, std::span<const uint8_t> data) {
+        return companyId == AppleCP::VendorId && AppleCP::AirPods::Matches(data);
+    });
+
     _adWatcher.CbReceived() += [this](auto &&...args) {
         std::lock_guard<std::mutex> lock{_mutex};
         OnAdvertisementReceived(std::forward<decltype(args)>(args)...);
@@ -476,10 +669,6 @@ void Manager::SetupAAPCallbacks()
         OnEarDetectionChanged(primary, secondary);
     };
     
-    callbacks.onHeadTrackingData = [this](AAP::HeadTrackingData data) {
-        OnHeadTrackingData(data);
-    };
-    
     callbacks.onConnected = [this]() {
         OnAAPConnected();
     };
@@ -529,6 +718,7 @@ void Manager::OnBoundDeviceAddressChanged(uint64_t address)
 
     _boundDevice.reset();
     _modelOverride.reset();
+    _stateMgr.SetExpectedModel(std::nullopt);
     _deviceConnected = false;
     _stateMgr.Disconnect();
     
@@ -561,6 +751,7 @@ void Manager::OnBoundDeviceAddressChanged(uint64_t address)
                 Helper::ToString(_modelOverride.value()));
         }
     }
+    _stateMgr.SetExpectedModel(_modelOverride);
 
     _deviceName = QString::fromStdString([&] {
         auto name = _boundDevice->GetName();
@@ -738,21 +929,20 @@ void Manager::OnBothInEar(bool isBothInEar)
 
 bool Manager::OnAdvertisementReceived(const Bluetooth::AdvertisementWatcher::ReceivedData &data)
 {
-    if (!Details::Advertisement::IsDesiredAdv(data)) {
+    auto adv = Details::Advertisement::Parse(data);
+    if (!adv.has_value()) {
         return false;
     }
 
-    Details::Advertisement adv{data};
-
     LOG(Trace, "AirPods advertisement received. Data: {}, Address Hash: {}, RSSI: {}",
-        Helper::ToString(adv.GetDesensitizedData()), Helper::Hash(data.address), data.rssi);
+        Helper::ToString(adv->GetDesensitizedData()), Helper::Hash(data.address), data.rssi);
 
     if (!_deviceConnected) {
         LOG(Info, "AirPods advertisement received, but device disconnected.");
         return false;
     }
 
-    auto optUpdateEvent = _stateMgr.OnAdvReceived(Details::Advertisement{data});
+    auto optUpdateEvent = _stateMgr.OnAdvReceived(std::move(adv.value()));
     if (optUpdateEvent.has_value()) {
         OnStateChanged(std::move(optUpdateEvent.value()));
     }
@@ -768,10 +958,14 @@ void Manager::OnAdvWatcherStateChanged(
         LOG(Info, "Bluetooth AdvWatcher started.");
         break;
 
-    case Core::Bluetooth::AdvertisementWatcher::State::Stopped:
+    case Core::Bluetooth::AdvertisementWatcher::State::Stopped: {
         ApdApp->GetMainWindow()->UnavailableSafely();
         LOG(Warn, "Bluetooth AdvWatcher stopped. Error: '{}'.", optError.value_or("nullopt"));
+
+        const auto stats = _adWatcher.GetPrefilterStats();
+        LOG(Info, "Adv prefilter accepted: {}, rejected: {}", stats.accepted, stats.rejected);
         break;
+    }
 
     default:
         FatalError("Unhandled adv watcher state: '{}'", Helper::ToUnderlying(state));
@@ -840,13 +1034,26 @@ bool Manager::IsAAPConnected() const
     return _aapMgr.IsConnected();
 }
 
+std::shared_ptr<const AAP::DeviceState> Manager::GetAAPState() const
+{
+    return _aapMgr.GetState();
+}
+
 bool Manager::StartHeadTracking()
 {
-    return _aapMgr.StartHeadTracking();
+    if (!_aapMgr.StartHeadTracking()) {
+        return false;
+    }
+    // The last stream's resting position means nothing for this one
+    _headOrientationFilter = {};
+    _headGestureDetector = {};
+    _headTrackingTimer.Start(100ms, [this] { PullHeadTrackingSamples(); });
+    return true;
 }
 
 bool Manager::StopHeadTracking()
 {
+    _headTrackingTimer.Stop();
     return _aapMgr.StopHeadTracking();
 }
 
@@ -969,13 +1176,30 @@ void Manager::OnEarDetectionChanged(AAP::EarStatus primary, AAP::EarStatus secon
     // Note: We don't auto-resume when put back in ear to avoid unexpected playback
 }
 
-void Manager::OnHeadTrackingData(AAP::HeadTrackingData data)
+void Manager::PullHeadTrackingSamples()
 {
-    // This callback receives real-time head tracking sensor data
-    // Can be used for spatial audio or other applications
-    LOG(Trace, "Head tracking: o1={}, o2={}, o3={}, hAccel={}, vAccel={}", 
-        data.orientation1, data.orientation2, data.orientation3,
-        data.horizontalAcceleration, data.verticalAcceleration);
+    // Real-time head tracking sensor data, can be used for spatial audio or other applications
+    std::array<AAP::HeadTrackingSample, 32> batch;
+    while (const size_t count = _aapMgr.PopHeadTrackingSamples(batch)) {
+        uint32_t dropped = 0;
+        for (size_t i = 0; i < count; ++i) {
+            dropped += batch[i].dropped;
+
+            // Samples carry their receive time, filtering them in batches is the same as one by one
+            _headOrientationFilter.Update(batch[i]);
+            const auto gesture = _headGestureDetector.Update(_headOrientationFilter.Current());
+            if (gesture.has_value()) {
+                LOG(Info, "Head gesture: {}", gesture == AAP::HeadGesture::Nod ? "nod" : "shake");
+            }
+        }
+
+        const auto &data = batch[count - 1].data;
+        LOG(Trace,
+            "Head tracking: {} samples ({} dropped), last o1={}, o2={}, o3={}, hAccel={}, "
+            "vAccel={}",
+            count, dropped, data.orientation1, data.orientation2, data.orientation3,
+            data.horizontalAcceleration, data.verticalAcceleration);
+    }
 }
 
 // Volume levels for conversational awareness
@@ -1035,6 +1259,7 @@ void Manager::OnAAPConnected()
 void Manager::OnAAPDisconnected()
 {
     LOG(Info, "AAP connection lost - ANC features unavailable");
+    _headTrackingTimer.Stop();
 }
 
 std::vector<Bluetooth::Device> GetDevices()
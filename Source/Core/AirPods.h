@@ -18,13 +18,16 @@
 
 #pragma once
 
+#include <array>
 #include <optional>
 #include <functional>
+#include <unordered_map>
 
 #include "Bluetooth.h"
 #include "AppleCP.h"
 #include "AAP.h"
 #include "AAPManager.h"
+#include "RssiFilter.h"
 
 namespace Core::AirPods {
 
@@ -93,27 +96,96 @@ public:
         Side side;
     };
 
-    static bool IsDesiredAdv(const Bluetooth::AdvertisementWatcher::ReceivedData &data);
+    using TimestampType = decltype(Bluetooth::AdvertisementWatcher::ReceivedData::timestamp);
 
-    Advertisement(const Bluetooth::AdvertisementWatcher::ReceivedData &data);
+    // Looks up the Apple manufacturer data and decodes it once, returns nullopt if it isn't an
+    // AirPods advertisement
+    static std::optional<Advertisement>
+    Parse(const Bluetooth::AdvertisementWatcher::ReceivedData &data);
 
     int16_t GetRssi() const;
-    const auto &GetTimestamp() const;
+    const TimestampType &GetTimestamp() const;
     AddressType GetAddress() const;
     std::vector<uint8_t> GetDesensitizedData() const;
     const AdvState &GetAdvState() const;
 
 private:
-    Bluetooth::AdvertisementWatcher::ReceivedData _data;
+    Advertisement(
+        const Bluetooth::AdvertisementWatcher::ReceivedData &data, AppleCP::AirPods protocol);
+
+    int16_t _rssi;
+    TimestampType _timestamp;
+    AddressType _address;
     AppleCP::AirPods _protocol;
     AdvState _state;
+};
+
+// Nearby AirPods, one candidate per device. An advertisement from a known address goes straight
+// to its candidate. An unknown address is either a candidate that changed its address or another
+// device, it goes to the candidate whose model, batteries and signal strength match it best, or
+// starts a new one. Bounded, the candidate seen least recently is evicted.
+//
+class CandidateTable
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Timestamp = std::chrono::time_point<Clock>;
+
+    static constexpr size_t kMaxCandidates = 8;
+
+    struct Candidate {
+        // Unique for the lifetime of the table, for logs
+        uint32_t id{0};
+        Model model{Model::Unknown};
+        Helper::Sides<std::optional<std::pair<Advertisement, Timestamp>>> adv;
+        Helper::Sides<std::optional<Advertisement::AddressType>> address;
+        // The last known levels, whichever side reported them
+        Helper::Sides<Battery> podsBattery;
+        Battery caseBattery;
+        Helper::Sides<RssiFilter> rssi;
+        // Whether the signal passes the RSSI limit, with hysteresis
+        bool inRange{false};
+        Timestamp lastSeen;
+
+        // The stronger side, smoothed, dBm
+        float GetRssi() const;
+    };
+
+    // Returns the index of the candidate the advertisement is attributed to
+    size_t Update(Advertisement adv, Timestamp now);
 
-    const std::vector<uint8_t> &GetMfrData() const;
+    // Binds the most likely candidate: in range, of the expected model if known, with the
+    // strongest signal. A bound candidate is kept until it goes quiet or out of range, or another
+    // one is clearly stronger. Returns true if the binding changed.
+    bool Rebind(std::optional<Model> expectedModel, Timestamp now);
+
+    std::optional<size_t> GetBoundIndex() const;
+    const Candidate *GetBound() const;
+    Candidate *GetBound();
+
+    size_t Size() const;
+    void Clear();
+
+    // Candidates whose smoothed RSSI is below are never bound
+    void SetRssiMin(int16_t rssiMin);
+
+private:
+    std::array<std::optional<Candidate>, kMaxCandidates> _candidates;
+    std::unordered_map<Advertisement::AddressType, size_t> _indexByAddress;
+    std::optional<size_t> _bound;
+    uint32_t _nextId{1};
+    int16_t _rssiMin{std::numeric_limits<int16_t>::max()};
+
+    std::optional<float> MatchScore(const Candidate &candidate, const Advertisement &adv) const;
+    std::optional<size_t> FindMatch(const Advertisement &adv) const;
+    size_t Insert(const Advertisement &adv);
+    void Remove(size_t index);
+    void Prune(Timestamp now);
 };
 
 // AirPods use Random Non-resolvable device addresses for privacy reasons. This means we
-// can't "Remember" the user's AirPods by any device property. Here we track our desired
-// devices in some non-elegant ways, but obviously it is sometimes unreliable.
+// can't "Remember" the user's AirPods by any device property. Here we track the devices nearby
+// and bind the one most likely to be ours by some heuristics, which is sometimes unreliable.
 //
 class StateManager
 {
@@ -131,21 +203,21 @@ public:
     void Disconnect();
 
     void OnRssiMinChanged(int16_t rssiMin);
+    // The model of the paired device, if known only candidates of it are bound
+    void SetExpectedModel(std::optional<Model> model);
 
 private:
-    using Clock = std::chrono::steady_clock;
-    using Timestamp = std::chrono::time_point<Clock>;
+    using Clock = CandidateTable::Clock;
+    using Timestamp = CandidateTable::Timestamp;
 
     mutable std::mutex _mutex;
 
     Helper::Timer _lostTimer;
     Helper::Sides<Helper::Timer> _stateResetTimer;
-    Helper::Sides<std::optional<std::pair<Advertisement, Timestamp>>> _adv;
+    CandidateTable _candidates;
     std::optional<State> _cachedState;
-    int16_t _rssiMin{std::numeric_limits<int16_t>::max()};
+    std::optional<Model> _expectedModel;
 
-    bool IsPossibleDesiredAdv(const Advertisement &adv) const;
-    void UpdateAdv(Advertisement adv);
     std::optional<UpdateEvent> UpdateState();
     void ResetAll();
 
@@ -185,6 +257,7 @@ public:
     std::optional<uint8_t> GetAdaptiveTransparencyLevel() const;
     bool SetAdaptiveNoiseLevel(uint8_t level);
     bool IsAAPConnected() const;
+    std::shared_ptr<const AAP::DeviceState> GetAAPState() const;
 
     // Head tracking
     bool StartHeadTracking();
@@ -212,6 +285,11 @@ private:
     
     // AAP Manager for L2CAP protocol communication
     AAP::Manager _aapMgr;
+    // Pulls head tracking samples while the stream is active
+    Helper::Timer _headTrackingTimer;
+    // Fed with the pulled samples, only touched by the timer
+    AAP::HeadOrientationFilter _headOrientationFilter;
+    AAP::HeadGestureDetector _headGestureDetector;
 
     void OnBoundDeviceConnectionStateChanged(Bluetooth::DeviceState state);
     void OnStateChanged(Details::StateManager::UpdateEvent updateEvent);
@@ -229,7 +307,7 @@ private:
     void OnAdaptiveTransparencyLevelNotification(uint8_t level);
     void OnSpeakingLevelChanged(AAP::SpeakingLevel level);
     void OnEarDetectionChanged(AAP::EarStatus primary, AAP::EarStatus secondary);
-    void OnHeadTrackingData(AAP::HeadTrackingData data);
+    void PullHeadTrackingSamples();
     void OnAAPConnected();
     void OnAAPDisconnected();
     void SetupAAPCallbacks();
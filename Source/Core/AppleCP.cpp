@@ -18,25 +18,50 @@
 
 #include "AppleCP.h"
 
+#include <algorithm>
+
 namespace Core::AppleCP {
 
-bool AirPods::IsValid(const std::vector<uint8_t> &data)
+namespace {
+
+constexpr size_t kModelIdOffset = 3;
+constexpr size_t kStatusOffset = 5;
+constexpr size_t kBatteryOffset = 6;
+constexpr size_t kCaseOffset = 7;
+constexpr size_t kLidOffset = 8;
+constexpr size_t kPayloadOffset = 11;
+
+} // namespace
+
+bool AirPods::Matches(std::span<const uint8_t> data)
 {
-    if (data.size() != sizeof(AirPods)) {
-        return false;
+    return data.size() == kSize &&
+           data[kPacketTypeOffset] == Helper::ToUnderlying(PacketType::ProximityPairing) &&
+           data[kRemainingLengthOffset] == kSize - kHeaderSize;
+}
+
+std::optional<AirPods> AirPods::Parse(std::span<const uint8_t> data)
+{
+    if (!Matches(data)) {
+        return std::nullopt;
     }
 
-    constexpr uint8_t shouldRemainingLength =
-        sizeof(AirPods) - (offsetof(Header, remainingLength) + sizeof(Header::remainingLength));
+    return AirPods{data.first<kSize>()};
+}
 
-    Header *packet = (Header *)(data.data());
-    if (packet->packetType != PacketType::ProximityPairing ||
-        packet->remainingLength != shouldRemainingLength)
-    {
-        return false;
-    }
+AirPods::AirPods(std::span<const uint8_t, kSize> data)
+{
+    std::ranges::copy(data, _data.begin());
+}
 
-    return true;
+uint8_t AirPods::Bits(size_t offset, uint32_t shift, uint32_t count) const
+{
+    return static_cast<uint8_t>((_data[offset] >> shift) & ((1u << count) - 1));
+}
+
+bool AirPods::Bit(size_t offset, uint32_t shift) const
+{
+    return Bits(offset, shift, 1) != 0;
 }
 
 Core::AirPods::Model AirPods::GetModel(uint16_t modelId)
@@ -80,7 +105,7 @@ Core::AirPods::Model AirPods::GetModel(uint16_t modelId)
 
 Core::AirPods::Side AirPods::GetBroadcastedSide() const
 {
-    return broadcastFrom == 1 ? Core::AirPods::Side::Left : Core::AirPods::Side::Right;
+    return Bit(kStatusOffset, 5) ? Core::AirPods::Side::Left : Core::AirPods::Side::Right;
 }
 
 bool AirPods::IsLeftBroadcasted() const
@@ -95,50 +120,50 @@ bool AirPods::IsRightBroadcasted() const
 
 Core::AirPods::Model AirPods::GetModel() const
 {
-    return GetModel(modelId);
+    return GetModel(static_cast<uint16_t>(_data[kModelIdOffset] | _data[kModelIdOffset + 1] << 8));
 }
 
 Core::AirPods::Battery AirPods::GetLeftBattery() const
 {
-    const auto val = (IsLeftBroadcasted() ? battery.curr : battery.anot);
-    return (val >= 0 && val <= 10) ? val : Core::AirPods::Battery{};
+    const auto val = Bits(kBatteryOffset, IsLeftBroadcasted() ? 0 : 4, 4);
+    return val <= 10 ? val : Core::AirPods::Battery{};
 }
 
 Core::AirPods::Battery AirPods::GetRightBattery() const
 {
-    const auto val = (IsRightBroadcasted() ? battery.curr : battery.anot);
-    return (val >= 0 && val <= 10) ? val : Core::AirPods::Battery{};
+    const auto val = Bits(kBatteryOffset, IsRightBroadcasted() ? 0 : 4, 4);
+    return val <= 10 ? val : Core::AirPods::Battery{};
 }
 
 Core::AirPods::Battery AirPods::GetCaseBattery() const
 {
-    const auto val = battery.caseBox;
-    return (val >= 0 && val <= 10) ? val : Core::AirPods::Battery{};
+    const auto val = Bits(kCaseOffset, 0, 4);
+    return val <= 10 ? val : Core::AirPods::Battery{};
 }
 
 bool AirPods::IsLeftCharging() const
 {
-    return (IsLeftBroadcasted() ? battery.currCharging : battery.anotCharging) != 0;
+    return Bit(kCaseOffset, IsLeftBroadcasted() ? 4 : 5);
 }
 
 bool AirPods::IsRightCharging() const
 {
-    return (IsRightBroadcasted() ? battery.currCharging : battery.anotCharging) != 0;
+    return Bit(kCaseOffset, IsRightBroadcasted() ? 4 : 5);
 }
 
 bool AirPods::IsBothPodsInCase() const
 {
-    return bothInCase;
+    return Bit(kStatusOffset, 2);
 }
 
 bool AirPods::IsLidOpened() const
 {
-    return lid.closed == 0;
+    return !Bit(kLidOffset, 3);
 }
 
 bool AirPods::IsCaseCharging() const
 {
-    return battery.caseCharging;
+    return Bit(kCaseOffset, 6);
 }
 
 bool AirPods::IsLeftInEar() const
@@ -146,22 +171,22 @@ bool AirPods::IsLeftInEar() const
     // If it's charging, the "ear" will be set in one of the multiple devices, idk why..
     // so we need to filter it
     //     vvvvvvvvvvvvvvvvvvvv
-    return !IsLeftCharging() && (IsLeftBroadcasted() ? currInEar : anotInEar);
+    return !IsLeftCharging() && Bit(kStatusOffset, IsLeftBroadcasted() ? 1 : 3);
 }
 
 bool AirPods::IsRightInEar() const
 {
-    return !IsRightCharging() && (IsRightBroadcasted() ? currInEar : anotInEar);
+    return !IsRightCharging() && Bit(kStatusOffset, IsRightBroadcasted() ? 1 : 3);
 }
 
-AirPods AirPods::Desensitize() const
+std::array<uint8_t, AirPods::kSize> AirPods::Desensitize() const
 {
-    auto result = *this;
+    auto result = _data;
 
     // This field may be some kind of hash or encrypted payload.
     // So it may contain personal information about the user.
     //
-    std::memset(result.unk12, 0, sizeof(result.unk12));
+    std::fill(result.begin() + kPayloadOffset, result.end(), 0);
 
     return result;
 }
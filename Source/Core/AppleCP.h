@@ -18,7 +18,9 @@
 
 #pragma once
 
-#include <vector>
+#include <span>
+#include <array>
+#include <optional>
 
 #include "Base.h"
 
@@ -26,8 +28,6 @@
 //
 namespace Core::AppleCP {
 
-#pragma pack(push)
-#pragma pack(1)
 enum class PacketType : uint8_t {
     AirPrint = 0x3,
     AirDrop = 0x5,
@@ -59,10 +59,10 @@ enum class Color : uint8_t {
     Yellow = 0xC,
 };
 
-struct Header {
-    PacketType packetType;
-    uint8_t remainingLength; // Remaining length of this packet
-};
+// Every packet starts with its type and the length of the rest of it
+constexpr size_t kPacketTypeOffset = 0;
+constexpr size_t kRemainingLengthOffset = 1;
+constexpr size_t kHeaderSize = 2;
 
 constexpr uint16_t VendorId = 76;
 
@@ -97,10 +97,41 @@ constexpr uint16_t VendorId = 76;
 //      one earphone is working and the other is charging (lid opened), the Bluetooth device in
 //      both earphones is made discoverable, and the battery of the case is sent and synced.
 //
-class AirPods : Header
+// About the layout:
+//
+//      The advertisement is decoded with explicit byte and bit extraction, never by casting the
+//      buffer to a struct, so it doesn't depend on the compiler's bit-field order or alignment.
+//      Multi-byte values are little-endian. "Current" is the earphone broadcasting.
+//
+//        0      packet type (ProximityPairing)
+//        1      remaining length (25)
+//        2      unknown
+//        3-4    model id
+//        5      bit 1: current in ear, bit 2: both in case, bit 3: another in ear,
+//               bit 5: broadcast from the left earphone
+//        6      bits 0-3: current battery, bits 4-7: another battery
+//        7      bits 0-3: case battery, bit 4: current charging, bit 5: another charging,
+//               bit 6: case charging
+//        8      bits 0-2: lid open/close count, bit 3: lid closed
+//        9      color (untested because I don't have a device other than white)
+//        10     unknown
+//        11-26  hash or encrypted payload
+//
+//      Batteries are [0, 10], otherwise unavailable. The lid count increases if the lid opened
+//      or closed once, and resets if it overflows or the advertisements stop.
+//
+class AirPods
 {
 public:
-    static bool IsValid(const std::vector<uint8_t> &data);
+    static constexpr size_t kSize = 27;
+
+    // Checks the size and the header only, cheap enough to run on every advertisement received
+    static bool Matches(std::span<const uint8_t> data);
+
+    // Validates and decodes the manufacturer data in one pass, returns nullopt if it isn't an
+    // AirPods advertisement
+    static std::optional<AirPods> Parse(std::span<const uint8_t> data);
+
     static Core::AirPods::Model GetModel(uint16_t modelId);
 
     Core::AirPods::Side GetBroadcastedSide() const;
@@ -123,53 +154,15 @@ public:
     bool IsLeftInEar() const;
     bool IsRightInEar() const;
 
-    AirPods Desensitize() const;
+    // The raw advertisement with the payload that may identify the user zeroed
+    std::array<uint8_t, kSize> Desensitize() const;
 
 private:
-    uint8_t unk1[1];
-    uint16_t modelId;
-    struct {
-        uint8_t unk4 : 1;
-        uint8_t currInEar : 1;
-        uint8_t bothInCase : 1;
-        uint8_t anotInEar : 1;
-        uint8_t unk6 : 1;
-        uint8_t broadcastFrom : 1; // This advertisement is broadcast from which earphone.
-        uint8_t unk7 : 1;
-        uint8_t unk8 : 1;
-    };
-    struct {
-        uint8_t curr : 4;         // Battery remaining [0, 10], otherwise unavailable
-        uint8_t anot : 4;         // Battery remaining [0, 10], otherwise unavailable
-        uint8_t caseBox : 4;      // Battery remaining [0, 10], otherwise unavailable
-        uint8_t currCharging : 1; // If it's charging (value != 0)
-        uint8_t anotCharging : 1; // If it's charging (value != 0)
-        uint8_t caseCharging : 1; // If it's charging (value != 0)
-        uint8_t unk9 : 1;
-    } battery;
-    struct {
-        uint8_t switchCount : 3; // This count increases if the lid opened or closed once, and
-                                 // resets if overflow or no longer broadcasting advertisements
-        uint8_t closed : 1;
-        uint8_t unk10 : 4;
-    } lid;
-    Color color; // Untested because I don't have a device other than white
-    uint8_t unk11[1];
-    uint8_t unk12[16]; // Hash or encrypted payload
-};
-static_assert(sizeof(AirPods) == 27);
-#pragma pack(pop)
-
-template <class T>
-concept KindOfACPStruct = std::is_base_of_v<Header, T>;
+    explicit AirPods(std::span<const uint8_t, kSize> data);
 
-template <KindOfACPStruct T>
-std::optional<T> As(const std::vector<uint8_t> &data)
-{
-    if (!T::IsValid(data)) {
-        return std::nullopt;
-    }
+    std::array<uint8_t, kSize> _data;
 
-    return *(T *)data.data();
-}
+    uint8_t Bits(size_t offset, uint32_t shift, uint32_t count) const;
+    bool Bit(size_t offset, uint32_t shift) const;
+};
 } // namespace Core::AppleCP
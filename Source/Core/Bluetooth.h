@@ -28,9 +28,10 @@ inline QString Helper::ToString<Core::Bluetooth::AdvertisementWatcher::ReceivedD
 {
     QString manufacturerData;
 
-    for (const auto &keyValue : value.manufacturerDataMap) {
-        manufacturerData +=
-            QString{"CompanyId: %1 Bytes: %2"}.arg(keyValue.first).arg(ToString(keyValue.second));
+    for (size_t i = 0; i < value.manufacturerData.Size(); ++i) {
+        const auto entry = value.manufacturerData[i];
+        manufacturerData += QString{"CompanyId: %1 Bytes: %2"}.arg(entry.companyId).arg(
+            ToString(std::vector<uint8_t>{entry.data.begin(), entry.data.end()}));
     }
 
     return QString{"rssi: %1 address: %3\nmanufacturerData: %4"}
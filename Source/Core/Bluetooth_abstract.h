@@ -18,8 +18,13 @@
 
 #pragma once
 
+#include <span>
+#include <array>
+#include <atomic>
+#include <algorithm>
 #include <functional>
 #include <optional>
+#include <type_traits>
 
 #include "../Helper.h"
 
@@ -31,14 +36,100 @@ enum class DeviceState : uint32_t {
     Connected,
 };
 
+//////////////////////////////////////////////////
+// ManufacturerDataList
+//
+// The manufacturer data entries of a legacy advertisement, stored inline. The payload of one is at
+// most 31 bytes and each entry takes 4 of them besides its data (length, type and company id),
+// which bounds both the data and the number of entries. Trivially copyable.
+//
+
+class ManufacturerDataList
+{
+public:
+    static constexpr size_t kMaxPayloadSize = 31;
+    static constexpr size_t kEntryOverhead = 4;
+    static constexpr size_t kMaxEntries = kMaxPayloadSize / kEntryOverhead;
+    static constexpr size_t kMaxDataSize = kMaxPayloadSize - kEntryOverhead;
+
+    struct Entry {
+        uint16_t companyId;
+        std::span<const uint8_t> data;
+    };
+
+    // Returns false if the entry isn't stored, because it doesn't fit (e.g. it's from an extended
+    // advertisement) or the company id is present already. The first entry of a company wins.
+    inline bool Append(uint16_t companyId, std::span<const uint8_t> data)
+    {
+        if (_entryCount == kMaxEntries || data.size() > kMaxDataSize - _dataSize ||
+            Find(companyId).has_value())
+        {
+            return false;
+        }
+
+        _entries[_entryCount++] = StoredEntry{
+            .companyId = companyId,
+            .offset = _dataSize,
+            .size = static_cast<uint8_t>(data.size()),
+        };
+        std::ranges::copy(data, _data.begin() + _dataSize);
+        _dataSize += static_cast<uint8_t>(data.size());
+        return true;
+    }
+
+    inline std::optional<std::span<const uint8_t>> Find(uint16_t companyId) const
+    {
+        for (size_t i = 0; i < _entryCount; ++i) {
+            if (_entries[i].companyId == companyId) {
+                return DataOf(_entries[i]);
+            }
+        }
+        return std::nullopt;
+    }
+
+    inline size_t Size() const
+    {
+        return _entryCount;
+    }
+
+    inline bool Empty() const
+    {
+        return _entryCount == 0;
+    }
+
+    // The data points into this list
+    inline Entry operator[](size_t index) const
+    {
+        return Entry{.companyId = _entries[index].companyId, .data = DataOf(_entries[index])};
+    }
+
+private:
+    struct StoredEntry {
+        uint16_t companyId;
+        uint8_t offset;
+        uint8_t size;
+    };
+
+    std::array<uint8_t, kMaxDataSize> _data{};
+    std::array<StoredEntry, kMaxEntries> _entries{};
+    uint8_t _entryCount{0};
+    uint8_t _dataSize{0};
+
+    inline std::span<const uint8_t> DataOf(const StoredEntry &entry) const
+    {
+        return std::span{_data}.subspan(entry.offset, entry.size);
+    }
+};
+static_assert(std::is_trivially_copyable_v<ManufacturerDataList>);
+
 namespace Details {
 
 template <class ConcreteAddressT>
 class DeviceAbstract
 {
 public:
-    using FnConnectionStatusChanged = std::function<void(DeviceState)>;
-    using FnNameChanged = std::function<void(const std::string &)>;
+    using FnConnectionStatusChanged = Helper::InplaceFunction<void(DeviceState)>;
+    using FnNameChanged = Helper::InplaceFunction<void(const std::string &)>;
 
     virtual inline ~DeviceAbstract() {}
 
@@ -83,10 +174,17 @@ public:
         int16_t rssi{};
         typename Derived::Timestamp timestamp;
         uint64_t address{};
-        std::map<uint16_t, std::vector<uint8_t>> manufacturerDataMap;
+        ManufacturerDataList manufacturerData;
+    };
+    using FnReceived = Helper::InplaceFunction<void(const ReceivedData &)>;
+    using FnStateChanged = Helper::InplaceFunction<void(State, const std::optional<std::string> &)>;
+    using FnPrefilter =
+        Helper::InplaceFunction<bool(uint16_t companyId, std::span<const uint8_t> data)>;
+
+    struct PrefilterStats {
+        uint64_t accepted{0};
+        uint64_t rejected{0};
     };
-    using FnReceived = std::function<void(const ReceivedData &)>;
-    using FnStateChanged = std::function<void(State, const std::optional<std::string> &)>;
 
     virtual inline ~AdvertisementWatcherAbstract() {}
 
@@ -99,12 +197,51 @@ public:
         return _cbStateChanged;
     }
 
+    // Runs on the raw manufacturer data entries of every advertisement, before anything is
+    // copied. Only the entries it passes are delivered, and an advertisement without any is
+    // dropped. Without a prefilter every advertisement is delivered as is.
+    //
+    // Not synchronized with the receiving thread, set it before `Start()`.
+    //
+    inline void SetPrefilter(FnPrefilter prefilter)
+    {
+        _prefilter = std::move(prefilter);
+    }
+
+    inline PrefilterStats GetPrefilterStats() const
+    {
+        return PrefilterStats{
+            .accepted = _prefilterAccepted.load(std::memory_order_relaxed),
+            .rejected = _prefilterRejected.load(std::memory_order_relaxed),
+        };
+    }
+
     virtual bool Start() = 0;
     virtual bool Stop() = 0;
 
+protected:
+    inline bool HasPrefilter() const
+    {
+        return static_cast<bool>(_prefilter);
+    }
+
+    inline bool PassesPrefilter(uint16_t companyId, std::span<const uint8_t> data) const
+    {
+        return !_prefilter || _prefilter(companyId, data);
+    }
+
+    // Called once per advertisement by the implementation
+    inline void CountPrefiltered(bool accepted)
+    {
+        (accepted ? _prefilterAccepted : _prefilterRejected)
+            .fetch_add(1, std::memory_order_relaxed);
+    }
+
 private:
     Helper::Callback<FnReceived> _cbReceived;
     Helper::Callback<FnStateChanged> _cbStateChanged;
+    FnPrefilter _prefilter;
+    std::atomic<uint64_t> _prefilterAccepted{0}, _prefilterRejected{0};
 };
 } // namespace Details
 } // namespace Core::Bluetooth
@@ -345,31 +345,46 @@ bool AdvertisementWatcher::Stop()
 
 void AdvertisementWatcher::OnReceived(const BluetoothLEAdvertisementReceivedEventArgs &args)
 {
+    // Most advertisements around are of no interest, they are rejected on the raw buffers
     ReceivedData receivedData;
 
-    receivedData.rssi = args.RawSignalStrengthInDBm();
-    receivedData.timestamp = args.Timestamp();
-    receivedData.address = args.BluetoothAddress();
-
     const auto &manufacturerDataArray = args.Advertisement().ManufacturerData();
     for (uint32_t i = 0; i < manufacturerDataArray.Size(); ++i) {
         const auto &manufacturerData = manufacturerDataArray.GetAt(i);
         const auto companyId = manufacturerData.CompanyId();
         const auto &data = manufacturerData.Data();
 
-        std::vector<uint8_t> stdData(data.data(), data.data() + data.Length());
+        std::span<const uint8_t> rawData{data.data(), data.Length()};
 
 #if defined APD_DEBUG
-        auto overrideAdv = DebugConfig::GetInstance().GetOverrideAdv();
+        const auto overrideAdv = DebugConfig::GetInstance().GetOverrideAdv();
         if (overrideAdv.has_value()) {
-            stdData = std::move(overrideAdv.value());
-            LOG(Trace, "Adv override: {}", Helper::ToString(stdData));
+            rawData = overrideAdv.value();
+            LOG(Trace, "Adv override: {}", Helper::ToString(overrideAdv.value()));
         }
 #endif
 
-        receivedData.manufacturerDataMap.try_emplace(companyId, std::move(stdData));
+        if (!PassesPrefilter(companyId, rawData)) {
+            continue;
+        }
+
+        if (!receivedData.manufacturerData.Append(companyId, rawData)) {
+            LOG(Trace, "Manufacturer data dropped. CompanyId: '{}', size: '{}'", companyId,
+                rawData.size());
+        }
     }
 
+    // Advertisements without manufacturer data only get through when nothing is filtered
+    const bool accepted = !HasPrefilter() || !receivedData.manufacturerData.Empty();
+    CountPrefiltered(accepted);
+    if (!accepted) {
+        return;
+    }
+
+    receivedData.rssi = args.RawSignalStrengthInDBm();
+    receivedData.timestamp = args.Timestamp();
+    receivedData.address = args.BluetoothAddress();
+
     std::lock_guard<std::mutex> lock{_mutex};
     CbReceived().Invoke(receivedData);
 }
@@ -137,4 +137,7 @@ private:
     void OnReceived(const WinrtBluetoothAdv::BluetoothLEAdvertisementReceivedEventArgs &args);
     void OnStopped(const WinrtBluetoothAdv::BluetoothLEAdvertisementWatcherStoppedEventArgs &args);
 };
+
+// Handed to the callbacks and kept by them, copying it must stay a memcpy
+static_assert(std::is_trivially_copyable_v<AdvertisementWatcher::ReceivedData>);
 } // namespace Core::Bluetooth
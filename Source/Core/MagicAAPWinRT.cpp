@@ -385,7 +385,7 @@ void MagicAAPWinRTClient::CleanupWinRTObjects() {
 #endif
 }
 
-bool MagicAAPWinRTClient::SendData(const std::vector<uint8_t>& data) {
+bool MagicAAPWinRTClient::SendData(std::span<const uint8_t> data) {
     std::lock_guard<std::mutex> lock(_mutex);
     
     if (!_connected.load()) {
@@ -439,7 +439,8 @@ bool MagicAAPWinRTClient::SendData(const std::vector<uint8_t>& data) {
     
     try {
         // Write data
-        impl->writer.WriteBytes(::winrt::array_view<const uint8_t>(data));
+        impl->writer.WriteBytes(
+            ::winrt::array_view<const uint8_t>(data.data(), data.data() + data.size()));
         impl->writer.StoreAsync().get();
         
         spdlog::debug("[MagicAAPWinRT] Sent {} bytes", data.size());
@@ -462,7 +463,8 @@ void MagicAAPWinRTClient::ReceiverLoop() {
     // Handle device interface mode
     if (_usingDeviceInterface && _deviceHandle) {
         HANDLE hDevice = static_cast<HANDLE>(_deviceHandle);
-        std::vector<uint8_t> buffer(4096);
+        _receiveBuffer.resize(4096);
+        auto &buffer = _receiveBuffer;
         
         while (!_stopReceiver.load() && _connected.load()) {
             OVERLAPPED overlapped = {};
@@ -488,11 +490,10 @@ void MagicAAPWinRTClient::ReceiverLoop() {
             CloseHandle(overlapped.hEvent);
             
             if (result && bytesRead > 0) {
-                std::vector<uint8_t> data(buffer.begin(), buffer.begin() + bytesRead);
                 spdlog::debug("[MagicAAPWinRT] Received {} bytes via device interface", bytesRead);
                 
                 if (_onDataReceived) {
-                    _onDataReceived(data);
+                    _onDataReceived(std::span<const uint8_t>{buffer.data(), bytesRead});
                 }
             }
         }
@@ -506,6 +507,8 @@ void MagicAAPWinRTClient::ReceiverLoop() {
     
 #if HAS_WINRT_BLUETOOTH
     try {
+        _receiveBuffer.resize(1024);
+
         while (!_stopReceiver.load() && _connected.load()) {
             if (!_impl) break;
             
@@ -522,15 +525,19 @@ void MagicAAPWinRTClient::ReceiverLoop() {
                 if (status == WinRTFoundation::AsyncStatus::Completed) {
                     uint32_t bytesRead = loadOp.get();
                     if (bytesRead > 0) {
-                        // Read the data
-                        std::vector<uint8_t> buffer(bytesRead);
-                        impl->reader.ReadBytes(buffer);
+                        // Read the data into the reused buffer
+                        if (bytesRead > _receiveBuffer.size()) {
+                            _receiveBuffer.resize(bytesRead);
+                        }
+                        impl->reader.ReadBytes(::winrt::array_view<uint8_t>(
+                            _receiveBuffer.data(), _receiveBuffer.data() + bytesRead));
                         
                         spdlog::debug("[MagicAAPWinRT] Received {} bytes", bytesRead);
                         
                         // Call callback
                         if (_onDataReceived) {
-                            _onDataReceived(buffer);
+                            _onDataReceived(
+                                std::span<const uint8_t>{_receiveBuffer.data(), bytesRead});
                         }
                     }
                 } else if (status == WinRTFoundation::AsyncStatus::Started) {
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 #include <functional>
@@ -73,10 +74,11 @@ public:
     bool IsConnected() const { return _connected.load(); }
 
     // Send raw data
-    bool SendData(const std::vector<uint8_t>& data);
+    bool SendData(std::span<const uint8_t> data);
 
     // Callbacks
-    using OnDataReceivedCallback = std::function<void(const std::vector<uint8_t>&)>;
+    // The received data is only valid for the duration of the callback
+    using OnDataReceivedCallback = std::function<void(std::span<const uint8_t>)>;
     using OnDisconnectedCallback = std::function<void()>;
     
     void SetOnDataReceived(OnDataReceivedCallback callback);
@@ -89,6 +91,8 @@ private:
     std::atomic<bool> _connected{false};
     std::atomic<bool> _stopReceiver{false};
     std::thread _receiverThread;
+    // Reused by the receiver thread for every read, allocated once per connection
+    std::vector<uint8_t> _receiveBuffer;
     mutable std::mutex _mutex;
     std::wstring _lastError;
     
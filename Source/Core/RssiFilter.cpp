@@ -0,0 +1,104 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "RssiFilter.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace Core::AirPods::Details {
+
+RssiFilter::RssiFilter() : RssiFilter{Config{}} {}
+
+RssiFilter::RssiFilter(Config config) : _config{config} {}
+
+void RssiFilter::Update(int16_t rssi, Timestamp now)
+{
+    const auto elapsed = now - _last;
+    const bool restart =
+        _samples == 0 || elapsed < Clock::duration::zero() || elapsed > _config.maxGap;
+    if (restart) {
+        _recentCount = 0;
+        _recentNext = 0;
+    }
+
+    _recent[_recentNext] = rssi;
+    _recentNext = (_recentNext + 1) % _recent.size();
+    _recentCount = std::min(_recentCount + 1, _recent.size());
+
+    float median;
+    if (_recentCount == 3) {
+        median = static_cast<float>(std::max(
+            std::min(_recent[0], _recent[1]),
+            std::min(std::max(_recent[0], _recent[1]), _recent[2])));
+    }
+    else {
+        median = (_recent[0] + _recent[_recentCount - 1]) / 2.0f;
+    }
+
+    if (restart) {
+        _value = median;
+        _variance = 0;
+        _intervalMs = 0;
+    }
+    else {
+        const float k = 1.0f - std::exp(
+                                   -std::chrono::duration<float>{elapsed}.count() /
+                                   std::chrono::duration<float>{_config.timeConstant}.count());
+        const float delta = median - _value;
+        _value += k * delta;
+        _variance = (1.0f - k) * (_variance + k * delta * delta);
+
+        const float elapsedMs = std::chrono::duration<float, std::milli>{elapsed}.count();
+        _intervalMs =
+            _intervalMs == 0 ? elapsedMs : _intervalMs + 0.25f * (elapsedMs - _intervalMs);
+    }
+
+    _last = now;
+    _lastSample = rssi;
+    ++_samples;
+}
+
+bool RssiFilter::HasValue() const
+{
+    return _samples != 0;
+}
+
+float RssiFilter::Value() const
+{
+    return _value;
+}
+
+bool RssiFilter::PassesThreshold(float threshold)
+{
+    _passing = HasValue() && _value >= (_passing ? threshold - _config.hysteresis : threshold);
+    return _passing;
+}
+
+auto RssiFilter::GetQuality() const -> Quality
+{
+    return Quality{
+        .rssi = _value,
+        .deviation = std::sqrt(_variance),
+        .interval = std::chrono::milliseconds{std::lround(_intervalMs)},
+        .lastSample = _lastSample,
+        .samples = _samples,
+    };
+}
+
+} // namespace Core::AirPods::Details
@@ -0,0 +1,85 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace Core::AirPods::Details {
+
+// Smooths the RSSI of one advertiser. A single advertisement is easily off by 10 dB or more,
+// decisions on the raw values keep changing their mind. A median of the last three samples drops
+// spikes, then an exponential low-pass whose coefficient follows the time between samples, so it
+// smooths the same at any advertising rate.
+//
+class RssiFilter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Timestamp = std::chrono::time_point<Clock>;
+
+    struct Config {
+        std::chrono::milliseconds timeConstant{1500};
+        // A sample gap longer than this restarts the filter instead of smoothing across it
+        std::chrono::milliseconds maxGap{5000};
+        // How far below a threshold the value has to drop to fall below it again, see
+        // `PassesThreshold()`
+        float hysteresis{6};
+    };
+
+    struct Quality {
+        // Smoothed, dBm
+        float rssi{0};
+        // Exponentially weighted standard deviation of the samples, dB
+        float deviation{0};
+        // Smoothed time between samples
+        std::chrono::milliseconds interval{0};
+        int16_t lastSample{0};
+        uint32_t samples{0};
+    };
+
+    RssiFilter();
+    explicit RssiFilter(Config config);
+
+    void Update(int16_t rssi, Timestamp now);
+
+    bool HasValue() const;
+    // Smoothed, dBm. Only meaningful if `HasValue()`.
+    float Value() const;
+
+    // Comparator with hysteresis: passes once the smoothed value reaches `threshold` and keeps
+    // passing until it drops `Config::hysteresis` below it
+    bool PassesThreshold(float threshold);
+
+    Quality GetQuality() const;
+
+private:
+    Config _config;
+    // Ring of the last samples, `_recentNext` is overwritten next
+    std::array<int16_t, 3> _recent{};
+    size_t _recentCount{0}, _recentNext{0};
+    Timestamp _last;
+    float _value{0}, _variance{0}, _intervalMs{0};
+    int16_t _lastSample{0};
+    uint32_t _samples{0};
+    bool _passing{false};
+};
+
+} // namespace Core::AirPods::Details
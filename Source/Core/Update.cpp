@@ -377,14 +377,24 @@ AsyncChecker::~AsyncChecker()
 
 void AsyncChecker::Start()
 {
-    // clang-format off
-    _timer.Start(kInterval, [this] { Checker(); }, true);
-    // clang-format on
+    _timer.Start(
+        kInterval,
+        [this] {
+            if (_check.valid() && !Helper::IsFutureReady(_check)) {
+                LOG(Info, "The last update check is still running.");
+                return;
+            }
+            _check = std::async(std::launch::async, [this] { Checker(); });
+        },
+        true);
 }
 
 void AsyncChecker::Stop()
 {
     _timer.Stop();
+    if (_check.valid()) {
+        _check.wait();
+    }
 }
 
 void AsyncChecker::Checker()
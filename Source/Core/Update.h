@@ -19,6 +19,7 @@
 #pragma once
 
 #include <string>
+#include <future>
 #include <optional>
 
 #include <QString>
@@ -69,6 +70,8 @@ private:
 
     FnCallback _callback;
     Helper::Timer _timer;
+    // Fetching blocks, it runs off the shared timer thread
+    std::future<void> _check;
     bool _isFirst = true;
 
     void Checker();
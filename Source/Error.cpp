@@ -29,6 +29,7 @@
 
 #include <Config.h>
 #include "Utils.h"
+#include "Logger.h"
 
 constexpr auto kStackTraceFileName = "StackTrace.log";
 
@@ -59,6 +60,8 @@ void Initialize()
 [[noreturn]] void FatalError(const std::string &content, bool report)
 {
     Error::Impl::WriteStackTraceFile();
+    // The process is aborted below, write out what's still queued
+    Logger::Flush();
 
 #if !defined APD_OS_WIN
     #error "Need to port."
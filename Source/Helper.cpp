@@ -0,0 +1,146 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Helper.h"
+
+#if defined APD_OS_WIN
+    #include <Windows.h>
+#elif defined __linux__
+    #include <cerrno>
+    #include <ctime>
+    #include <unistd.h>
+    #include <sys/timerfd.h>
+#endif
+
+namespace Helper {
+
+#if defined APD_OS_WIN
+
+AlarmClock::AlarmClock()
+{
+    // High resolution timers need Windows 10 1803, older ones follow the system timer resolution
+    HANDLE timer = CreateWaitableTimerExW(
+        nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (timer == nullptr) {
+        timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+    }
+    if (timer != nullptr) {
+        _handle = reinterpret_cast<intptr_t>(timer);
+    }
+}
+
+AlarmClock::~AlarmClock()
+{
+    if (_handle != -1) {
+        CloseHandle(reinterpret_cast<HANDLE>(_handle));
+    }
+}
+
+void AlarmClock::Set(Clock::time_point at)
+{
+    if (_handle == -1) {
+        return;
+    }
+
+    const auto timer = reinterpret_cast<HANDLE>(_handle);
+    if (at == Clock::time_point::max()) {
+        CancelWaitableTimer(timer);
+        return;
+    }
+
+    // Relative to now, in 100 ns units. An absolute due time would follow the system clock.
+    using Units = std::chrono::duration<LONGLONG, std::ratio<1, 10'000'000>>;
+    const auto remaining = std::chrono::ceil<Units>(at - Clock::now());
+
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = -std::max<LONGLONG>(remaining.count(), 1);
+    SetWaitableTimer(timer, &dueTime, 0, nullptr, nullptr, FALSE);
+}
+
+void AlarmClock::Wait()
+{
+    if (_handle == -1) {
+        std::this_thread::sleep_for(kPollInterval);
+        return;
+    }
+    WaitForSingleObject(reinterpret_cast<HANDLE>(_handle), INFINITE);
+}
+
+#elif defined __linux__
+
+AlarmClock::AlarmClock()
+{
+    // `steady_clock` is `CLOCK_MONOTONIC` on Linux, so `Set()` can pass its time as is
+    _handle = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+}
+
+AlarmClock::~AlarmClock()
+{
+    if (_handle != -1) {
+        close(static_cast<int>(_handle));
+    }
+}
+
+void AlarmClock::Set(Clock::time_point at)
+{
+    if (_handle == -1) {
+        return;
+    }
+
+    // All zero disarms it
+    itimerspec spec{};
+    if (at != Clock::time_point::max()) {
+        const auto sinceEpoch = std::max(at.time_since_epoch(), Clock::duration{1});
+        const auto seconds = std::chrono::floor<std::chrono::seconds>(sinceEpoch);
+        spec.it_value.tv_sec = static_cast<time_t>(seconds.count());
+        spec.it_value.tv_nsec = static_cast<long>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch - seconds).count());
+    }
+    timerfd_settime(static_cast<int>(_handle), TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void AlarmClock::Wait()
+{
+    if (_handle == -1) {
+        std::this_thread::sleep_for(kPollInterval);
+        return;
+    }
+
+    // Blocks until it expires, a disarmed one doesn't
+    uint64_t expirations;
+    while (read(static_cast<int>(_handle), &expirations, sizeof(expirations)) < 0 &&
+           errno == EINTR) {
+    }
+}
+
+#else
+
+AlarmClock::AlarmClock() = default;
+
+AlarmClock::~AlarmClock() = default;
+
+void AlarmClock::Set(Clock::time_point) {}
+
+void AlarmClock::Wait()
+{
+    std::this_thread::sleep_for(kPollInterval);
+}
+
+#endif
+
+} // namespace Helper
@@ -18,8 +18,21 @@
 
 #pragma once
 
+#include <bit>
+#include <span>
 #include <mutex>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <memory>
+#include <optional>
 #include <vector>
+#include <utility>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <future>
@@ -168,8 +181,126 @@ struct Sides {
 
 //////////////////////////////////////////////////
 
+// Move-only replacement of `std::function` that never allocates. The callable is stored inline,
+// a callable that doesn't fit into `Capacity` bytes (or is over-aligned, or may throw when
+// moved) is rejected at compile time instead of being moved to the heap.
+//
+// The callable is invoked as const, like the lambdas without `mutable` it is meant for.
+//
+inline constexpr size_t kInplaceFunctionCapacity = 4 * sizeof(void *);
+
+template <class Signature, size_t Capacity = kInplaceFunctionCapacity>
+class InplaceFunction;
+
+template <class R, class... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>
+{
+public:
+    InplaceFunction() noexcept = default;
+    InplaceFunction(std::nullptr_t) noexcept {}
+
+    template <class F>
+        requires(
+            !std::is_same_v<std::remove_cvref_t<F>, InplaceFunction> &&
+            std::is_invocable_r_v<R, const std::decay_t<F> &, Args...>)
+    InplaceFunction(F &&function) noexcept(std::is_nothrow_constructible_v<std::decay_t<F>, F>)
+    {
+        using T = std::decay_t<F>;
+        static_assert(sizeof(T) <= Capacity, "The callable doesn't fit into the capacity.");
+        static_assert(alignof(T) <= alignof(void *), "The callable is over-aligned.");
+        static_assert(std::is_nothrow_move_constructible_v<T>, "The callable may throw on move.");
+
+        ::new (static_cast<void *>(_storage)) T(std::forward<F>(function));
+        _ops = &kOps<T>;
+    }
+
+    InplaceFunction(InplaceFunction &&rhs) noexcept
+    {
+        MoveFrom(rhs);
+    }
+
+    InplaceFunction &operator=(InplaceFunction &&rhs) noexcept
+    {
+        if (this != &rhs) {
+            Reset();
+            MoveFrom(rhs);
+        }
+        return *this;
+    }
+
+    InplaceFunction &operator=(std::nullptr_t) noexcept
+    {
+        Reset();
+        return *this;
+    }
+
+    ~InplaceFunction()
+    {
+        Reset();
+    }
+
+    R operator()(Args... args) const
+    {
+        return _ops->invoke(_storage, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return _ops != nullptr;
+    }
+
+private:
+    struct Ops {
+        R (*invoke)(const void *storage, Args &&...args);
+        // Move-constructs into `to` and destroys `from`
+        void (*relocate)(void *from, void *to) noexcept;
+        void (*destroy)(void *storage) noexcept;
+    };
+
+    template <class T>
+    static constexpr Ops kOps{
+        .invoke = [](const void *storage, Args &&...args) -> R {
+            return std::invoke(*static_cast<const T *>(storage), std::forward<Args>(args)...);
+        },
+        .relocate =
+            [](void *from, void *to) noexcept {
+                ::new (to) T(std::move(*static_cast<T *>(from)));
+                static_cast<T *>(from)->~T();
+            },
+        .destroy = [](void *storage) noexcept { static_cast<T *>(storage)->~T(); },
+    };
+
+    alignas(void *) std::byte _storage[Capacity];
+    const Ops *_ops{nullptr};
+
+    void MoveFrom(InplaceFunction &rhs) noexcept
+    {
+        if (rhs._ops != nullptr) {
+            rhs._ops->relocate(rhs._storage, _storage);
+            _ops = std::exchange(rhs._ops, nullptr);
+        }
+    }
+
+    void Reset() noexcept
+    {
+        if (_ops != nullptr) {
+            std::exchange(_ops, nullptr)->destroy(_storage);
+        }
+    }
+};
+
+//////////////////////////////////////////////////
+
 using CbHandle = uint64_t;
 
+// Registered functions are kept in an immutable list that is replaced on every change, so
+// `Invoke` only takes a snapshot of it and calls the functions without holding the mutex. A
+// function may therefore register or unregister callbacks (even itself) while being invoked.
+//
+// The snapshot is an `std::atomic<std::shared_ptr>`, which gives lock-free readers where the
+// platform provides it. libstdc++ implements it with an internal spinlock, so there `Invoke`
+// briefly contends with the writers and other readers while it copies the pointer.
+//
 template <class Function>
 class Callback
 {
@@ -179,41 +310,52 @@ public:
         std::lock_guard<std::mutex> lock{_mutex};
 
         auto thisHandle = _nextHandle++;
-        _callbacks.emplace_back(thisHandle, std::move(callback));
+        auto callbacks = std::make_shared<List>(*_callbacks.load());
+        callbacks->emplace_back(thisHandle, std::make_shared<const Function>(std::move(callback)));
+        _callbacks.store(std::move(callbacks));
         return thisHandle;
     }
 
+    // Doesn't wait for the `Invoke`s in flight. Those that have already taken their snapshot may
+    // still call the function after this returns, so whatever it captures must outlive them.
+    // Waiting isn't an option, a function may unregister itself while being invoked.
     inline bool Unregister(CbHandle handle)
     {
         std::lock_guard<std::mutex> lock{_mutex};
 
+        const auto current = _callbacks.load();
         auto iter =
-            std::find_if(_callbacks.begin(), _callbacks.end(), [handle](const auto &callbackInfo) {
+            std::find_if(current->begin(), current->end(), [handle](const auto &callbackInfo) {
                 return callbackInfo.first == handle;
             });
 
-        if (iter == _callbacks.end()) {
+        if (iter == current->end()) {
             return false;
         }
 
-        _callbacks.erase(iter);
+        auto callbacks = std::make_shared<List>();
+        callbacks->reserve(current->size() - 1);
+        callbacks->insert(callbacks->end(), current->begin(), iter);
+        callbacks->insert(callbacks->end(), std::next(iter), current->end());
+        _callbacks.store(std::move(callbacks));
         return true;
     }
 
+    // Same as `Unregister`, the `Invoke`s in flight may still call the functions
     inline void UnregisterAll()
     {
         std::lock_guard<std::mutex> lock{_mutex};
 
-        _callbacks.clear();
+        _callbacks.store(std::make_shared<const List>());
     }
 
     template <class... Args>
     inline void Invoke(Args &&...args) const
     {
-        std::lock_guard<std::mutex> lock{_mutex};
+        const auto callbacks = _callbacks.load();
 
-        for (const auto &callbackInfo : _callbacks) {
-            callbackInfo.second(args...);
+        for (const auto &callbackInfo : *callbacks) {
+            (*callbackInfo.second)(args...);
         }
     }
 
@@ -224,9 +366,13 @@ public:
     }
 
 private:
-    mutable std::mutex _mutex;
+    // Functions are shared between the successive lists, a change only copies the pointers
+    using List = std::vector<std::pair<CbHandle, std::shared_ptr<const Function>>>;
+
+    // Serializes the writers only
+    std::mutex _mutex;
     CbHandle _nextHandle{1};
-    std::vector<std::pair<CbHandle, Function>> _callbacks;
+    std::atomic<std::shared_ptr<const List>> _callbacks{std::make_shared<const List>()};
 };
 
 class ConWorker
@@ -289,11 +435,363 @@ private:
     }
 };
 
-class Timer
+//////////////////////////////////////////////////
+// AlarmClock - Lets a thread sleep until a time that other threads can move
+//
+// Backed by an OS timer, a timerfd on Linux and a waitable timer on Windows. Moving the time only
+// re-programs the timer, the sleeping thread isn't woken up to pick up the new one. Elsewhere, or
+// if the OS timer can't be created, `Wait()` falls back to polling every `kPollInterval`.
+//
+
+class AlarmClock : NonCopyable
 {
 public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto kPollInterval = std::chrono::milliseconds(10);
+
+    AlarmClock();
+    ~AlarmClock();
+
+    // Replaces the time set before, `Clock::time_point::max()` disarms the alarm. A time in the
+    // past rings right away.
+    void Set(Clock::time_point at);
+
+    // Returns when the alarm rings
+    void Wait();
+
+private:
+    // The native handle, -1 if there is none
+    intptr_t _handle{-1};
+};
+
+//////////////////////////////////////////////////
+// TimerScheduler - One thread that runs the callbacks of all `Timer`s
+//
+// A hierarchical timing wheel: 5 levels of 64 slots, a slot of level 0 is one tick, a slot of
+// level n spans 64^n ticks. A timer sits in the slot of the lowest level its deadline fits in, as
+// an intrusive list node, so arming, re-arming and cancelling are O(1). When the time reaches a
+// slot of a higher level, its timers cascade down to lower levels.
+//
+// The thread doesn't tick, it sleeps on an `AlarmClock` until the next slot with timers in it,
+// found from a bitmap per level. Re-arming never wakes it. When the next slot moves, earlier or
+// later, the alarm is moved with it, so a deadline pushed back doesn't wake the thread at the old
+// one either.
+//
+// Callbacks run on the scheduler thread one after another, so they must not block for long.
+//
+// The scheduler is never destroyed. A callback may destroy any timer, the last one included, and
+// the scheduler can't go away on its own thread in the middle of running it.
+//
+
+class TimerScheduler : NonCopyable
+{
+public:
+    using Clock = std::chrono::steady_clock;
     using FnTrigger = std::function<void()>;
 
+    // Deadlines are rounded up to it, a timer fires up to a tick late but never early
+    static constexpr auto kTick = std::chrono::milliseconds(10);
+
+    struct Entry {
+        std::chrono::milliseconds interval{};
+        std::shared_ptr<const FnTrigger> callback;
+
+    private:
+        friend class TimerScheduler;
+
+        static constexpr uint32_t kNotScheduled = std::numeric_limits<uint32_t>::max();
+
+        uint64_t expires{0};
+        Entry *prev{nullptr}, *next{nullptr};
+        // level * kSlots + slot
+        uint32_t slot{kNotScheduled};
+    };
+
+    // Shared by all timers. Started with the first of them, the thread sleeps without waking up
+    // while no timer is armed.
+    static inline TimerScheduler &GetInstance()
+    {
+        // Leaked on purpose, timers held by other static objects may outlive a static instance
+        static TimerScheduler *instance = new TimerScheduler;
+        return *instance;
+    }
+
+    inline void Add(Entry &entry, Clock::time_point deadline)
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        if (entry.slot != Entry::kNotScheduled) {
+            return;
+        }
+        Arm(entry, deadline);
+    }
+
+    // Moves the deadline to `interval` from now, does nothing if the entry isn't scheduled
+    inline void Reschedule(Entry &entry)
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        if (entry.slot == Entry::kNotScheduled) {
+            return;
+        }
+        // Re-armed within the same tick, e.g. for every packet of a burst
+        const auto deadline = Clock::now() + entry.interval;
+        if (ExpiryTickOf(deadline) == entry.expires) {
+            return;
+        }
+        Unlink(entry);
+        Arm(entry, deadline);
+    }
+
+    // When it returns, the callback of the entry isn't running and won't run anymore. Unless
+    // called from the callback itself, which then finishes.
+    inline void Remove(Entry &entry)
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+
+        if (entry.slot != Entry::kNotScheduled) {
+            Unlink(entry);
+            MoveAlarm();
+        }
+
+        if (std::this_thread::get_id() != _thread.get_id()) {
+            _idleConVar.wait(lock, [&] { return _running != &entry; });
+        }
+    }
+
+    // Times the thread woke up to run or cascade due timers, for diagnostics
+    inline uint64_t GetWakeups() const
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        return _wakeups;
+    }
+
+    // Times the thread woke up with nothing due, not included in `GetWakeups()`. Only expected
+    // where the alarm falls back to polling.
+    inline uint64_t GetStaleWakeups() const
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        return _staleWakeups;
+    }
+
+private:
+    static constexpr uint32_t kLevelBits = 6;
+    static constexpr uint32_t kSlots = 1 << kLevelBits;
+    static constexpr uint32_t kLevels = 5;
+    // About 124 days, later deadlines wait in the last level and are re-linked when they come up
+    static constexpr uint64_t kMaxDelta = (uint64_t{1} << (kLevelBits * kLevels)) - 1;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _idleConVar;
+    AlarmClock _alarm;
+    const Clock::time_point _start{Clock::now()};
+    uint64_t _currentTick{0};
+    std::array<std::array<Entry *, kSlots>, kLevels> _slots{};
+    std::array<uint64_t, kLevels> _occupied{};
+    // The time the alarm is set to, `min()` while the thread is awake
+    Clock::time_point _wakeAt{Clock::time_point::min()};
+    const Entry *_running{nullptr};
+    uint64_t _wakeups{0}, _staleWakeups{0};
+    std::thread _thread;
+
+    inline TimerScheduler() : _thread{[this] { Thread(); }} {}
+
+    inline void Thread()
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        bool woken = false;
+        while (true) {
+            const auto nowTick = static_cast<uint64_t>((Clock::now() - _start) / kTick);
+            const auto next = NextEventTick();
+
+            if (next.has_value() && next.value() <= nowTick) {
+                if (woken) {
+                    ++_wakeups;
+                    woken = false;
+                }
+                _currentTick = next.value();
+                Cascade();
+                ExpireCurrentSlot(lock);
+                continue;
+            }
+
+            // Woken for nothing, only when the alarm polls
+            if (woken) {
+                ++_staleWakeups;
+            }
+
+            // Nothing happens in between
+            _currentTick = std::max(_currentTick, nowTick);
+
+            // From here on, `MoveAlarm()` keeps the alarm on the next event
+            _wakeAt = next.has_value() ? TimeOf(next.value()) : Clock::time_point::max();
+            _alarm.Set(_wakeAt);
+            lock.unlock();
+            _alarm.Wait();
+            lock.lock();
+            _wakeAt = Clock::time_point::min();
+            woken = true;
+        }
+    }
+
+    inline Clock::time_point TimeOf(uint64_t tick) const
+    {
+        return _start + kTick * tick;
+    }
+
+    // The tick a deadline is rounded up to
+    inline uint64_t ExpiryTickOf(Clock::time_point deadline) const
+    {
+        const auto sinceStart = std::max(deadline - _start, Clock::duration::zero());
+        return static_cast<uint64_t>((sinceStart + kTick - Clock::duration{1}) / kTick);
+    }
+
+    inline void Arm(Entry &entry, Clock::time_point deadline)
+    {
+        entry.expires = ExpiryTickOf(deadline);
+        Link(entry, std::max(entry.expires, _currentTick + 1));
+        MoveAlarm();
+    }
+
+    // Sets the alarm of the sleeping thread to the next event, if that moved. The thread looks for
+    // it by itself while awake.
+    inline void MoveAlarm()
+    {
+        if (_wakeAt == Clock::time_point::min()) {
+            return;
+        }
+
+        const auto next = NextEventTick();
+        const auto wakeAt = next.has_value() ? TimeOf(next.value()) : Clock::time_point::max();
+        if (wakeAt != _wakeAt) {
+            _wakeAt = wakeAt;
+            _alarm.Set(wakeAt);
+        }
+    }
+
+    // Links the entry into the slot that comes up at tick `at`, which isn't in the past
+    inline void Link(Entry &entry, uint64_t at)
+    {
+        const uint64_t delta = std::min(at - _currentTick, kMaxDelta);
+        at = _currentTick + delta;
+
+        const uint32_t level =
+            delta < kSlots ? 0 : (static_cast<uint32_t>(std::bit_width(delta)) - 1) / kLevelBits;
+        const uint32_t slot = static_cast<uint32_t>(at >> (level * kLevelBits)) & (kSlots - 1);
+
+        Entry *&head = _slots[level][slot];
+        entry.prev = nullptr;
+        entry.next = head;
+        if (head != nullptr) {
+            head->prev = &entry;
+        }
+        head = &entry;
+        entry.slot = level * kSlots + slot;
+        _occupied[level] |= uint64_t{1} << slot;
+    }
+
+    inline void Unlink(Entry &entry)
+    {
+        const uint32_t level = entry.slot / kSlots, slot = entry.slot % kSlots;
+
+        if (entry.prev != nullptr) {
+            entry.prev->next = entry.next;
+        }
+        else {
+            _slots[level][slot] = entry.next;
+        }
+        if (entry.next != nullptr) {
+            entry.next->prev = entry.prev;
+        }
+        if (_slots[level][slot] == nullptr) {
+            _occupied[level] &= ~(uint64_t{1} << slot);
+        }
+        entry.prev = entry.next = nullptr;
+        entry.slot = Entry::kNotScheduled;
+    }
+
+    // The first tick after the current one at which a slot with entries comes up
+    inline std::optional<uint64_t> NextEventTick() const
+    {
+        std::optional<uint64_t> result;
+        for (uint32_t level = 0; level < kLevels; ++level) {
+            if (_occupied[level] == 0) {
+                continue;
+            }
+            // The current slot of a level is behind, it comes up again after a full turn
+            const uint32_t shift = level * kLevelBits;
+            const uint64_t base = _currentTick >> shift;
+            const int rotation = static_cast<int>((base + 1) & (kSlots - 1));
+            const auto distance = std::countr_zero(std::rotr(_occupied[level], rotation));
+
+            const uint64_t tick = (base + 1 + static_cast<uint64_t>(distance)) << shift;
+            if (!result.has_value() || tick < result.value()) {
+                result = tick;
+            }
+        }
+        return result;
+    }
+
+    // Moves the entries of the higher level slots coming up at the current tick down
+    inline void Cascade()
+    {
+        for (uint32_t level = 1; level < kLevels; ++level) {
+            const uint32_t shift = level * kLevelBits;
+            if ((_currentTick & ((uint64_t{1} << shift) - 1)) != 0) {
+                break;
+            }
+
+            const uint32_t slot = static_cast<uint32_t>(_currentTick >> shift) & (kSlots - 1);
+            while (Entry *entry = _slots[level][slot]) {
+                Unlink(*entry);
+                Link(*entry, std::max(entry->expires, _currentTick));
+            }
+        }
+    }
+
+    // Runs the due entries of the current level 0 slot, one at a time. The lock is released
+    // while a callback runs, so the slot is looked at again after each.
+    inline void ExpireCurrentSlot(std::unique_lock<std::mutex> &lock)
+    {
+        const uint32_t slot = static_cast<uint32_t>(_currentTick) & (kSlots - 1);
+        while (Entry *entry = _slots[0][slot]) {
+            Unlink(*entry);
+            if (entry->expires > _currentTick) {
+                Link(*entry, entry->expires);
+                continue;
+            }
+
+            // Periodic. The next deadline counts from when this one was due, so that the rounding
+            // to ticks doesn't add up, but not from the past if the thread fell behind.
+            Arm(*entry, std::max(TimeOf(entry->expires) + entry->interval, Clock::now()));
+
+            // A copy, so the timer can be restarted or stopped from its own callback
+            const auto callback = entry->callback;
+            _running = entry;
+            lock.unlock();
+            (*callback)();
+            lock.lock();
+            _running = nullptr;
+            _idleConVar.notify_all();
+        }
+    }
+};
+
+//////////////////////////////////////////////////
+// Timer - Calls back periodically on the shared `TimerScheduler` thread
+//
+// The timer is the handle of its entry in the wheel. `Start()` arms it, `Reset()` re-arms it, e.g.
+// a timeout pushed back by activity, and `Stop()` cancels it, all in constant time. `Reset()` is
+// cheap enough to be called for every packet. It never wakes the scheduler thread, at most it
+// moves the thread's alarm when the timer was the next one due.
+//
+
+class Timer : NonCopyable
+{
+public:
+    using FnTrigger = TimerScheduler::FnTrigger;
+
     Timer() = default;
 
     template <class... Args>
@@ -311,61 +809,178 @@ public:
     Start(std::chrono::milliseconds interval, FnTrigger callback, bool immediatelyOnce = false)
     {
         Stop();
-        _destroyFlag = false;
-        _interval = std::move(interval);
-        _thread =
-            std::thread{&Timer::Thread, this, std::move(callback), immediatelyOnce};
+        _entry.interval = interval;
+        _entry.callback = std::make_shared<const FnTrigger>(std::move(callback));
+
+        const auto now = TimerScheduler::Clock::now();
+        _scheduler.Add(_entry, immediatelyOnce ? now : now + interval);
     }
 
     inline void Stop()
     {
-        _destroyFlag = true;
-        _destroyConVar.notify_all();
-        if (_thread.joinable()) {
-            _thread.join();
-        }
+        _scheduler.Remove(_entry);
     }
 
     inline void Reset()
     {
-        _deadline = Clock::now() + _interval.load();
+        _scheduler.Reschedule(_entry);
     }
 
 private:
-    using Clock = std::chrono::steady_clock;
-    using TimePoint = Clock::time_point;
+    TimerScheduler &_scheduler{TimerScheduler::GetInstance()};
+    TimerScheduler::Entry _entry;
+};
 
-    std::atomic<bool> _destroyFlag{false};
-    std::mutex _mutex;
-    std::condition_variable _destroyConVar;
-    std::atomic<std::chrono::milliseconds> _interval;
-    std::atomic<TimePoint> _deadline;
-    std::thread _thread;
+//////////////////////////////////////////////////
+// SpscRing - Bounded lock-free queue between one producer and one consumer thread
+//
+// Neither side ever blocks or allocates, `TryPush` fails if the ring is full. Each side caches
+// the other side's index and only reloads it when the ring looks full or empty.
+//
+
+template <class T, size_t kCapacity>
+class SpscRing : NonCopyable
+{
+    static_assert(
+        kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0, "Capacity must be a power of two.");
 
-    inline void Thread(FnTrigger callback, bool immediatelyOnce)
+public:
+    // Producer only
+    inline bool TryPush(const T &value)
     {
-        if (immediatelyOnce) {
-            callback();
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _cachedTail == kCapacity) {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head - _cachedTail == kCapacity) {
+                return false;
+            }
         }
 
-        Reset();
+        _slots[head & kMask] = value;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
 
-        while (true) {
-            std::unique_lock<std::mutex> lock{_mutex};
-            {
-                _destroyConVar.wait_until(lock, _deadline.load());
-            }
-            lock.unlock();
+    // Consumer only, returns the number of elements written to `out`
+    inline size_t PopBatch(std::span<T> out)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (_cachedHead - tail < out.size()) {
+            _cachedHead = _head.load(std::memory_order_acquire);
+        }
 
-            if (_destroyFlag) {
-                break;
-            }
-            if (_deadline.load() > Clock::now()) {
-                continue;
+        const size_t count = std::min(out.size(), _cachedHead - tail);
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = _slots[(tail + i) & kMask];
+        }
+        _tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    static constexpr size_t kMask = kCapacity - 1;
+    // Keeps the indices of both sides apart, so they don't bounce the same cache line
+    static constexpr size_t kCacheLineSize = 64;
+
+    alignas(kCacheLineSize) std::atomic<size_t> _head{0};
+    size_t _cachedTail{0};
+
+    alignas(kCacheLineSize) std::atomic<size_t> _tail{0};
+    size_t _cachedHead{0};
+
+    alignas(kCacheLineSize) std::array<T, kCapacity> _slots{};
+};
+
+//////////////////////////////////////////////////
+// LatencyHistogram - Log-linear histogram of durations (HDR style)
+//
+// Each power of two is split into 32 linear buckets, so a value is reported within about 3% at
+// any magnitude, from a microsecond up to about an hour, in a fixed 7 KB. Not thread-safe.
+//
+
+class LatencyHistogram
+{
+public:
+    using Duration = std::chrono::microseconds;
+
+    inline void Record(std::chrono::nanoseconds value)
+    {
+        const uint64_t us = std::min<uint64_t>(
+            std::max<int64_t>(std::chrono::duration_cast<Duration>(value).count(), 0), kMaxValue);
+
+        ++_counts[IndexOf(us)];
+        _min = _count == 0 ? us : std::min(_min, us);
+        _max = std::max(_max, us);
+        _sum += us;
+        ++_count;
+    }
+
+    inline uint64_t GetCount() const
+    {
+        return _count;
+    }
+
+    inline Duration GetMin() const
+    {
+        return Duration{_min};
+    }
+
+    inline Duration GetMax() const
+    {
+        return Duration{_max};
+    }
+
+    inline Duration GetMean() const
+    {
+        return Duration{_count == 0 ? 0 : _sum / _count};
+    }
+
+    // Value `percentile` (0-100) percent of the recorded values are at or below, rounded up to
+    // the end of its bucket
+    inline Duration GetPercentile(double percentile) const
+    {
+        if (_count == 0) {
+            return Duration::zero();
+        }
+
+        const auto rank = std::max<uint64_t>(
+            static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(_count))), 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += _counts[i];
+            if (seen >= rank) {
+                return Duration{std::min(HighestOf(i), _max)};
             }
-            Reset();
-            callback();
         }
+        return Duration{_max};
+    }
+
+private:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr uint64_t kSubBucketCount = uint64_t{1} << kSubBucketBits;
+    static constexpr int kValueBits = 32;
+    static constexpr uint64_t kMaxValue = (uint64_t{1} << kValueBits) - 1;
+    static constexpr size_t kBucketCount = (kValueBits - kSubBucketBits + 1) * kSubBucketCount;
+
+    // Values below 64 get a bucket each, above that every power of two gets 32 buckets
+    static constexpr size_t IndexOf(uint64_t value)
+    {
+        const int width = static_cast<int>(std::bit_width(value));
+        const int shift = std::max(width - (kSubBucketBits + 1), 0);
+        return shift * kSubBucketCount + (value >> shift);
+    }
+
+    static constexpr uint64_t HighestOf(size_t index)
+    {
+        if (index < 2 * kSubBucketCount) {
+            return index;
+        }
+        const uint64_t shift = index / kSubBucketCount - 1;
+        const uint64_t top = index % kSubBucketCount + kSubBucketCount;
+        return ((top + 1) << shift) - 1;
     }
+
+    std::array<uint64_t, kBucketCount> _counts{};
+    uint64_t _count{0}, _sum{0}, _min{0}, _max{0};
 };
 } // namespace Helper
@@ -68,7 +68,16 @@ bool Initialize(bool enableTrace)
         spdlog::set_default_logger(logger);
 
         spdlog::set_level(enableTrace ? spdlog::level::trace : spdlog::level::info);
-        spdlog::flush_on(spdlog::level::trace);
+
+        // While debugging, a message must be on disk before whatever it leads up to happens
+        if (enableTrace) {
+            spdlog::flush_on(spdlog::level::trace);
+        }
+        else {
+            // The async backend flushes `LOG` once per batch, this covers direct `spdlog` calls
+            spdlog::flush_on(spdlog::level::err);
+            Details::AsyncBackend::Start(logger);
+        }
 
 #if defined APD_DEBUG
         spdlog::set_error_handler([](const std::string &msg) { Utils::Debug::BreakPoint(); });
@@ -81,6 +90,16 @@ bool Initialize(bool enableTrace)
     }
 }
 
+void Flush()
+{
+    if (auto *backend = Details::AsyncBackend::Get(); backend != nullptr) {
+        backend->Flush();
+    }
+    else {
+        spdlog::default_logger_raw()->flush();
+    }
+}
+
 // TODO: Remove this function in [v1.0.0]
 void CleanUpOldLogFiles()
 {
@@ -24,6 +24,8 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/fmt/ostr.h>
 
+#include "LoggerAsync.h"
+
 namespace Logger {
 
 namespace Details {
@@ -37,8 +39,8 @@ enum class Level : uint32_t {
     Critical,
 };
 
-template <Level level, class... Args>
-inline void Log(const spdlog::source_loc &srcloc, Args &&...args)
+template <Level level, class Format, class... Args>
+inline void Log(const spdlog::source_loc &srcloc, Format &&format, Args &&...args)
 {
     constexpr auto spdlogLevel = []() {
         if constexpr (level == Level::Trace) {
@@ -64,13 +66,31 @@ inline void Log(const spdlog::source_loc &srcloc, Args &&...args)
         }
     }();
 
-    spdlog::default_logger_raw()->log(srcloc, spdlogLevel, std::forward<Args>(args)...);
+    auto *logger = spdlog::default_logger_raw();
+    if (!logger->should_log(spdlogLevel)) {
+        return;
+    }
+
+    if (auto *backend = AsyncBackend::Get(); backend != nullptr) {
+        backend->Push(
+            srcloc, spdlogLevel, std::forward<Format>(format), std::forward<Args>(args)...);
+    }
+    else {
+        logger->log(
+            srcloc, spdlogLevel, UnwrapFormat(std::forward<Format>(format)),
+            std::forward<Args>(args)...);
+    }
 }
 
 } // namespace Details
 
+// Logs are written asynchronously from here on, unless tracing is enabled. Tracing is for
+// debugging, so then every message is written and flushed before `LOG` returns.
 bool Initialize(bool enableTrace);
 
+// Waits until everything logged so far is written to the log file
+void Flush();
+
 QDir GetLogFilePath();
 
 void CleanUpOldLogFiles();
@@ -83,6 +103,8 @@ inline OutStream &operator<<(OutStream &outStream, const QString &qstr)
     return outStream << qstr.toStdString().c_str();
 }
 
+// The first of the variadic arguments is the format, `FormatTag{} <<` only applies to it
 #define LOG(level, ...)                                                                            \
     Logger::Details::Log<Logger::Details::Level::level>(                                           \
-        spdlog::source_loc{__FILE__, __LINE__, SPDLOG_FUNCTION}, __VA_ARGS__)
+        spdlog::source_loc{__FILE__, __LINE__, SPDLOG_FUNCTION},                                   \
+        Logger::Details::FormatTag{} << __VA_ARGS__)
@@ -0,0 +1,175 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "LoggerAsync.h"
+
+namespace Logger::Details {
+
+AsyncBackend::AsyncBackend() : _records{std::make_unique<Record[]>(kCapacity)}
+{
+    for (size_t i = 0; i < kCapacity; ++i) {
+        _records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+AsyncBackend::~AsyncBackend()
+{
+    StopWriter();
+}
+
+AsyncBackend &AsyncBackend::GetInstance()
+{
+    static AsyncBackend instance;
+    return instance;
+}
+
+void AsyncBackend::Start(std::shared_ptr<spdlog::logger> logger)
+{
+    Stop();
+
+    auto &backend = GetInstance();
+    backend._logger = std::move(logger);
+    backend._stopRequested = false;
+    backend._writer = std::thread{&AsyncBackend::WriterThread, &backend};
+    _instance.store(&backend, std::memory_order_release);
+}
+
+void AsyncBackend::Stop()
+{
+    GetInstance().StopWriter();
+}
+
+void AsyncBackend::StopWriter()
+{
+    if (!_writer.joinable()) {
+        return;
+    }
+
+    // The writer drains the ring once more before it exits. A thread that loaded the instance
+    // just before may still push a record after that, it's only written if started again.
+    _instance.store(nullptr, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopRequested = true;
+    }
+    _writeConVar.notify_one();
+    _writer.join();
+    _logger.reset();
+}
+
+void AsyncBackend::Flush()
+{
+    const size_t target = _enqueuePos.load(std::memory_order_acquire);
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (_flushedPos >= target) {
+            return;
+        }
+    }
+
+    _writeRequested.store(true, std::memory_order_release);
+    std::unique_lock<std::mutex> lock{_mutex};
+    _writeConVar.notify_one();
+    _writtenConVar.wait_for(
+        lock, kFlushTimeout, [&] { return _flushedPos >= target || _stopRequested; });
+}
+
+void AsyncBackend::WriterThread()
+{
+    uint64_t reportedDrops = 0;
+
+    while (true) {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _writeConVar.wait_for(lock, kWriteInterval, [this] {
+                return _stopRequested || _writeRequested.load(std::memory_order_acquire);
+            });
+            _writeRequested.store(false, std::memory_order_release);
+            stop = _stopRequested;
+        }
+
+        bool written = WritePublished();
+
+        if (const uint64_t dropped = GetDroppedCount(); dropped != reportedDrops) {
+            _logger->log(
+                spdlog::level::warn,
+                fmt::format(
+                    "Logger: {} messages dropped, the queue was full.", dropped - reportedDrops));
+            reportedDrops = dropped;
+            written = true;
+        }
+
+        if (written) {
+            _logger->flush();
+        }
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _flushedPos = _dequeuePos.load(std::memory_order_relaxed);
+        }
+        _writtenConVar.notify_all();
+
+        if (stop) {
+            break;
+        }
+    }
+}
+
+bool AsyncBackend::WritePublished()
+{
+    size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+    const size_t first = pos;
+    spdlog::memory_buf_t message;
+
+    while (true) {
+        Record &record = _records[pos % kCapacity];
+        if (record.sequence.load(std::memory_order_acquire) != pos + 1) {
+            break;
+        }
+
+        spdlog::string_view_t text;
+        if (record.format != nullptr) {
+            message.clear();
+            try {
+                record.format(record, message);
+            }
+            catch (const std::exception &exception) {
+                message.clear();
+                fmt::format_to(
+                    std::back_inserter(message), "Failed to format log message '{}': {}",
+                    record.formatString, exception.what());
+            }
+            text = {message.data(), message.size()};
+        }
+        else if (record.longText != nullptr) {
+            text = *record.longText;
+        }
+        else {
+            text = {reinterpret_cast<const char *>(record.payload), record.size};
+        }
+
+        _logger->log(record.time, record.srcloc, record.level, text);
+
+        record.longText.reset();
+        record.sequence.store(pos + kCapacity, std::memory_order_release);
+        _dequeuePos.store(++pos, std::memory_order_relaxed);
+    }
+    return pos != first;
+}
+
+} // namespace Logger::Details
@@ -0,0 +1,343 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <new>
+#include <mutex>
+#include <tuple>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <iterator>
+#include <type_traits>
+#include <condition_variable>
+
+#include <spdlog/spdlog.h>
+
+#include "Helper.h"
+
+namespace Logger::Details {
+
+//////////////////////////////////////////////////
+// LiteralFormat - The format string of a `LOG` call, known to be a string literal
+//
+// `LOG` passes its format through `FormatTag{} << format`. A `const char` array can only become a
+// `LiteralFormat` if its address is a constant, i.e. a literal or a static array, which outlives
+// any record. Other formats (a `char` buffer, a `std::string`, a wide literal) pass through
+// unchanged. A local `const char` array doesn't compile as a format, copy it into a string.
+//
+
+struct LiteralFormat {
+    const char *text;
+};
+
+struct FormatTag {};
+
+template <size_t N>
+consteval LiteralFormat operator<<(FormatTag, const char (&text)[N])
+{
+    return LiteralFormat{text};
+}
+
+template <class FormatT>
+constexpr FormatT &&operator<<(FormatTag, FormatT &&format)
+{
+    return std::forward<FormatT>(format);
+}
+
+// What `spdlog` takes as a format
+template <class FormatT>
+constexpr decltype(auto) UnwrapFormat(FormatT &&format)
+{
+    if constexpr (std::is_same_v<std::remove_cvref_t<FormatT>, LiteralFormat>) {
+        return format.text;
+    }
+    else {
+        return std::forward<FormatT>(format);
+    }
+}
+
+//////////////////////////////////////////////////
+// AsyncBackend - Takes the writing of `LOG` off the logging threads
+//
+// Records are pushed into a bounded lock-free ring and written by a background thread, which
+// wakes up every `kWriteInterval` (or earlier for errors and when the ring fills up), writes
+// everything queued and flushes the sinks once per batch.
+//
+// A record with a `LiteralFormat` and only arithmetic arguments is stored binary, the pointer to
+// the literal and a copy of the arguments, and only formatted by the writer. Any other record is
+// formatted by the caller, as `spdlog` would.
+//
+// Pushing never blocks. A record that doesn't fit into a full ring is dropped and counted, unless
+// it's an error or critical. Those are written by the caller right away instead, ahead of the
+// records still queued.
+//
+
+class AsyncBackend : Helper::NonCopyable
+{
+public:
+    static constexpr size_t kCapacity = 1024;
+    static constexpr size_t kPayloadSize = 176;
+    static constexpr auto kWriteInterval = std::chrono::milliseconds(500);
+    // How long `Flush()` waits for the writer at most
+    static constexpr auto kFlushTimeout = std::chrono::seconds(1);
+
+    // Nullptr while `LOG` writes synchronously
+    static AsyncBackend *Get() noexcept
+    {
+        return _instance.load(std::memory_order_acquire);
+    }
+
+    // Writes the records of `LOG` to `logger` from now on. The sinks of `logger` are flushed by
+    // the writer, they shouldn't flush on every message themselves.
+    static void Start(std::shared_ptr<spdlog::logger> logger);
+    // Writes everything queued and returns to writing synchronously
+    static void Stop();
+
+    // Waits until everything queued before has been written and flushed
+    void Flush();
+
+    uint64_t GetDroppedCount() const
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    template <class FormatT, class... ArgsT>
+    void Push(
+        const spdlog::source_loc &srcloc, spdlog::level::level_enum level, FormatT &&format,
+        ArgsT &&...args)
+    {
+        const auto time = spdlog::log_clock::now();
+
+        if constexpr (IsDeferrable<FormatT, ArgsT...>()) {
+            using Arguments = std::tuple<std::decay_t<ArgsT>...>;
+            static_assert(std::is_trivially_destructible_v<Arguments>);
+
+            Record *record = Acquire();
+            if (record == nullptr) {
+                if (!Drop(level)) {
+                    spdlog::memory_buf_t text;
+                    FormatNow(text, format, args...);
+                    WriteNow(time, srcloc, level, text);
+                }
+                return;
+            }
+            ::new (static_cast<void *>(record->payload)) Arguments{std::forward<ArgsT>(args)...};
+            record->formatString = format.text;
+            record->format = &FormatDeferred<std::decay_t<ArgsT>...>;
+            Publish(*record, time, srcloc, level);
+        }
+        else {
+            // Formatted before a record is reserved, the writer waits for the records in order
+            spdlog::memory_buf_t text;
+            try {
+                FormatNow(text, std::forward<FormatT>(format), std::forward<ArgsT>(args)...);
+            }
+            catch (const std::exception &exception) {
+                text.clear();
+                FormatNow(text, "Failed to format a log message: {}", exception.what());
+            }
+
+            Record *record = Acquire();
+            if (record == nullptr) {
+                if (!Drop(level)) {
+                    WriteNow(time, srcloc, level, text);
+                }
+                return;
+            }
+            SetText(*record, {text.data(), text.size()});
+            Publish(*record, time, srcloc, level);
+        }
+    }
+
+private:
+    struct alignas(64) Record {
+        std::atomic<size_t> sequence;
+        spdlog::log_clock::time_point time;
+        spdlog::source_loc srcloc;
+        spdlog::level::level_enum level;
+        // Formats the payload into the message, nullptr if the payload is the message already
+        void (*format)(const Record &record, spdlog::memory_buf_t &out);
+        const char *formatString;
+        size_t size;
+        // Text of a message too long for the payload
+        std::unique_ptr<std::string> longText;
+        alignas(std::max_align_t) std::byte payload[kPayloadSize];
+    };
+
+    static inline std::atomic<AsyncBackend *> _instance{nullptr};
+
+    std::shared_ptr<spdlog::logger> _logger;
+    std::unique_ptr<Record[]> _records;
+    std::atomic<size_t> _enqueuePos{0};
+    std::atomic<size_t> _dequeuePos{0};
+    std::atomic<uint64_t> _dropped{0};
+
+    std::mutex _mutex;
+    std::condition_variable _writeConVar, _writtenConVar;
+    std::atomic<bool> _writeRequested{false};
+    bool _stopRequested{false};
+    // Records before this one are written and flushed
+    size_t _flushedPos{0};
+    std::thread _writer;
+
+    AsyncBackend();
+    ~AsyncBackend();
+
+    static AsyncBackend &GetInstance();
+    void StopWriter();
+
+    // Only a literal format outlives the record, any other is formatted eagerly
+    template <class FormatT, class... ArgsT>
+    static constexpr bool IsDeferrable()
+    {
+        if constexpr (
+            sizeof...(ArgsT) == 0 || !std::is_same_v<std::remove_cvref_t<FormatT>, LiteralFormat>)
+        {
+            return false;
+        }
+        else {
+            return (std::is_arithmetic_v<std::remove_cvref_t<ArgsT>> && ...) &&
+                   sizeof(std::tuple<std::decay_t<ArgsT>...>) <= kPayloadSize;
+        }
+    }
+
+    template <class... ArgsT>
+    static void FormatDeferred(const Record &record, spdlog::memory_buf_t &out)
+    {
+        const auto &arguments =
+            *std::launder(reinterpret_cast<const std::tuple<ArgsT...> *>(record.payload));
+        std::apply(
+            [&](const auto &...values) {
+                fmt::format_to(std::back_inserter(out), record.formatString, values...);
+            },
+            arguments);
+    }
+
+    // Same as `spdlog::logger::log()`, a message without arguments is written as is
+    template <class FormatT, class... ArgsT>
+    static void FormatNow(spdlog::memory_buf_t &out, FormatT &&format, ArgsT &&...args)
+    {
+        const auto &unwrapped = UnwrapFormat(format);
+        using Unwrapped = decltype(unwrapped);
+
+        if constexpr (sizeof...(ArgsT) != 0) {
+            fmt::format_to(std::back_inserter(out), unwrapped, std::forward<ArgsT>(args)...);
+        }
+        else if constexpr (std::is_convertible_v<Unwrapped, spdlog::string_view_t>) {
+            const spdlog::string_view_t text{unwrapped};
+            out.append(text.data(), text.data() + text.size());
+        }
+        else {
+            fmt::format_to(std::back_inserter(out), "{}", unwrapped);
+        }
+    }
+
+    // Whether a record that doesn't fit is dropped, an error or critical never is
+    bool Drop(spdlog::level::level_enum level)
+    {
+        if (level >= spdlog::level::err) {
+            return false;
+        }
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Writes past the ring, through the default logger which is the one `LOG` checked the level
+    // with. Its sinks flush on errors by themselves.
+    static void WriteNow(
+        spdlog::log_clock::time_point time, const spdlog::source_loc &srcloc,
+        spdlog::level::level_enum level, const spdlog::memory_buf_t &text)
+    {
+        spdlog::default_logger_raw()->log(
+            time, srcloc, level, spdlog::string_view_t{text.data(), text.size()});
+    }
+
+    static void SetText(Record &record, spdlog::string_view_t text)
+    {
+        record.format = nullptr;
+        record.size = text.size();
+        if (text.size() <= kPayloadSize) {
+            std::memcpy(record.payload, text.data(), text.size());
+        }
+        else {
+            record.longText = std::make_unique<std::string>(text.data(), text.size());
+        }
+    }
+
+    // Reserves the next record, nullptr if the ring is full
+    Record *Acquire()
+    {
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Record &record = _records[pos % kCapacity];
+            const size_t sequence = record.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+            if (diff == 0) {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return &record;
+                }
+            }
+            else if (diff < 0) {
+                return nullptr;
+            }
+            else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Publish(
+        Record &record, spdlog::log_clock::time_point time, const spdlog::source_loc &srcloc,
+        spdlog::level::level_enum level)
+    {
+        record.time = time;
+        record.srcloc = srcloc;
+        record.level = level;
+
+        const size_t pos = record.sequence.load(std::memory_order_relaxed);
+        record.sequence.store(pos + 1, std::memory_order_release);
+
+        // Errors are written right away, and the writer catches up before the ring overflows
+        const size_t dequeuePos = _dequeuePos.load(std::memory_order_relaxed);
+        const bool backlogged = pos >= dequeuePos && pos - dequeuePos >= kCapacity / 2;
+        if (level >= spdlog::level::err || backlogged) {
+            RequestWrite();
+        }
+    }
+
+    void RequestWrite()
+    {
+        if (!_writeRequested.exchange(true, std::memory_order_acq_rel)) {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _writeConVar.notify_one();
+        }
+    }
+
+    void WriterThread();
+    // Writes the published records, returns false if there were none
+    bool WritePublished();
+};
+
+} // namespace Logger::Details
@@ -0,0 +1,509 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// AAP simulator - Runs `AAP::Manager` against a simulated AirPods peer and measures
+//
+//   - Connection setup time, per handshake phase
+//   - Command round trip: `SetNoiseControlMode()` until the notification comes back
+//   - Sustained notification throughput of the configured streams, and the heap allocations the
+//     reader thread makes meanwhile, the run fails if there are any
+//
+// `--stats` dumps the manager's traffic statistics at the end.
+//
+// With `--replay` it runs the manager against a recorded capture instead, e.g. one taken from
+// real AirPods with `AAP::Manager::StartCapture()`, and measures how fast it is processed.
+//
+
+#include <atomic>
+#include <format>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include <cxxopts.hpp>
+#include <spdlog/spdlog.h>
+
+#include "SimulatedPeer.h"
+#include "../Common/Benchmark.h"
+#include "../Common/AllocationCounter.h"
+#include "../../Source/Core/AAPManager.h"
+
+#if !defined APD_OS_WIN
+    #include <sys/socket.h>
+#endif
+
+using namespace std::chrono_literals;
+using namespace Core::AAP;
+using namespace Tools::AAPSimulator;
+
+namespace {
+
+using Tools::Clock;
+
+struct Counters {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool connected{false};
+    std::optional<NoiseControlMode> noiseControl;
+    uint64_t noiseControlCount{0};
+    std::atomic<uint64_t> earDetection{0}, speakingLevel{0}, headTracking{0};
+};
+
+std::pair<std::unique_ptr<Transport>, std::unique_ptr<Transport>>
+CreateTransportPair(const std::string &kind)
+{
+    if (kind == "loopback") {
+        return LoopbackTransport::CreatePair();
+    }
+#if !defined APD_OS_WIN
+    if (kind == "socket") {
+        // A Unix datagram socket pair, exercising the same code path as an L2CAP socket
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0) {
+            throw std::runtime_error{std::format("socketpair failed: {}", errno)};
+        }
+        return {
+            std::make_unique<SocketTransport>(fds[0]), std::make_unique<SocketTransport>(fds[1])};
+    }
+#endif
+    throw std::runtime_error{std::format("Unsupported transport '{}'", kind)};
+}
+
+std::string Percentiles(std::vector<Clock::duration> samples)
+{
+    if (samples.empty()) {
+        return "no samples";
+    }
+    std::ranges::sort(samples);
+
+    const auto at = [&](double percentile) {
+        const auto index =
+            static_cast<size_t>(percentile * static_cast<double>(samples.size() - 1));
+        return std::chrono::duration<double, std::micro>{samples[index]}.count();
+    };
+    return std::format(
+        "min {:.1f} us, p50 {:.1f} us, p99 {:.1f} us, max {:.1f} us", at(0), at(0.5), at(0.99),
+        at(1));
+}
+
+std::string_view OpcodeName(uint8_t opcode)
+{
+    switch (static_cast<Opcode>(opcode)) {
+    case Opcode::Battery:
+        return "battery";
+    case Opcode::EarDetection:
+        return "ear detection";
+    case Opcode::Settings:
+        return "settings";
+    case Opcode::HeadTracking:
+        return "head tracking";
+    case Opcode::SpeakingLevel:
+        return "speaking level";
+    }
+    return "";
+}
+
+std::string_view SettingName(uint8_t setting)
+{
+    switch (static_cast<SettingId>(setting)) {
+    case SettingId::NoiseControl:
+        return "noise control";
+    case SettingId::AutomaticEarDetection:
+        return "automatic ear detection";
+    case SettingId::LoudSoundReduction:
+        return "loud sound reduction";
+    case SettingId::PersonalizedVolume:
+        return "personalized volume";
+    case SettingId::ConversationalAwareness:
+        return "conversational awareness";
+    case SettingId::AdaptiveNoise:
+        return "adaptive noise";
+    case SettingId::AdaptiveTransparencyLevel:
+        return "adaptive transparency";
+    }
+    return "";
+}
+
+void PrintTrafficStats(const TrafficStats &stats)
+{
+    const auto printCounter = [](std::string_view label, const TrafficCounter &counter) {
+        if (counter.packets != 0) {
+            std::cout << std::format(
+                             "    {:<36} {:>8} packets {:>10} bytes", label, counter.packets,
+                             counter.bytes)
+                      << std::endl;
+        }
+    };
+    const auto printDirection = [&](std::string_view name, const DirectionTrafficStats &direction) {
+        std::cout << std::format("  {}:", name) << std::endl;
+        for (size_t i = 0; i < direction.opcodes.size(); ++i) {
+            const auto opcode = static_cast<uint8_t>(i);
+            printCounter(
+                std::format("opcode 0x{:02X} {}", opcode, OpcodeName(opcode)),
+                direction.opcodes[i]);
+        }
+        for (size_t i = 0; i < direction.settings.size(); ++i) {
+            const auto setting = static_cast<uint8_t>(i);
+            printCounter(
+                std::format("setting 0x{:02X} {}", setting, SettingName(setting)),
+                direction.settings[i]);
+        }
+        printCounter("without header", direction.headerless);
+    };
+    const auto printHistogram = [](std::string_view name,
+                                   const Helper::LatencyHistogram &histogram) {
+        std::cout << std::format(
+                         "  {}: {} samples, min {} us, p50 {} us, p90 {} us, p99 {} us, max {} us",
+                         name, histogram.GetCount(), histogram.GetMin().count(),
+                         histogram.GetPercentile(50).count(), histogram.GetPercentile(90).count(),
+                         histogram.GetPercentile(99).count(), histogram.GetMax().count())
+                  << std::endl;
+    };
+
+    std::cout << "Traffic statistics:" << std::endl;
+    printDirection("received", stats.received);
+    printDirection("sent", stats.sent);
+    std::cout << std::format(
+                     "  unknown packets {}, send failures {}", stats.unknownPackets,
+                     stats.sendFailures)
+              << std::endl;
+    printHistogram("command latency", stats.commandLatency);
+    printHistogram("head tracking interval", stats.headTrackingInterval);
+}
+
+int RunReplay(const std::string &path, const std::string &speed, bool printStats)
+{
+    if (speed != "original" && speed != "unthrottled") {
+        throw std::runtime_error{std::format("Unsupported replay speed '{}'", speed)};
+    }
+
+    auto transport = ReplayTransport::Open(
+        path, speed == "original" ? ReplaySpeed::Original : ReplaySpeed::Unthrottled);
+    if (transport == nullptr) {
+        std::cerr << std::format("Failed to load capture '{}'.", path) << std::endl;
+        return 1;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool finished{false};
+
+    Callbacks callbacks;
+    callbacks.onDisconnected = [&] {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            finished = true;
+        }
+        cv.notify_all();
+    };
+
+    Manager manager;
+    manager.SetCallbacks(std::move(callbacks));
+
+    // Owned by the manager from here on, and alive until the replay has finished
+    const auto replay = transport.get();
+    if (!manager.Connect(std::move(transport))) {
+        std::cerr << "Failed to start the replay." << std::endl;
+        return 1;
+    }
+    // Head tracking frames are only recognized while the stream is on. The capture holds the
+    // command that turned it on, but replayed sends go nowhere.
+    manager.StartHeadTracking();
+
+    const auto start = Clock::now();
+    replay->Start();
+
+    // The ring isn't drained, frames beyond it are counted as dropped but processed all the same
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        cv.wait(lock, [&] { return finished; });
+    }
+    const auto elapsed = Clock::now() - start;
+
+    const auto stats = manager.GetReceiveStats();
+    std::cout << std::format(
+                     "Replayed {} packets ({} bytes) in {:.1f} ms, {:.0f} ns/packet",
+                     stats.packets, stats.bytes,
+                     std::chrono::duration<double, std::milli>{elapsed}.count(),
+                     std::chrono::duration<double, std::nano>{elapsed}.count() /
+                         static_cast<double>(std::max<uint64_t>(stats.packets, 1)))
+              << std::endl;
+
+    if (printStats) {
+        PrintTrafficStats(manager.GetTrafficStats());
+    }
+
+    manager.Disconnect();
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    cxxopts::Options parser{"AAPSimulator", "Benchmark AAP::Manager against a simulated peer"};
+
+    parser.add_options()                                                                     //
+        ("transport", "Transport between manager and peer. [loopback, socket]",              //
+         cxxopts::value<std::string>()->default_value("loopback"))                           //
+        ("rtt-iterations", "Number of noise control round trips to measure.",                //
+         cxxopts::value<uint32_t>()->default_value("1000"))                                  //
+        ("duration", "Seconds to stream notifications for the throughput measurement.",      //
+         cxxopts::value<double>()->default_value("5"))                                       //
+        ("noise-control-hz", "Noise control notification rate.",                             //
+         cxxopts::value<double>()->default_value("10"))                                      //
+        ("ear-detection-hz", "Ear detection notification rate.",                             //
+         cxxopts::value<double>()->default_value("10"))                                      //
+        ("speaking-level-hz", "Speaking level notification rate.",                           //
+         cxxopts::value<double>()->default_value("50"))                                      //
+        ("head-tracking-hz", "Head tracking frame rate.",                                    //
+         cxxopts::value<double>()->default_value("100"))                                     //
+        ("head-tracking-pull-ms", "Interval of the head tracking consumer pulling samples.", //
+         cxxopts::value<uint32_t>()->default_value("10"))                                    //
+        ("capture", "Record the simulated session into this capture file.",                  //
+         cxxopts::value<std::string>()->default_value(""))                                   //
+        ("replay", "Replay this capture file instead of simulating a peer.",                 //
+         cxxopts::value<std::string>()->default_value(""))                                   //
+        ("replay-speed", "Speed of the replay. [original, unthrottled]",                     //
+         cxxopts::value<std::string>()->default_value("unthrottled"))                        //
+        ("stats", "Dump the manager's traffic statistics at the end.",                       //
+         cxxopts::value<bool>()->default_value("false"))                                     //
+        ("verbose", "Keep the manager's info logging.",                                      //
+         cxxopts::value<bool>()->default_value("false"));
+
+    const auto options = Tools::ParseOptions(parser, argc, argv);
+    if (!options.has_value()) {
+        return 0;
+    }
+    const auto &args = options.value();
+
+    // Per-notification logging would dominate the throughput measurement
+    spdlog::set_level(args["verbose"].as<bool>() ? spdlog::level::info : spdlog::level::warn);
+
+    if (const auto replay = args["replay"].as<std::string>(); !replay.empty()) {
+        return RunReplay(
+            replay, args["replay-speed"].as<std::string>(), args["stats"].as<bool>());
+    }
+
+    auto [managerEnd, peerEnd] = CreateTransportPair(args["transport"].as<std::string>());
+
+    SimulatedPeer peer{std::move(peerEnd)};
+    peer.Start();
+
+    Counters counters;
+    Callbacks callbacks;
+    callbacks.onConnected = [&] {
+        // Invoked on the reader thread
+        Tools::CountAllocationsOfThisThread();
+        {
+            std::lock_guard<std::mutex> lock{counters.mutex};
+            counters.connected = true;
+        }
+        counters.cv.notify_all();
+    };
+    callbacks.onNoiseControlChanged = [&](NoiseControlMode mode) {
+        {
+            std::lock_guard<std::mutex> lock{counters.mutex};
+            counters.noiseControl = mode;
+            ++counters.noiseControlCount;
+        }
+        counters.cv.notify_all();
+    };
+    callbacks.onEarDetectionChanged = [&](EarStatus, EarStatus) { ++counters.earDetection; };
+    callbacks.onSpeakingLevelChanged = [&](SpeakingLevel) { ++counters.speakingLevel; };
+
+    Manager manager;
+    manager.SetCallbacks(std::move(callbacks));
+
+    const auto capture = args["capture"].as<std::string>();
+    if (!capture.empty() && !manager.StartCapture(capture)) {
+        std::cerr << std::format("Failed to create capture '{}'.", capture) << std::endl;
+        return 1;
+    }
+
+    auto start = Clock::now();
+    if (!manager.Connect(std::move(managerEnd))) {
+        std::cerr << "Failed to connect to the simulated peer." << std::endl;
+        return 1;
+    }
+    {
+        std::unique_lock<std::mutex> lock{counters.mutex};
+        if (!counters.cv.wait_for(lock, 5s, [&] { return counters.connected; })) {
+            std::cerr << "Timed out waiting for the connection to be set up." << std::endl;
+            return 1;
+        }
+    }
+    std::cout << std::format(
+                     "Connect: {:.1f} ms",
+                     std::chrono::duration<double, std::milli>{Clock::now() - start}.count())
+              << std::endl;
+
+    const auto handshake = manager.GetHandshakeStats();
+    for (size_t i = 0; i < handshake.phaseDurations.size(); ++i) {
+        std::cout << std::format(
+                         "  phase {}: {:.1f} ms ({})", i,
+                         std::chrono::duration<double, std::milli>{handshake.phaseDurations[i]}
+                             .count(),
+                         handshake.acknowledged[i] ? "answered" : "not answered")
+                  << std::endl;
+    }
+
+    // Command round trip
+    //
+    const auto iterations = args["rtt-iterations"].as<uint32_t>();
+    std::vector<Clock::duration> roundTrips;
+    roundTrips.reserve(iterations);
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        const auto mode =
+            i % 2 == 0 ? NoiseControlMode::Transparency : NoiseControlMode::NoiseCancellation;
+
+        std::unique_lock<std::mutex> lock{counters.mutex};
+        counters.noiseControl.reset();
+        lock.unlock();
+
+        start = Clock::now();
+        if (!manager.SetNoiseControlMode(mode)) {
+            std::cerr << "SetNoiseControlMode failed." << std::endl;
+            return 1;
+        }
+
+        lock.lock();
+        if (!counters.cv.wait_for(lock, 1s, [&] { return counters.noiseControl == mode; })) {
+            std::cerr << "Timed out waiting for the noise control notification." << std::endl;
+            return 1;
+        }
+        roundTrips.push_back(Clock::now() - start);
+    }
+    std::cout << std::format(
+                     "Noise control round trip ({}): {}", iterations, Percentiles(roundTrips))
+              << std::endl;
+
+    // Notification throughput
+    //
+    const StreamRates rates{
+        .noiseControl = args["noise-control-hz"].as<double>(),
+        .earDetection = args["ear-detection-hz"].as<double>(),
+        .speakingLevel = args["speaking-level-hz"].as<double>(),
+        .headTracking = args["head-tracking-hz"].as<double>(),
+    };
+    if (rates.headTracking > 0) {
+        manager.StartHeadTracking();
+    }
+
+    // Pulls head tracking samples at its own pace, like a UI would
+    std::atomic<bool> stopConsumer{false};
+    Clock::duration worstLatency{};
+    std::thread consumer{[&, interval = std::chrono::milliseconds{
+                                 args["head-tracking-pull-ms"].as<uint32_t>()}] {
+        std::array<HeadTrackingSample, 64> batch;
+        while (!stopConsumer) {
+            while (const size_t count = manager.PopHeadTrackingSamples(batch)) {
+                counters.headTracking += count;
+                worstLatency = std::max(worstLatency, Clock::now() - batch[0].timestamp);
+            }
+            std::this_thread::sleep_for(interval);
+        }
+    }};
+
+    const uint64_t noiseControlBefore = [&] {
+        std::lock_guard<std::mutex> lock{counters.mutex};
+        return counters.noiseControlCount;
+    }();
+    const uint64_t earDetectionBefore = counters.earDetection;
+    const uint64_t speakingLevelBefore = counters.speakingLevel;
+    const uint64_t headTrackingBefore = counters.headTracking;
+    const auto peerBefore = peer.GetStats();
+    const auto receivedBefore = manager.GetReceiveStats().packets;
+    const uint64_t allocationsBefore = Tools::GetAllocationCount();
+
+    start = Clock::now();
+    peer.SetStreamRates(rates);
+    std::this_thread::sleep_for(std::chrono::duration<double>{args["duration"].as<double>()});
+    peer.SetStreamRates({});
+    const double seconds = std::chrono::duration<double>{Clock::now() - start}.count();
+
+    // Let the manager drain what is still in flight
+    std::this_thread::sleep_for(100ms);
+    stopConsumer = true;
+    consumer.join();
+
+    const auto peerAfter = peer.GetStats();
+    const uint64_t noiseControl = [&] {
+        std::lock_guard<std::mutex> lock{counters.mutex};
+        return counters.noiseControlCount - noiseControlBefore;
+    }();
+    const auto received = manager.GetReceiveStats().packets - receivedBefore;
+    const uint64_t allocations = Tools::GetAllocationCount() - allocationsBefore;
+
+    const auto report = [&](std::string_view name, uint64_t sent, uint64_t delivered) {
+        std::cout << std::format(
+                         "  {:<14} sent {:>8} delivered {:>8} ({:.1f}/s)", name, sent, delivered,
+                         static_cast<double>(delivered) / seconds)
+                  << std::endl;
+    };
+    std::cout << std::format(
+                     "Throughput over {:.2f} s: {} packets received ({:.1f}/s)", seconds, received,
+                     static_cast<double>(received) / seconds)
+              << std::endl;
+    report(
+        "noise control", peerAfter.noiseControlSent - peerBefore.noiseControlSent, noiseControl);
+    report(
+        "ear detection", peerAfter.earDetectionSent - peerBefore.earDetectionSent,
+        counters.earDetection - earDetectionBefore);
+    report(
+        "speaking level", peerAfter.speakingLevelSent - peerBefore.speakingLevelSent,
+        counters.speakingLevel - speakingLevelBefore);
+    report(
+        "head tracking", peerAfter.headTrackingSent - peerBefore.headTrackingSent,
+        counters.headTracking - headTrackingBefore);
+
+    std::cout << std::format(
+                     "  head tracking dropped {}, worst sample age when pulled {:.1f} ms",
+                     manager.GetHeadTrackingDroppedCount(),
+                     std::chrono::duration<double, std::milli>{worstLatency}.count())
+              << std::endl;
+
+    std::cout << std::format(
+                     "  reader thread allocations {} ({:.3f}/packet), peer answered {} commands",
+                     allocations,
+                     static_cast<double>(allocations) /
+                         static_cast<double>(std::max<uint64_t>(received, 1)),
+                     peerAfter.commandsAnswered)
+              << std::endl;
+
+    if (!capture.empty()) {
+        manager.StopCapture();
+        std::cout << std::format("Captured the session to '{}'", capture) << std::endl;
+    }
+
+    manager.Disconnect();
+
+    // Only complete once the reader has exited
+    if (args["stats"].as<bool>()) {
+        PrintTrafficStats(manager.GetTrafficStats());
+    }
+    peer.Stop();
+
+    // The receive path must not allocate, a regression fails the run
+    if (allocations != 0) {
+        std::cerr << std::format("The reader thread allocated {} times", allocations) << std::endl;
+        return 1;
+    }
+    return 0;
+}
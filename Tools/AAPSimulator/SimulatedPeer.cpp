@@ -0,0 +1,309 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "SimulatedPeer.h"
+
+#include <array>
+#include <cmath>
+#include <chrono>
+#include <numbers>
+
+using namespace std::chrono_literals;
+using namespace Core::AAP;
+
+namespace Tools::AAPSimulator {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum Stream : size_t {
+    NoiseControlStream,
+    EarDetectionStream,
+    SpeakingLevelStream,
+    HeadTrackingStream,
+    StreamCount,
+};
+
+void WriteInt16LE(std::span<uint8_t> packet, size_t offset, int16_t value)
+{
+    packet[offset] = static_cast<uint8_t>(value & 0xFF);
+    packet[offset + 1] = static_cast<uint8_t>((value >> 8) & 0xFF);
+}
+
+} // namespace
+
+SimulatedPeer::SimulatedPeer(std::unique_ptr<Transport> transport)
+    : _transport{std::move(transport)}
+{
+}
+
+SimulatedPeer::~SimulatedPeer()
+{
+    Stop();
+}
+
+void SimulatedPeer::Start()
+{
+    _stop = false;
+    _receiveThread = std::thread{&SimulatedPeer::ReceiveLoop, this};
+    _streamThread = std::thread{&SimulatedPeer::StreamLoop, this};
+}
+
+void SimulatedPeer::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stop = true;
+    }
+    _streamCv.notify_all();
+    _transport->Wake();
+
+    if (_receiveThread.joinable()) {
+        _receiveThread.join();
+    }
+    if (_streamThread.joinable()) {
+        _streamThread.join();
+    }
+    _transport->Close();
+}
+
+void SimulatedPeer::SetStreamRates(const StreamRates &rates)
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _rates = rates;
+        _ratesChanged = true;
+    }
+    _streamCv.notify_all();
+}
+
+PeerStats SimulatedPeer::GetStats() const
+{
+    return PeerStats{
+        .received = _received,
+        .sent = _sent,
+        .commandsAnswered = _commandsAnswered,
+        .noiseControlSent = _noiseControlSent,
+        .earDetectionSent = _earDetectionSent,
+        .speakingLevelSent = _speakingLevelSent,
+        .headTrackingSent = _headTrackingSent,
+    };
+}
+
+bool SimulatedPeer::Send(std::span<const uint8_t> packet)
+{
+    if (!_transport->Send(packet)) {
+        return false;
+    }
+    _sent.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void SimulatedPeer::SendSetting(SettingId id, uint8_t value)
+{
+    // Notifications have the same layout as the commands
+    Send(Packets::BuildSettingPacket(id, value));
+}
+
+void SimulatedPeer::ReceiveLoop()
+{
+    std::array<uint8_t, 1024> buffer;
+
+    while (!_stop) {
+        const auto result = _transport->Receive(buffer);
+        if (result.status == ReceiveStatus::Data) {
+            _received.fetch_add(1, std::memory_order_relaxed);
+            OnPacket(std::span<const uint8_t>{buffer.data(), result.size});
+            continue;
+        }
+        if (result.status == ReceiveStatus::Closed || result.status == ReceiveStatus::Error) {
+            break;
+        }
+    }
+}
+
+void SimulatedPeer::OnPacket(std::span<const uint8_t> packet)
+{
+    // The handshake is the only packet without the regular header
+    if (std::ranges::equal(packet, Packets::Handshake)) {
+        // Report the ear state once the link is up
+        const std::array<uint8_t, 8> earDetection{
+            0x04, 0x00, 0x04, 0x00, Helper::ToUnderlying(Opcode::EarDetection), 0x00,
+            Helper::ToUnderlying(EarStatus::InEar), Helper::ToUnderlying(EarStatus::InEar)};
+        Send(earDetection);
+        return;
+    }
+
+    if (!HasHeader(packet)) {
+        return;
+    }
+
+    if (std::ranges::equal(packet, Packets::EnableFeatures)) {
+        SendSetting(
+            SettingId::ConversationalAwareness,
+            Helper::ToUnderlying(ConversationalAwarenessState::Enabled));
+        return;
+    }
+
+    if (std::ranges::equal(packet, Packets::RequestNotifications)) {
+        NoiseControlMode mode;
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _notificationsRequested = true;
+            _ratesChanged = true;
+            mode = _noiseControlMode;
+        }
+        _streamCv.notify_all();
+        SendSetting(SettingId::NoiseControl, Helper::ToUnderlying(mode));
+        return;
+    }
+
+    const auto opcode = packet[kOpcodeOffset];
+
+    // Settings commands are acknowledged by notifying the new value
+    if (opcode == Helper::ToUnderlying(Opcode::Settings) && packet.size() > kSettingValueOffset) {
+        const auto id = static_cast<SettingId>(packet[kSettingIdOffset]);
+        const auto value = packet[kSettingValueOffset];
+        if (id == SettingId::NoiseControl) {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _noiseControlMode = Decode::NoiseControl(value);
+        }
+        SendSetting(id, value);
+        _commandsAnswered.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // `StartHeadTracking` and `StopHeadTracking` differ at byte 10
+    if (opcode == Helper::ToUnderlying(Opcode::HeadTracking) && packet.size() > 10) {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _headTrackingActive = packet[10] == 0x10;
+            _ratesChanged = true;
+        }
+        _streamCv.notify_all();
+        _commandsAnswered.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SimulatedPeer::StreamLoop()
+{
+    std::array<Clock::time_point, StreamCount> due{};
+    std::array<Clock::duration, StreamCount> period{};
+    uint64_t frame = 0;
+
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    while (!_stop) {
+        if (_ratesChanged) {
+            _ratesChanged = false;
+
+            const auto toPeriod = [](double hz) {
+                return hz > 0 ? std::chrono::duration_cast<Clock::duration>(
+                                    std::chrono::duration<double>{1.0 / hz})
+                              : Clock::duration::zero();
+            };
+            period[NoiseControlStream] = toPeriod(_rates.noiseControl);
+            period[EarDetectionStream] = toPeriod(_rates.earDetection);
+            period[SpeakingLevelStream] = toPeriod(_rates.speakingLevel);
+            period[HeadTrackingStream] =
+                _headTrackingActive ? toPeriod(_rates.headTracking) : Clock::duration::zero();
+            due.fill(Clock::now());
+        }
+
+        std::optional<Clock::time_point> next;
+        if (_notificationsRequested) {
+            for (size_t i = 0; i < StreamCount; ++i) {
+                if (period[i] != Clock::duration::zero() && (!next || due[i] < *next)) {
+                    next = due[i];
+                }
+            }
+        }
+
+        const auto woken = [this] { return _stop || _ratesChanged; };
+        if (!next.has_value()) {
+            _streamCv.wait(lock, woken);
+            continue;
+        }
+        if (_streamCv.wait_until(lock, *next, woken)) {
+            continue;
+        }
+
+        const auto now = Clock::now();
+        lock.unlock();
+
+        for (size_t i = 0; i < StreamCount; ++i) {
+            if (period[i] == Clock::duration::zero() || due[i] > now) {
+                continue;
+            }
+
+            // Keep a fixed rate, but don't burst to catch up after a long stall
+            due[i] += period[i];
+            if (now - due[i] > period[i] * 16) {
+                due[i] = now + period[i];
+            }
+
+            switch (i) {
+            case NoiseControlStream: {
+                const auto mode = frame % 2 == 0 ? NoiseControlMode::Transparency
+                                                 : NoiseControlMode::NoiseCancellation;
+                SendSetting(SettingId::NoiseControl, Helper::ToUnderlying(mode));
+                _noiseControlSent.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            case EarDetectionStream: {
+                const auto status = frame % 2 == 0 ? EarStatus::InEar : EarStatus::OutOfEar;
+                const std::array<uint8_t, 8> packet{
+                    0x04, 0x00, 0x04, 0x00, Helper::ToUnderlying(Opcode::EarDetection), 0x00,
+                    Helper::ToUnderlying(status), Helper::ToUnderlying(EarStatus::InEar)};
+                Send(packet);
+                _earDetectionSent.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            case SpeakingLevelStream: {
+                const std::array<uint8_t, 10> packet{
+                    0x04, 0x00, 0x04, 0x00, Helper::ToUnderlying(Opcode::SpeakingLevel), 0x00,
+                    0x02, 0x00, 0x01, static_cast<uint8_t>(1 + frame % 9)};
+                Send(packet);
+                _speakingLevelSent.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            case HeadTrackingStream: {
+                std::array<uint8_t, kHeadTrackingPacketSize> packet{
+                    0x04, 0x00, 0x04, 0x00, Helper::ToUnderlying(Opcode::HeadTracking), 0x00};
+
+                // A slow head turn
+                const double phase = static_cast<double>(frame) * std::numbers::pi / 180.0;
+                WriteInt16LE(packet, 43, static_cast<int16_t>(std::sin(phase) * 4096));
+                WriteInt16LE(packet, 45, static_cast<int16_t>(std::cos(phase) * 4096));
+                WriteInt16LE(packet, 47, static_cast<int16_t>(std::sin(phase / 2) * 1024));
+                WriteInt16LE(packet, 51, static_cast<int16_t>(std::cos(phase * 2) * 256));
+                WriteInt16LE(packet, 53, static_cast<int16_t>(std::sin(phase * 2) * 256));
+                Send(packet);
+                _headTrackingSent.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            }
+        }
+        ++frame;
+
+        lock.lock();
+    }
+}
+
+} // namespace Tools::AAPSimulator
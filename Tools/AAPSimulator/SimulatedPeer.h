@@ -0,0 +1,99 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <cstdint>
+#include <condition_variable>
+
+#include "../../Source/Core/AAP.h"
+#include "../../Source/Core/AAPTransport.h"
+
+namespace Tools::AAPSimulator {
+
+//////////////////////////////////////////////////
+// SimulatedPeer - The AirPods side of an AAP connection
+//
+// Answers the setup sequence (`Handshake`, `EnableFeatures`, `RequestNotifications`), echoes
+// every settings command back as a notification like the AirPods do when a setting changes, and
+// emits streams of notifications at fixed rates. The replies model what the manager relies on,
+// not the exact traffic of real AirPods.
+//
+
+// Frames per second of each stream, 0 disables it
+struct StreamRates {
+    double noiseControl{0};
+    double earDetection{0};
+    double speakingLevel{0};
+    // Only emitted while head tracking has been started by the host
+    double headTracking{0};
+};
+
+struct PeerStats {
+    uint64_t received{0};
+    uint64_t sent{0};
+    uint64_t commandsAnswered{0};
+    uint64_t noiseControlSent{0};
+    uint64_t earDetectionSent{0};
+    uint64_t speakingLevelSent{0};
+    uint64_t headTrackingSent{0};
+};
+
+class SimulatedPeer : Helper::NonCopyable
+{
+public:
+    explicit SimulatedPeer(std::unique_ptr<Core::AAP::Transport> transport);
+    ~SimulatedPeer();
+
+    void Start();
+    void Stop();
+
+    void SetStreamRates(const StreamRates &rates);
+    PeerStats GetStats() const;
+
+private:
+    std::unique_ptr<Core::AAP::Transport> _transport;
+    std::thread _receiveThread, _streamThread;
+    std::atomic<bool> _stop{false};
+
+    mutable std::mutex _mutex;
+    std::condition_variable _streamCv;
+    StreamRates _rates;
+    bool _ratesChanged{false};
+    bool _notificationsRequested{false};
+    std::atomic<bool> _headTrackingActive{false};
+
+    Core::AAP::NoiseControlMode _noiseControlMode{Core::AAP::NoiseControlMode::NoiseCancellation};
+    std::atomic<uint64_t> _received{0}, _sent{0}, _commandsAnswered{0};
+    std::atomic<uint64_t> _noiseControlSent{0}, _earDetectionSent{0}, _speakingLevelSent{0},
+        _headTrackingSent{0};
+
+    bool Send(std::span<const uint8_t> packet);
+    void SendSetting(Core::AAP::SettingId id, uint8_t value);
+
+    void ReceiveLoop();
+    void StreamLoop();
+    void OnPacket(std::span<const uint8_t> packet);
+};
+
+} // namespace Tools::AAPSimulator
@@ -0,0 +1,201 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// Advertisement benchmark - Compares the way from the raw manufacturer data of an advertisement
+// to the decoded state
+//
+//   - With the received data as a map of vectors, as the watcher used to deliver it
+//   - With the received data in the inline `ManufacturerDataList`
+//
+// Both build the received data from the raw entries, keep two copies of it (the advertisement
+// and the state manager used to hold one each), look up the Apple entry and decode it. The
+// decoded states are checked against each other.
+//
+
+#include <map>
+#include <format>
+#include <vector>
+#include <iostream>
+#include <functional>
+
+#include <cxxopts.hpp>
+
+#include "../Common/Watcher.h"
+#include "../Common/Benchmark.h"
+#include "../../Source/Core/AppleCP.h"
+
+using namespace Core;
+
+namespace {
+
+using Tools::Clock;
+using ReceivedData = Tools::Watcher::ReceivedData;
+
+struct MapReceivedData {
+    int16_t rssi{};
+    Clock::time_point timestamp;
+    uint64_t address{};
+    std::map<uint16_t, std::vector<uint8_t>> manufacturerDataMap;
+};
+
+struct RawEntry {
+    uint16_t companyId;
+    std::vector<uint8_t> data;
+};
+
+struct RawAdvertisement {
+    int16_t rssi;
+    uint64_t address;
+    std::vector<RawEntry> entries;
+};
+
+// AirPods advertisements with random content, some of them with a second entry of another company
+std::vector<RawAdvertisement> GenerateAdvertisements(size_t count)
+{
+    Tools::Random random{0x1018};
+
+    std::vector<RawAdvertisement> advertisements(count);
+    for (auto &advertisement : advertisements) {
+        advertisement.rssi = -static_cast<int16_t>(random.Byte() % 100);
+        advertisement.address = (static_cast<uint64_t>(random.Byte()) << 40) | random.Byte();
+
+        std::vector<uint8_t> data(AppleCP::AirPods::kSize);
+        random.Fill(data);
+        data[AppleCP::kPacketTypeOffset] =
+            Helper::ToUnderlying(AppleCP::PacketType::ProximityPairing);
+        data[AppleCP::kRemainingLengthOffset] = AppleCP::AirPods::kSize - AppleCP::kHeaderSize;
+        advertisement.entries.push_back({AppleCP::VendorId, std::move(data)});
+
+        if (random.Byte() % 4 == 0) {
+            advertisement.entries.push_back({0x0006, {0x01, 0x09, 0x20, 0x02}});
+        }
+    }
+    return advertisements;
+}
+
+// What the state is made of, folded into a number to compare the results
+uint64_t DecodeState(std::span<const uint8_t> data)
+{
+    const auto protocol = AppleCP::AirPods::Parse(data);
+    if (!protocol.has_value()) {
+        return 0;
+    }
+
+    uint64_t state = Helper::ToUnderlying(protocol->GetModel());
+    for (const auto &battery :
+         {protocol->GetLeftBattery(), protocol->GetRightBattery(), protocol->GetCaseBattery()})
+    {
+        state = state * 31 + (battery.Available() ? battery.Value() + 1 : 0);
+    }
+    for (bool flag :
+         {protocol->IsLeftBroadcasted(), protocol->IsLeftCharging(), protocol->IsRightCharging(),
+          protocol->IsCaseCharging(), protocol->IsBothPodsInCase(), protocol->IsLidOpened(),
+          protocol->IsLeftInEar(), protocol->IsRightInEar()})
+    {
+        state = state * 2 + flag;
+    }
+    return state;
+}
+
+uint64_t RunMap(std::span<const RawAdvertisement> advertisements)
+{
+    uint64_t result = 0;
+    MapReceivedData kept;
+    for (const auto &raw : advertisements) {
+        MapReceivedData received;
+        received.rssi = raw.rssi;
+        received.timestamp = Clock::time_point{};
+        received.address = raw.address;
+        for (const auto &entry : raw.entries) {
+            received.manufacturerDataMap.try_emplace(
+                entry.companyId, std::vector<uint8_t>(entry.data.begin(), entry.data.end()));
+        }
+
+        const MapReceivedData advertisement = received;
+        const auto iter = advertisement.manufacturerDataMap.find(AppleCP::VendorId);
+        if (iter != advertisement.manufacturerDataMap.end()) {
+            result += DecodeState(iter->second);
+        }
+        kept = advertisement;
+    }
+    return result + kept.manufacturerDataMap.size();
+}
+
+uint64_t RunInline(std::span<const RawAdvertisement> advertisements)
+{
+    uint64_t result = 0;
+    ReceivedData kept;
+    for (const auto &raw : advertisements) {
+        ReceivedData received;
+        received.rssi = raw.rssi;
+        received.timestamp = Clock::time_point{};
+        received.address = raw.address;
+        for (const auto &entry : raw.entries) {
+            received.manufacturerData.Append(entry.companyId, entry.data);
+        }
+
+        const ReceivedData advertisement = received;
+        const auto data = advertisement.manufacturerData.Find(AppleCP::VendorId);
+        if (data.has_value()) {
+            result += DecodeState(data.value());
+        }
+        kept = advertisement;
+    }
+    return result + kept.manufacturerData.Size();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    cxxopts::Options parser{
+        "AdvertisementBenchmark", "Benchmark the way from an advertisement to the state"};
+
+    parser.add_options()                                                  //
+        ("advertisements", "Number of advertisements per run.",           //
+         cxxopts::value<uint32_t>()->default_value("100000"));
+    Tools::AddIterationsOption(parser, 50);
+
+    const auto options = Tools::ParseOptions(parser, argc, argv);
+    if (!options.has_value()) {
+        return 0;
+    }
+    const auto &args = options.value();
+
+    const size_t count = args["advertisements"].as<uint32_t>();
+    const uint32_t iterations = Tools::GetIterations(args);
+    const auto advertisements = GenerateAdvertisements(count);
+
+    uint64_t mapResult = 0, inlineResult = 0;
+    const double mapNs =
+        Tools::Measure([&] { mapResult = RunMap(advertisements); }, count, iterations);
+    const double inlineNs =
+        Tools::Measure([&] { inlineResult = RunInline(advertisements); }, count, iterations);
+
+    if (!Tools::Agree(mapResult, inlineResult, "Decoded states")) {
+        return 1;
+    }
+
+    std::cout << std::format(
+                     "{} advertisements, best of {} runs, received data is {} bytes:", count,
+                     iterations, sizeof(ReceivedData))
+              << std::endl;
+    Tools::Report("map of vectors", std::format("{:>8.2f} ns/adv", mapNs));
+    Tools::Report("inline", std::format("{:>8.2f} ns/adv ({:.2f}x)", inlineNs, mapNs / inlineNs));
+    return 0;
+}
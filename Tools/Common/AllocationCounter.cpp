@@ -0,0 +1,97 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "AllocationCounter.h"
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+namespace {
+
+thread_local bool tCountAllocations{false};
+std::atomic<uint64_t> gAllocations{0};
+
+void *Allocate(size_t size)
+{
+    if (tCountAllocations) {
+        gAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+// Not inlined into the `operator delete` overloads, so the compiler doesn't see `free()` being
+// called on a pointer of `operator new` and warn about a mismatch
+#if defined _MSC_VER
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+void Deallocate(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+} // namespace
+
+namespace Tools {
+
+void CountAllocationsOfThisThread(bool count)
+{
+    tCountAllocations = count;
+}
+
+uint64_t GetAllocationCount()
+{
+    return gAllocations.load(std::memory_order_relaxed);
+}
+
+} // namespace Tools
+
+void *operator new(size_t size)
+{
+    return Allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+    return Allocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    Deallocate(ptr);
+}
@@ -0,0 +1,35 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// Allocation counter - Replaces the global `operator new` and `operator delete` of the tool that
+// links `AllocationCounter.cpp`, and counts the heap allocations of the threads that ask for it
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace Tools {
+
+// Counts the allocations of the calling thread from now on, or stops counting them
+void CountAllocationsOfThisThread(bool count = true);
+
+// Allocations of all counted threads so far
+uint64_t GetAllocationCount();
+
+} // namespace Tools
@@ -0,0 +1,133 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// Benchmark helpers - Shared by the tools that time runs over a batch of generated items, check
+// that the ways they compare agree and report the cost per item
+//
+
+#pragma once
+
+#include <span>
+#include <random>
+#include <string>
+#include <chrono>
+#include <format>
+#include <cstdint>
+#include <optional>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <string_view>
+
+#include <cxxopts.hpp>
+
+namespace Tools {
+
+using Clock = std::chrono::steady_clock;
+
+// Nanoseconds per item
+inline double NsPer(Clock::duration duration, double count)
+{
+    return std::chrono::duration<double, std::nano>{duration}.count() / count;
+}
+
+// Best of `iterations` runs, in nanoseconds per item
+inline double Measure(const std::function<void()> &run, size_t count, uint32_t iterations)
+{
+    auto best = Clock::duration::max();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        const auto start = Clock::now();
+        run();
+        best = std::min(best, Clock::now() - start);
+    }
+    return NsPer(best, static_cast<double>(count));
+}
+
+// The number of runs `Measure()` takes the best of
+inline void AddIterationsOption(cxxopts::Options &parser, uint32_t defaultValue)
+{
+    parser.add_options()(
+        "iterations", "Number of runs, the best one is reported.",
+        cxxopts::value<uint32_t>()->default_value(std::to_string(defaultValue)));
+}
+
+inline uint32_t GetIterations(const cxxopts::ParseResult &args)
+{
+    return args["iterations"].as<uint32_t>();
+}
+
+// Adds the "help" option and parses the command line. `nullopt` once the help is printed, the
+// tool then exits.
+inline std::optional<cxxopts::ParseResult>
+ParseOptions(cxxopts::Options &parser, int argc, char *argv[])
+{
+    parser.add_options()("help", "Print options");
+
+    auto args = parser.parse(argc, argv);
+    if (args.count("help")) {
+        std::cout << parser.help() << std::endl;
+        return std::nullopt;
+    }
+    return args;
+}
+
+// Generates the input, the same on every run for a seed
+class Random
+{
+public:
+    explicit Random(uint32_t seed) : _engine{seed} {}
+
+    uint8_t Byte()
+    {
+        return static_cast<uint8_t>(_byte(_engine));
+    }
+
+    void Fill(std::span<uint8_t> bytes)
+    {
+        std::ranges::generate(bytes, [this] { return Byte(); });
+    }
+
+    // For other distributions
+    std::mt19937 &Engine()
+    {
+        return _engine;
+    }
+
+private:
+    std::mt19937 _engine;
+    std::uniform_int_distribution<uint32_t> _byte{0, 0xFF};
+};
+
+// Reports the results of the ways compared being different, returns whether they agree
+template <class T>
+inline bool Agree(const T &lhs, const T &rhs, std::string_view what)
+{
+    if (!(lhs == rhs)) {
+        std::cerr << std::format("{} disagree.", what) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// A line of the report, the results aligned after the name
+inline void Report(std::string_view name, std::string_view results)
+{
+    std::cout << std::format("  {:<16} {}", name, results) << std::endl;
+}
+
+} // namespace Tools
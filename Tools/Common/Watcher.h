@@ -0,0 +1,46 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// Watcher - An advertisement watcher that doesn't watch, for the tools that need its types or feed
+// it advertisements themselves
+//
+
+#pragma once
+
+#include "Benchmark.h"
+#include "../../Source/Core/Bluetooth_abstract.h"
+
+namespace Tools {
+
+class Watcher final
+    : public Core::Bluetooth::Details::AdvertisementWatcherAbstract<Watcher>
+{
+public:
+    using Timestamp = Clock::time_point;
+
+    bool Start() override
+    {
+        return true;
+    }
+    bool Stop() override
+    {
+        return true;
+    }
+};
+
+} // namespace Tools
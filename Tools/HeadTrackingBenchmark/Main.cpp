@@ -0,0 +1,234 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// Head tracking benchmark - Compares decoding a block of head tracking frames
+//
+//   - Per frame, through `ParseHeadTrackingData()` as the manager does for live frames
+//   - Batched, with the portable scalar decoder
+//   - Batched, with the SIMD decoder (if the target has one)
+//
+// All of them write the same structure of arrays and are checked against each other.
+//
+// Also measures what the consumer of the samples spends per sample on the orientation filter and
+// the gesture detector, and checks that a synthetic nod and shake are recognized.
+//
+
+#include <cmath>
+#include <random>
+#include <format>
+#include <vector>
+#include <iostream>
+#include <functional>
+
+#include <cxxopts.hpp>
+
+#include "../Common/Benchmark.h"
+#include "../../Source/Core/AAPHeadTracking.h"
+
+using namespace Core::AAP;
+
+namespace {
+
+using Tools::Clock;
+
+struct Columns {
+    explicit Columns(size_t count)
+        : orientation1(count), orientation2(count), orientation3(count),
+          horizontalAcceleration(count), verticalAcceleration(count)
+    {
+    }
+
+    HeadTrackingColumns View()
+    {
+        return {
+            orientation1, orientation2, orientation3, horizontalAcceleration,
+            verticalAcceleration};
+    }
+
+    bool operator==(const Columns &) const = default;
+
+    std::vector<int16_t> orientation1, orientation2, orientation3, horizontalAcceleration,
+        verticalAcceleration;
+};
+
+std::vector<uint8_t> GenerateFrames(size_t count)
+{
+    Tools::Random random{0x1001};
+
+    std::vector<uint8_t> frames(count * kHeadTrackingPacketSize);
+    for (size_t i = 0; i < count; ++i) {
+        const auto frame = std::span{frames}.subspan(i * kHeadTrackingPacketSize);
+        std::ranges::copy(
+            std::array<uint8_t, 6>{
+                0x04, 0x00, 0x04, 0x00, Helper::ToUnderlying(Opcode::HeadTracking), 0x00},
+            frame.begin());
+        random.Fill(frame.subspan(kHeaderSize, kHeadTrackingPacketSize - kHeaderSize));
+    }
+    return frames;
+}
+
+void ParsePerFrame(std::span<const uint8_t> frames, const HeadTrackingColumns &out)
+{
+    const size_t count = frames.size() / kHeadTrackingPacketSize;
+    for (size_t i = 0; i < count; ++i) {
+        const auto data = ParseHeadTrackingData(
+            frames.subspan(i * kHeadTrackingPacketSize, kHeadTrackingPacketSize));
+        out.orientation1[i] = data->orientation1;
+        out.orientation2[i] = data->orientation2;
+        out.orientation3[i] = data->orientation3;
+        out.horizontalAcceleration[i] = data->horizontalAcceleration;
+        out.verticalAcceleration[i] = data->verticalAcceleration;
+    }
+}
+
+// A 100 Hz stream: the head resting with a little jitter, a nod, resting, a shake, resting
+std::vector<HeadTrackingSample> GenerateGestureTrace()
+{
+    constexpr auto kInterval = std::chrono::milliseconds(10);
+    constexpr double kPi = 3.14159265358979323846;
+
+    Tools::Random random{0x1013};
+    std::normal_distribution<double> jitter{0.0, 0.5};
+
+    std::vector<HeadTrackingSample> samples;
+    auto timestamp = Clock::time_point{} + std::chrono::seconds(1);
+    const auto append = [&](double yaw, double pitch) {
+        const auto raw = [&](double degrees) {
+            return static_cast<int16_t>(std::lround((degrees + jitter(random.Engine())) * 32768.0 / 180.0));
+        };
+        samples.push_back(
+            {.data =
+                 {
+                     .orientation1 = raw(yaw),
+                     .orientation2 = raw(pitch),
+                     .orientation3 = raw(0),
+                     .horizontalAcceleration = 0,
+                     .verticalAcceleration = 0,
+                 },
+             .timestamp = timestamp,
+             .dropped = 0});
+        timestamp += kInterval;
+    };
+    const auto rest = [&](size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            append(30, -5);
+        }
+    };
+    // One and a half periods of 2 Hz, down-up-down or left-right-left
+    const auto swing = [&](bool pitch) {
+        for (size_t i = 0; i < 75; ++i) {
+            const double offset = 20.0 * std::sin(2.0 * kPi * 2.0 * static_cast<double>(i) / 100.0);
+            append(pitch ? 30 : 30 + offset, pitch ? -5 + offset : -5);
+        }
+    };
+
+    rest(150);
+    swing(true);
+    rest(150);
+    swing(false);
+    rest(150);
+    return samples;
+}
+
+// Runs the samples through the filter and the detector like `AirPods::Manager` does
+std::vector<HeadGesture> DetectGestures(std::span<const HeadTrackingSample> samples)
+{
+    HeadOrientationFilter filter;
+    HeadGestureDetector detector;
+    std::vector<HeadGesture> gestures;
+    for (const auto &sample : samples) {
+        filter.Update(sample);
+        if (const auto gesture = detector.Update(filter.Current()); gesture.has_value()) {
+            gestures.push_back(*gesture);
+        }
+    }
+    return gestures;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    cxxopts::Options parser{
+        "HeadTrackingBenchmark", "Benchmark decoding blocks of head tracking frames"};
+
+    parser.add_options()                                                  //
+        ("frames", "Number of frames per block.",                         //
+         cxxopts::value<uint32_t>()->default_value("100000"));
+    Tools::AddIterationsOption(parser, 50);
+
+    const auto options = Tools::ParseOptions(parser, argc, argv);
+    if (!options.has_value()) {
+        return 0;
+    }
+    const auto &args = options.value();
+
+    const size_t frameCount = args["frames"].as<uint32_t>();
+    const uint32_t iterations = Tools::GetIterations(args);
+    const auto frames = GenerateFrames(frameCount);
+
+    Columns perFrame{frameCount}, scalar{frameCount}, batch{frameCount};
+
+    const double perFrameNs =
+        Tools::Measure([&] { ParsePerFrame(frames, perFrame.View()); }, frameCount, iterations);
+    const double scalarNs = Tools::Measure(
+        [&] { DecodeHeadTrackingFramesScalar(frames, scalar.View()); }, frameCount, iterations);
+    const double batchNs = Tools::Measure(
+        [&] { DecodeHeadTrackingFrames(frames, batch.View()); }, frameCount, iterations);
+
+    if (!Tools::Agree(perFrame, scalar, "Decoders") ||
+        !Tools::Agree(perFrame, batch, "Decoders")) {
+        return 1;
+    }
+
+    // Repeat the trace to the requested length, keeping the timestamps going up
+    const auto trace = GenerateGestureTrace();
+    std::vector<HeadTrackingSample> samples;
+    samples.reserve(frameCount);
+    for (size_t i = 0; samples.size() < frameCount; ++i) {
+        const auto shift = (trace.back().timestamp - trace.front().timestamp) * i;
+        for (size_t j = 0; j < trace.size() && samples.size() < frameCount; ++j) {
+            samples.push_back(trace[j]);
+            samples.back().timestamp += shift;
+        }
+    }
+
+    size_t gestureCount = 0;
+    const double gestureNs = Tools::Measure(
+        [&] { gestureCount = DetectGestures(samples).size(); }, samples.size(), iterations);
+
+    const auto detected = DetectGestures(trace);
+    if (detected != std::vector{HeadGesture::Nod, HeadGesture::Shake}) {
+        std::cerr << std::format("Expected a nod and a shake, detected {} gestures.", detected.size())
+                  << std::endl;
+        return 1;
+    }
+
+    const auto report = [&](std::string_view name, double ns) {
+        Tools::Report(name, std::format("{:>8.2f} ns/frame ({:.2f}x)", ns, perFrameNs / ns));
+    };
+    std::cout << std::format("{} frames, best of {} runs:", frameCount, iterations) << std::endl;
+    report("per frame", perFrameNs);
+    report("batch scalar", scalarNs);
+    report("batch", batchNs);
+    Tools::Report(
+        "filter+gestures", std::format(
+                               "{:>8.2f} ns/sample, {:.4f}% of a core at 100 Hz ({} gestures)",
+                               gestureNs, gestureNs * 100.0 / 1e9 * 100.0, gestureCount));
+    return 0;
+}
@@ -0,0 +1,204 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// Logger benchmark - Compares what a `LOG` call costs the logging thread
+//
+//   - Written synchronously and flushed on every message, as `Logger::Initialize` used to set up
+//   - Pushed to the async backend
+//
+// With a message of numeric arguments (stored binary by the async backend) and one with a string
+// argument (formatted by the caller). Messages are logged in bursts, like the reader thread and
+// the BLE callbacks do, and written to a file that is checked to have all of them afterwards.
+//
+// Also overflows the ring of the async backend with info messages and errors in between, and
+// checks that only info messages were dropped.
+//
+
+#include <format>
+#include <string>
+#include <fstream>
+#include <optional>
+#include <string_view>
+#include <iostream>
+#include <filesystem>
+#include <functional>
+
+#include <cxxopts.hpp>
+#include <spdlog/sinks/basic_file_sink.h>
+
+#include "../Common/Benchmark.h"
+#include "../../Source/Logger.h"
+
+namespace {
+
+using Tools::Clock;
+
+struct Scenario {
+    std::string path;
+    uint32_t bursts;
+    uint32_t burstSize;
+};
+
+size_t CountLines(const std::string &path, std::string_view containing = {})
+{
+    std::ifstream file{path};
+    size_t count = 0;
+    for (std::string line; std::getline(file, line);) {
+        count += line.find(containing) != std::string::npos;
+    }
+    return count;
+}
+
+// Average cost of a `LOG` call in nanoseconds, the writing between the bursts isn't timed
+double Measure(
+    const Scenario &scenario, bool async, const std::function<void(uint32_t)> &log,
+    bool &complete)
+{
+    auto logger = std::make_shared<spdlog::logger>(
+        "Benchmark", std::make_shared<spdlog::sinks::basic_file_sink_mt>(scenario.path, true));
+    spdlog::set_default_logger(logger);
+    spdlog::set_level(spdlog::level::info);
+    if (async) {
+        spdlog::flush_on(spdlog::level::err);
+        Logger::Details::AsyncBackend::Start(logger);
+    }
+    else {
+        spdlog::flush_on(spdlog::level::trace);
+    }
+
+    auto total = Clock::duration::zero();
+    for (uint32_t burst = 0; burst < scenario.bursts; ++burst) {
+        const auto start = Clock::now();
+        for (uint32_t i = 0; i < scenario.burstSize; ++i) {
+            log(burst * scenario.burstSize + i);
+        }
+        total += Clock::now() - start;
+        if (auto *backend = Logger::Details::AsyncBackend::Get(); backend != nullptr) {
+            backend->Flush();
+        }
+    }
+
+    Logger::Details::AsyncBackend::Stop();
+    spdlog::drop_all();
+    logger.reset();
+
+    complete = CountLines(scenario.path) == size_t{scenario.bursts} * scenario.burstSize;
+    return Tools::NsPer(total, static_cast<double>(scenario.bursts) * scenario.burstSize);
+}
+
+// Logs several times the capacity of the ring at once, every 16th message an error. Returns the
+// number of messages dropped, or nullopt if an error is missing from the file.
+std::optional<uint64_t> Overflow(const std::string &path)
+{
+    constexpr uint32_t kMessages = Logger::Details::AsyncBackend::kCapacity * 8;
+    constexpr uint32_t kErrorEvery = 16;
+
+    auto logger = std::make_shared<spdlog::logger>(
+        "Benchmark", std::make_shared<spdlog::sinks::basic_file_sink_mt>(path, true));
+    spdlog::set_default_logger(logger);
+    spdlog::set_level(spdlog::level::info);
+    spdlog::flush_on(spdlog::level::err);
+    Logger::Details::AsyncBackend::Start(logger);
+
+    for (uint32_t i = 0; i < kMessages; ++i) {
+        if (i % kErrorEvery == 0) {
+            LOG(Error, "Overflow error {}", i);
+        }
+        else {
+            LOG(Info, "Overflow info {}", i);
+        }
+    }
+    const uint64_t dropped = Logger::Details::AsyncBackend::Get()->GetDroppedCount();
+
+    Logger::Details::AsyncBackend::Stop();
+    spdlog::drop_all();
+    logger.reset();
+
+    if (CountLines(path, "Overflow error") != kMessages / kErrorEvery) {
+        return std::nullopt;
+    }
+    return dropped;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    cxxopts::Options parser{"LoggerBenchmark", "Benchmark the cost of LOG calls"};
+
+    parser.add_options()                                                  //
+        ("bursts", "Number of bursts.",                                   //
+         cxxopts::value<uint32_t>()->default_value("200"))                //
+        ("burst-size", "Messages per burst.",                             //
+         cxxopts::value<uint32_t>()->default_value("256"));
+
+    const auto options = Tools::ParseOptions(parser, argc, argv);
+    if (!options.has_value()) {
+        return 0;
+    }
+    const auto &args = options.value();
+
+    const Scenario scenario{
+        .path = (std::filesystem::temp_directory_path() / "LoggerBenchmark.log").string(),
+        .bursts = args["bursts"].as<uint32_t>(),
+        .burstSize = std::min<uint32_t>(
+            args["burst-size"].as<uint32_t>(), Logger::Details::AsyncBackend::kCapacity / 2),
+    };
+
+    const auto numeric = [](uint32_t i) {
+        LOG(Info, "Advertisement received, rssi: {}, address: {:012X}, in range: {}",
+            -static_cast<int32_t>(i % 100), uint64_t{0x1C5CF2000000} + i, i % 3 != 0);
+    };
+    const auto text = [](uint32_t i) {
+        LOG(Info, "AAP: Noise control mode changed to {} ({})",
+            i % 2 == 0 ? std::string{"Transparency"} : std::string{"NoiseCancellation"}, i);
+    };
+
+    bool ok = true;
+    const auto report = [&](std::string_view name, const std::function<void(uint32_t)> &log) {
+        bool syncComplete = false, asyncComplete = false;
+        const double syncNs = Measure(scenario, false, log, syncComplete);
+        const double asyncNs = Measure(scenario, true, log, asyncComplete);
+        Tools::Report(
+            name, std::format(
+                      "sync {:>8.1f} ns/call, async {:>6.1f} ns/call ({:.1f}x)", syncNs, asyncNs,
+                      syncNs / asyncNs));
+        ok = ok && syncComplete && asyncComplete;
+    };
+
+    std::cout << std::format(
+                     "{} bursts of {} messages to '{}':", scenario.bursts, scenario.burstSize,
+                     scenario.path)
+              << std::endl;
+    report("numeric", numeric);
+    report("string", text);
+
+    const auto dropped = Overflow(scenario.path);
+    std::filesystem::remove(scenario.path);
+
+    if (!ok) {
+        std::cerr << "Messages are missing from the log file." << std::endl;
+        return 1;
+    }
+    if (!dropped.has_value()) {
+        std::cerr << "Errors were dropped from the full queue." << std::endl;
+        return 1;
+    }
+    Tools::Report("overflow", std::format("{} info messages dropped, no errors", dropped.value()));
+    return 0;
+}
@@ -0,0 +1,195 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// RSSI filter check - Checks the filter the state manager runs on the RSSI of every advertisement
+//
+//   - A rising RSSI is followed with the median of the last three samples
+//   - A single outlier in either direction is rejected by the median
+//   - The threshold comparator passes at the threshold and keeps passing until the value drops
+//     the hysteresis below it
+//   - A gap longer than `maxGap` restarts the filter at the new sample
+//
+// The checks use a time constant short enough for the low-pass to settle on every sample, so the
+// value is the median. Then the cost of a sample is measured.
+//
+
+#include <cmath>
+#include <random>
+#include <format>
+#include <vector>
+#include <iostream>
+#include <string_view>
+
+#include <cxxopts.hpp>
+
+#include "../Common/Benchmark.h"
+#include "../../Source/Core/RssiFilter.h"
+
+using namespace std::chrono_literals;
+using Core::AirPods::Details::RssiFilter;
+
+namespace {
+
+// Feeds samples 100 ms apart (or `gap` after the previous one)
+class Feeder
+{
+public:
+    Feeder() : _filter{RssiFilter::Config{.timeConstant = 1ms}} {}
+
+    RssiFilter &operator()(int16_t rssi, std::chrono::milliseconds gap = 100ms)
+    {
+        _now += gap;
+        _filter.Update(rssi, _now);
+        return _filter;
+    }
+
+    // Enough samples of `rssi` for the median to be `rssi`
+    RssiFilter &Settle(int16_t rssi)
+    {
+        for (size_t i = 0; i < 3; ++i) {
+            (*this)(rssi);
+        }
+        return _filter;
+    }
+
+private:
+    RssiFilter _filter;
+    RssiFilter::Timestamp _now;
+};
+
+bool ExpectValue(std::string_view check, const RssiFilter &filter, float expected)
+{
+    if (std::abs(filter.Value() - expected) <= 0.01f) {
+        return true;
+    }
+    std::cerr << std::format("{}: at {} dBm, expected {}", check, filter.Value(), expected)
+              << std::endl;
+    return false;
+}
+
+bool ExpectPassing(std::string_view check, RssiFilter &filter, float threshold, bool expected)
+{
+    if (filter.PassesThreshold(threshold) == expected) {
+        return true;
+    }
+    std::cerr << std::format(
+                     "{}: at {} dBm {} the threshold {}, expected otherwise", check,
+                     filter.Value(), expected ? "fails" : "passes", threshold)
+              << std::endl;
+    return false;
+}
+
+// Rising by 5 dB per sample: the first sample, then the mean of the first two, then always the
+// previous sample
+bool CheckMedian()
+{
+    Feeder feed;
+    for (int16_t i = 0, rssi = -90; rssi <= -40; ++i, rssi += 5) {
+        const float expected = i == 0 ? rssi : i == 1 ? rssi - 2.5f : rssi - 5.0f;
+        if (!ExpectValue("Rising RSSI", feed(rssi), expected)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CheckOutlier()
+{
+    Feeder feed;
+    feed.Settle(-60);
+    // One spike up and one down don't move it, a level that holds does within two samples
+    return ExpectValue("Spike up", feed(-30), -60) && ExpectValue("After spike", feed(-60), -60) &&
+           ExpectValue("Spike down", feed(-95), -60) &&
+           ExpectValue("After spike", feed(-60), -60) && ExpectValue("New level", feed(-40), -60) &&
+           ExpectValue("New level", feed(-40), -40);
+}
+
+bool CheckHysteresis()
+{
+    constexpr float kThreshold = -70;
+
+    Feeder feed;
+    // Default hysteresis of 6 dB
+    return ExpectPassing("Below", feed.Settle(-75), kThreshold, false) &&
+           ExpectPassing("At the threshold", feed.Settle(-70), kThreshold, true) &&
+           ExpectPassing("Within the hysteresis", feed.Settle(-74), kThreshold, true) &&
+           ExpectPassing("At the hysteresis", feed.Settle(-76), kThreshold, true) &&
+           ExpectPassing("Past the hysteresis", feed.Settle(-77), kThreshold, false) &&
+           ExpectPassing("Back within the hysteresis", feed.Settle(-72), kThreshold, false) &&
+           ExpectPassing("At the threshold again", feed.Settle(-70), kThreshold, true);
+}
+
+bool CheckGap()
+{
+    Feeder feed;
+    feed.Settle(-60);
+    return ExpectValue("After a gap", feed(-80, 6s), -80);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    cxxopts::Options parser{"RssiFilterCheck", "Check and benchmark the RSSI filter"};
+
+    parser.add_options()                                                  //
+        ("samples", "Number of samples per run.",                         //
+         cxxopts::value<uint32_t>()->default_value("100000"));
+    Tools::AddIterationsOption(parser, 50);
+
+    const auto options = Tools::ParseOptions(parser, argc, argv);
+    if (!options.has_value()) {
+        return 0;
+    }
+    const auto &args = options.value();
+
+    if (!CheckMedian() || !CheckOutlier() || !CheckHysteresis() || !CheckGap()) {
+        return 1;
+    }
+
+    const size_t count = args["samples"].as<uint32_t>();
+    const uint32_t iterations = Tools::GetIterations(args);
+
+    // About 10 advertisements a second around -60 dBm
+    Tools::Random random{0x1020};
+    std::normal_distribution<double> noise{-60.0, 8.0};
+    std::vector<int16_t> samples;
+    for (size_t i = 0; i < count; ++i) {
+        samples.push_back(static_cast<int16_t>(std::lround(noise(random.Engine()))));
+    }
+
+    uint32_t passing = 0;
+    const double ns = Tools::Measure(
+        [&] {
+            RssiFilter filter;
+            RssiFilter::Timestamp now;
+            passing = 0;
+            for (const int16_t rssi : samples) {
+                now += 100ms;
+                filter.Update(rssi, now);
+                passing += filter.PassesThreshold(-60);
+            }
+        },
+        count, iterations);
+
+    std::cout << std::format(
+                     "Checks passed. {} samples, best of {} runs: {:.2f} ns/sample ({} passing)",
+                     count, iterations, ns, passing)
+              << std::endl;
+    return 0;
+}
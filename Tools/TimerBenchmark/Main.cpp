@@ -0,0 +1,470 @@
+//
+// AirPodsWindows - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// Timer benchmark - Compares timeouts that keep being pushed back, like the state manager's on
+// every advertisement
+//
+//   - With a thread per timer, as `Helper::Timer` worked at first
+//   - With the shared scheduler keeping the timers in a binary min-heap, as `Helper::Timer` worked
+//     next
+//   - With `Helper::Timer` on the shared timing wheel
+//
+// Counts the thread wakeups while the timers are re-armed at a fixed rate, checks that none of
+// them fires meanwhile and that all of them fire once the re-arming stops. The first two still
+// wake at the old deadline of a timer pushed back, these wakeups are counted apart as stale. The
+// wheel moves its alarm instead and shouldn't have any. Also measures what a single re-arm costs
+// the caller.
+//
+
+#include <memory>
+#include <format>
+#include <vector>
+#include <iostream>
+#include <functional>
+
+#include <cxxopts.hpp>
+
+#include "../Common/Benchmark.h"
+#include "../../Source/Helper.h"
+
+namespace {
+
+using Tools::Clock;
+
+struct Wakeups {
+    uint64_t due{0};
+    uint64_t stale{0};
+};
+
+// The first `Helper::Timer`, with its wakeups counted like the wheel's
+class ThreadTimer
+{
+public:
+    ThreadTimer(std::chrono::milliseconds interval, std::function<void()> callback)
+        : _interval{interval}, _thread{&ThreadTimer::Thread, this, std::move(callback)}
+    {
+    }
+
+    ~ThreadTimer()
+    {
+        _destroyFlag = true;
+        _destroyConVar.notify_all();
+        _thread.join();
+    }
+
+    void Reset()
+    {
+        _deadline = Clock::now() + _interval;
+    }
+
+    Wakeups GetWakeups() const
+    {
+        return Wakeups{.due = _dueWakeups, .stale = _staleWakeups};
+    }
+
+private:
+    std::atomic<bool> _destroyFlag{false};
+    std::mutex _mutex;
+    std::condition_variable _destroyConVar;
+    std::chrono::milliseconds _interval;
+    std::atomic<Clock::time_point> _deadline{Clock::now() + _interval};
+    std::atomic<uint64_t> _dueWakeups{0}, _staleWakeups{0};
+    std::thread _thread;
+
+    void Thread(std::function<void()> callback)
+    {
+        while (true) {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _destroyConVar.wait_until(lock, _deadline.load());
+            lock.unlock();
+
+            if (_destroyFlag) {
+                break;
+            }
+            if (_deadline.load() > Clock::now()) {
+                ++_staleWakeups;
+                continue;
+            }
+            ++_dueWakeups;
+            Reset();
+            callback();
+        }
+    }
+};
+
+// The second `Helper::TimerScheduler`, with its wakeups counted like the wheel's
+class HeapScheduler
+{
+public:
+    using FnTrigger = std::function<void()>;
+
+    static constexpr size_t kNotScheduled = std::numeric_limits<size_t>::max();
+
+    struct Entry {
+        std::chrono::milliseconds interval{};
+        std::shared_ptr<const FnTrigger> callback;
+        Clock::time_point deadline;
+        size_t heapIndex{kNotScheduled};
+    };
+
+    HeapScheduler() : _thread{[this] { Thread(); }} {}
+
+    ~HeapScheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _stop = true;
+        }
+        _wakeConVar.notify_all();
+        _thread.join();
+    }
+
+    void Add(Entry &entry, Clock::time_point deadline)
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        if (entry.heapIndex != kNotScheduled) {
+            return;
+        }
+        entry.deadline = deadline;
+        entry.heapIndex = _heap.size();
+        _heap.push_back(&entry);
+        SiftUp(entry.heapIndex);
+        WakeIfFirst(entry);
+    }
+
+    void Reschedule(Entry &entry)
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        if (entry.heapIndex == kNotScheduled) {
+            return;
+        }
+        entry.deadline = Clock::now() + entry.interval;
+        SiftDown(SiftUp(entry.heapIndex));
+        WakeIfFirst(entry);
+    }
+
+    void Remove(Entry &entry)
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+
+        if (entry.heapIndex != kNotScheduled) {
+            const size_t index = entry.heapIndex;
+            SwapNodes(index, _heap.size() - 1);
+            _heap.pop_back();
+            entry.heapIndex = kNotScheduled;
+            if (index < _heap.size()) {
+                SiftDown(SiftUp(index));
+            }
+        }
+        _idleConVar.wait(lock, [&] { return _running != &entry; });
+    }
+
+    Wakeups GetWakeups() const
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        return _wakeups;
+    }
+
+private:
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeConVar, _idleConVar;
+    std::vector<Entry *> _heap;
+    Clock::time_point _wakeAt{Clock::time_point::max()};
+    const Entry *_running{nullptr};
+    Wakeups _wakeups;
+    bool _stop{false};
+    std::thread _thread;
+
+    void Thread()
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        bool woken = false;
+        while (!_stop) {
+            const auto now = Clock::now();
+            if (_heap.empty() || _heap.front()->deadline > now) {
+                if (woken) {
+                    ++_wakeups.stale;
+                }
+                _wakeAt = _heap.empty() ? Clock::time_point::max() : _heap.front()->deadline;
+                if (_heap.empty()) {
+                    _wakeConVar.wait(lock);
+                }
+                else {
+                    _wakeConVar.wait_until(lock, _wakeAt);
+                }
+                _wakeAt = Clock::time_point::min();
+                woken = true;
+                continue;
+            }
+            if (woken) {
+                ++_wakeups.due;
+                woken = false;
+            }
+
+            Entry *entry = _heap.front();
+            entry->deadline = now + entry->interval;
+            SiftDown(0);
+
+            const auto callback = entry->callback;
+            _running = entry;
+            lock.unlock();
+            (*callback)();
+            lock.lock();
+            _running = nullptr;
+            _idleConVar.notify_all();
+        }
+    }
+
+    void WakeIfFirst(const Entry &entry)
+    {
+        if (entry.heapIndex == 0 && entry.deadline < _wakeAt) {
+            _wakeConVar.notify_one();
+        }
+    }
+
+    void SwapNodes(size_t a, size_t b)
+    {
+        std::swap(_heap[a], _heap[b]);
+        _heap[a]->heapIndex = a;
+        _heap[b]->heapIndex = b;
+    }
+
+    size_t SiftUp(size_t index)
+    {
+        while (index != 0) {
+            const size_t parent = (index - 1) / 2;
+            if (_heap[parent]->deadline <= _heap[index]->deadline) {
+                break;
+            }
+            SwapNodes(parent, index);
+            index = parent;
+        }
+        return index;
+    }
+
+    size_t SiftDown(size_t index)
+    {
+        while (true) {
+            const size_t left = index * 2 + 1, right = left + 1;
+            size_t smallest = index;
+            if (left < _heap.size() && _heap[left]->deadline < _heap[smallest]->deadline) {
+                smallest = left;
+            }
+            if (right < _heap.size() && _heap[right]->deadline < _heap[smallest]->deadline) {
+                smallest = right;
+            }
+            if (smallest == index) {
+                return index;
+            }
+            SwapNodes(index, smallest);
+            index = smallest;
+        }
+    }
+};
+
+// The second `Helper::Timer`
+class HeapTimer
+{
+public:
+    HeapTimer(
+        HeapScheduler &scheduler, std::chrono::milliseconds interval,
+        std::function<void()> callback)
+        : _scheduler{scheduler}
+    {
+        _entry.interval = interval;
+        _entry.callback = std::make_shared<const HeapScheduler::FnTrigger>(std::move(callback));
+        _scheduler.Add(_entry, Clock::now() + interval);
+    }
+
+    ~HeapTimer()
+    {
+        _scheduler.Remove(_entry);
+    }
+
+    void Reset()
+    {
+        _scheduler.Reschedule(_entry);
+    }
+
+private:
+    HeapScheduler &_scheduler;
+    HeapScheduler::Entry _entry;
+};
+
+struct Result {
+    double wakeupsPerMinute;
+    double staleWakeupsPerMinute;
+    uint32_t firedWhileRearmed;
+    uint32_t firedAfterwards;
+};
+
+struct Scenario {
+    uint32_t timers;
+    std::chrono::milliseconds interval;
+    std::chrono::milliseconds rearmPeriod;
+    std::chrono::seconds duration;
+};
+
+// Re-arms all timers every `rearmPeriod` for `duration`, then waits for them to fire
+template <class TimerT>
+Result Run(
+    const Scenario &scenario,
+    const std::function<std::unique_ptr<TimerT>(std::function<void()>)> &create,
+    const std::function<Wakeups(const std::vector<std::unique_ptr<TimerT>> &)> &wakeups)
+{
+    std::atomic<uint32_t> fired{0};
+    std::vector<std::unique_ptr<TimerT>> timers;
+    for (uint32_t i = 0; i < scenario.timers; ++i) {
+        timers.push_back(create([&] { ++fired; }));
+    }
+
+    const auto wakeupsBefore = wakeups(timers);
+    const auto start = Clock::now();
+    for (auto next = start; next - start < scenario.duration; next += scenario.rearmPeriod) {
+        for (auto &timer : timers) {
+            timer->Reset();
+        }
+        std::this_thread::sleep_until(next + scenario.rearmPeriod);
+    }
+    const auto elapsed = Clock::now() - start;
+    const auto wakeupsAfter = wakeups(timers);
+    const uint32_t firedWhileRearmed = fired.exchange(0);
+
+    std::this_thread::sleep_for(scenario.interval + std::chrono::milliseconds(100));
+
+    const auto perMinute = [&](uint64_t count) {
+        return static_cast<double>(count) /
+               std::chrono::duration<double, std::ratio<60>>{elapsed}.count();
+    };
+    return Result{
+        .wakeupsPerMinute = perMinute(wakeupsAfter.due - wakeupsBefore.due),
+        .staleWakeupsPerMinute = perMinute(wakeupsAfter.stale - wakeupsBefore.stale),
+        .firedWhileRearmed = firedWhileRearmed,
+        .firedAfterwards = fired.load(),
+    };
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    cxxopts::Options parser{"TimerBenchmark", "Benchmark timeouts re-armed at a fixed rate"};
+
+    parser.add_options()                                                        //
+        ("timers", "Number of timers, the state manager has three.",            //
+         cxxopts::value<uint32_t>()->default_value("3"))                        //
+        ("interval", "Timeout of the timers in milliseconds.",                  //
+         cxxopts::value<uint32_t>()->default_value("10000"))                    //
+        ("rate", "Re-arms per second.",                                         //
+         cxxopts::value<uint32_t>()->default_value("10"))                       //
+        ("seconds", "How long the timers are re-armed.",                        //
+         cxxopts::value<uint32_t>()->default_value("30"));
+
+    Tools::AddIterationsOption(parser, 5);
+
+    const auto options = Tools::ParseOptions(parser, argc, argv);
+    if (!options.has_value()) {
+        return 0;
+    }
+    const auto &args = options.value();
+
+    const Scenario scenario{
+        .timers = args["timers"].as<uint32_t>(),
+        .interval = std::chrono::milliseconds(args["interval"].as<uint32_t>()),
+        .rearmPeriod = std::chrono::milliseconds(1000 / std::max(args["rate"].as<uint32_t>(), 1u)),
+        .duration = std::chrono::seconds(args["seconds"].as<uint32_t>()),
+    };
+
+    const auto threads = Run<ThreadTimer>(
+        scenario,
+        [&](std::function<void()> callback) {
+            return std::make_unique<ThreadTimer>(scenario.interval, std::move(callback));
+        },
+        [](const auto &timers) {
+            Wakeups sum;
+            for (const auto &timer : timers) {
+                const auto wakeups = timer->GetWakeups();
+                sum.due += wakeups.due;
+                sum.stale += wakeups.stale;
+            }
+            return sum;
+        });
+
+    HeapScheduler heapScheduler;
+    const auto heap = Run<HeapTimer>(
+        scenario,
+        [&](std::function<void()> callback) {
+            return std::make_unique<HeapTimer>(
+                heapScheduler, scenario.interval, std::move(callback));
+        },
+        [&](const auto &) { return heapScheduler.GetWakeups(); });
+
+    const auto wheel = Run<Helper::Timer>(
+        scenario,
+        [&](std::function<void()> callback) {
+            return std::make_unique<Helper::Timer>(scenario.interval, std::move(callback));
+        },
+        [](const auto &) {
+            const auto &scheduler = Helper::TimerScheduler::GetInstance();
+            return Wakeups{.due = scheduler.GetWakeups(), .stale = scheduler.GetStaleWakeups()};
+        });
+
+    constexpr uint32_t kRearms = 1'000'000;
+    const uint32_t iterations = Tools::GetIterations(args);
+    const auto rearm = [](auto &timer) {
+        return [&timer] {
+            for (uint32_t i = 0; i < kRearms; ++i) {
+                timer.Reset();
+            }
+        };
+    };
+    ThreadTimer threadTimer{scenario.interval, [] {}};
+    HeapTimer heapTimer{heapScheduler, scenario.interval, [] {}};
+    Helper::Timer wheelTimer{scenario.interval, [] {}};
+    const double threadRearmNs = Tools::Measure(rearm(threadTimer), kRearms, iterations);
+    const double heapRearmNs = Tools::Measure(rearm(heapTimer), kRearms, iterations);
+    const double wheelRearmNs = Tools::Measure(rearm(wheelTimer), kRearms, iterations);
+
+    bool ok = true;
+    const auto report = [&](std::string_view name, const Result &result, double rearmNs) {
+        Tools::Report(
+            name, std::format(
+                      "{:>8.1f} wakeups/min ({:.1f} stale), re-arm {:>6.1f} ns, fired {} while "
+                      "re-armed and {} afterwards",
+                      result.wakeupsPerMinute, result.staleWakeupsPerMinute, rearmNs,
+                      result.firedWhileRearmed, result.firedAfterwards));
+        ok = ok && result.firedWhileRearmed == 0 && result.firedAfterwards == scenario.timers;
+    };
+
+    std::cout << std::format(
+                     "{} timers of {} ms re-armed every {} ms for {} s:", scenario.timers,
+                     scenario.interval.count(), scenario.rearmPeriod.count(),
+                     scenario.duration.count())
+              << std::endl;
+    report("thread per timer", threads, threadRearmNs);
+    report("heap", heap, heapRearmNs);
+    report("timing wheel", wheel, wheelRearmNs);
+
+    if (!ok) {
+        std::cerr << "A timer fired while re-armed, or didn't fire afterwards." << std::endl;
+        return 1;
+    }
+    return 0;
+}